@@ -0,0 +1,221 @@
+#ifndef ASSETIOSYSTEM_H
+#define ASSETIOSYSTEM_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AssetPack.h"
+
+// ASSIMP file access without stdio. Every file an importer opens, the model and side files such as .mtl alike, is
+// an AssetFile (a view into the asset pack, or the loose file memory mapped), and the stream reads straight out of
+// that memory: no FILE*, no stdio buffer, no read() syscalls. Files can also be handed over as in-memory blobs,
+// which take precedence over the pack and the disk.
+
+// bytes served from memory under a path; the memory is not owned and must outlive the import
+struct AssetBlob {
+    std::string path;
+    const void *data;
+    size_t size;
+};
+
+class AssetIOStream : public Assimp::IOStream
+{
+public:
+    // over a file this stream keeps mapped
+    explicit AssetIOStream(AssetFile &&file) : file(std::move(file))
+    {
+        data = this->file.Data();
+        size = this->file.Size();
+    }
+    // over memory owned by someone else
+    AssetIOStream(const void *bytes, size_t length) : data(static_cast<const unsigned char*>(bytes)), size(length)
+    {
+    }
+
+    size_t Read(void *buffer, size_t elementSize, size_t count) override
+    {
+        if (elementSize == 0)
+            return 0;
+        size_t elements = std::min(count, (size - position) / elementSize);
+        std::memcpy(buffer, data + position, elements * elementSize);
+        position += elements * elementSize;
+        return elements;
+    }
+
+    size_t Write(const void*, size_t, size_t) override
+    {
+        return 0;
+    }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? position : size;
+        if (origin == aiOrigin_END ? offset > size : offset > size - base)
+            return aiReturn_FAILURE;
+        position = origin == aiOrigin_END ? size - offset : base + offset;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return position; }
+    size_t FileSize() const override { return size; }
+    void Flush() override {}
+
+private:
+    AssetFile file;
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    size_t position = 0;
+};
+
+// Installed on an Assimp::Importer with SetIOHandler(), which takes ownership. Read only: opening for writing fails.
+// With opened given, every path the importer asks to open is added to it (once), found or not.
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+    explicit AssetIOSystem(const std::vector<AssetBlob> *blobs = nullptr, std::atomic<size_t> *bytesServed = nullptr,
+                           std::vector<std::string> *opened = nullptr)
+        : blobs(blobs), bytesServed(bytesServed), opened(opened)
+    {
+    }
+
+    bool Exists(const char *path) const override
+    {
+        if (findBlob(path))
+            return true;
+        AssetView view;
+        if (Assets().Find(path, view))
+            return true;
+        int64_t mtime;
+        uint64_t size;
+        return FileStamp(path, mtime, size);
+    }
+
+    char getOsSeparator() const override
+    {
+        return '/';
+    }
+
+    Assimp::IOStream* Open(const char *path, const char *mode = "rb") override
+    {
+        if (std::strpbrk(mode, "wa+"))
+            return nullptr;
+        if (opened && std::find(opened->begin(), opened->end(), path) == opened->end())
+            opened->push_back(path);
+        if (const AssetBlob *blob = findBlob(path))
+        {
+            count(blob->size);
+            return new AssetIOStream(blob->data, blob->size);
+        }
+        AssetFile file(path);
+        if (!file.IsOpen())
+            return nullptr;
+        count(file.Size());
+        return new AssetIOStream(std::move(file));
+    }
+
+    void Close(Assimp::IOStream *stream) override
+    {
+        delete stream;
+    }
+
+    bool ComparePaths(const char *one, const char *second) const override
+    {
+        return NormalizeAssetPath(one) == NormalizeAssetPath(second);
+    }
+
+private:
+    const std::vector<AssetBlob> *blobs;
+    std::atomic<size_t> *bytesServed;
+    std::vector<std::string> *opened;
+
+    const AssetBlob* findBlob(const char *path) const
+    {
+        if (!blobs || blobs->empty())
+            return nullptr;
+        std::string normalized = NormalizeAssetPath(path);
+        for (const AssetBlob &blob : *blobs)
+            if (NormalizeAssetPath(blob.path) == normalized)
+                return &blob;
+        return nullptr;
+    }
+
+    void count(size_t bytes)
+    {
+        if (bytesServed)
+            *bytesServed += bytes;
+    }
+};
+
+// Runs ASSIMP on every model below root twice per round, once with its default stdio IOSystem and once with
+// AssetIOSystem, and prints the import throughput of both (source bytes, model and side files, over wall time).
+// The rounds alternate so both paths see the same page cache.
+inline void BenchmarkAssimpIO(const std::string &root, unsigned int flags, int rounds = 3)
+{
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(root))
+        if (entry.is_regular_file() && AssetFormatFor(entry.path().string()) == ASSET_MODEL)
+            paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+
+    std::cout << "ASSIMP IO BENCHMARK (" << rounds << " rounds)" << std::endl;
+    char line[256];
+    std::snprintf(line, sizeof(line), "  %-36s %9s %12s %12s %8s", "model", "bytes", "stdio", "mapped", "speedup");
+    std::cout << line << std::endl;
+    double totalBytes = 0.0, totalDefault = 0.0, totalMapped = 0.0;
+    for (const std::string &path : paths)
+    {
+        double defaultMs = 0.0, mappedMs = 0.0;
+        size_t bytes = 0;
+        bool failed = false;
+        for (int round = 0; round < rounds && !failed; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            {
+                Assimp::Importer importer;
+                failed |= importer.ReadFile(path, flags) == nullptr;
+            }
+            defaultMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::atomic<size_t> served{0};
+            start = std::chrono::steady_clock::now();
+            {
+                Assimp::Importer importer;
+                importer.SetIOHandler(new AssetIOSystem(nullptr, &served));
+                failed |= importer.ReadFile(path, flags) == nullptr;
+            }
+            mappedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            bytes = served;
+        }
+        if (failed)
+        {
+            std::snprintf(line, sizeof(line), "  %-36s could not be imported", path.c_str());
+            std::cout << line << std::endl;
+            continue;
+        }
+        double megabytes = bytes * (double)rounds / (1024.0 * 1024.0);
+        std::snprintf(line, sizeof(line), "  %-36s %8.1fM %8.1f MB/s %8.1f MB/s %7.2fx", path.c_str(), bytes / (1024.0 * 1024.0),
+                      megabytes / (defaultMs / 1000.0), megabytes / (mappedMs / 1000.0), defaultMs / mappedMs);
+        std::cout << line << std::endl;
+        totalBytes += megabytes;
+        totalDefault += defaultMs;
+        totalMapped += mappedMs;
+    }
+    if (totalDefault > 0.0 && totalMapped > 0.0)
+    {
+        std::snprintf(line, sizeof(line), "  %-36s %9s %8.1f MB/s %8.1f MB/s %7.2fx", "total", "",
+                      totalBytes / (totalDefault / 1000.0), totalBytes / (totalMapped / 1000.0), totalDefault / totalMapped);
+        std::cout << line << std::endl;
+    }
+}
+#endif
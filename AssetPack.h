@@ -0,0 +1,387 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Single-file archive of the res/ tree ("res.pack"), built offline with "app --build-pack". The file is
+//   header | index: one fixed-size entry per file, sorted by path hash | path strings | payloads
+// and every payload starts on a page boundary, so a lookup is a binary search over the mapped index and the asset
+// is handed to its loader as a view straight into the mapping: no open, no read, no copy. Paths are stored as given
+// to the builder ("res/Bus/buscolor.png"), which is how the loaders ask for them.
+// Files that are not in the pack (or all of them, when there is no pack) are read from disk, see AssetFile.
+
+enum AssetFormat : uint32_t {
+    ASSET_RAW,
+    ASSET_MODEL,       // .obj and other ASSIMP sources
+    ASSET_MATERIAL,    // .mtl
+    ASSET_IMAGE,       // .png/.jpg, decoded by stb_image
+    ASSET_KTX2,        // baked BCn textures
+    ASSET_MESH_CACHE,  // see MeshCache.h
+    ASSET_SHADER,
+};
+
+inline AssetFormat AssetFormatFor(const std::string &path)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (extension == ".obj" || extension == ".fbx" || extension == ".gltf" || extension == ".glb")
+        return ASSET_MODEL;
+    if (extension == ".mtl")
+        return ASSET_MATERIAL;
+    if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga")
+        return ASSET_IMAGE;
+    if (extension == ".ktx2")
+        return ASSET_KTX2;
+    if (extension == ".meshcache")
+        return ASSET_MESH_CACHE;
+    if (extension == ".shader" || extension == ".vs" || extension == ".fs")
+        return ASSET_SHADER;
+    return ASSET_RAW;
+}
+
+// "res\Bus/./a/../buscolor.png" -> "res/Bus/buscolor.png", so every spelling of a path finds the same entry
+inline std::string NormalizeAssetPath(const std::string &path)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find_first_of("/\\", start);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string part = path.substr(start, end - start);
+        if (part == "..")
+        {
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else
+                parts.push_back(part);
+        }
+        else if (!part.empty() && part != ".")
+            parts.push_back(part);
+        start = end + 1;
+    }
+    std::string normalized = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+    for (const std::string &part : parts)
+        normalized += (normalized.empty() || normalized == "/" ? "" : "/") + part;
+    return normalized;
+}
+
+// a file's bytes inside the pack; valid as long as the pack stays open
+struct AssetView {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    AssetFormat format = ASSET_RAW;
+};
+
+class AssetPack
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const uint32_t ALIGNMENT = 4096;
+
+    struct Header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t entrySize;    // sizeof(Entry) when written
+        uint32_t alignment;
+        uint64_t namesOffset;
+        uint64_t namesSize;
+    };
+
+    struct Entry {
+        uint64_t pathHash;     // HashBytes() of the normalized path
+        uint64_t offset;
+        uint64_t size;
+        uint32_t format;       // AssetFormat
+        uint32_t nameOffset;   // into the path strings, to tell hash collisions apart
+    };
+
+    // maps the pack at path; returns false (and serves nothing) if it is missing or malformed
+    bool Open(const std::string &path)
+    {
+        Close();
+        if (!file.Open(path) || file.Size() < sizeof(Header))
+        {
+            file.Close();
+            return false;
+        }
+        const Header *header = reinterpret_cast<const Header*>(file.Data());
+        uint64_t indexEnd = sizeof(Header) + (uint64_t)header->entryCount * sizeof(Entry);
+        if (std::memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION ||
+            header->entrySize != sizeof(Entry) || indexEnd > file.Size() ||
+            header->namesOffset > file.Size() || header->namesSize > file.Size() - header->namesOffset)
+        {
+            std::cout << "ERROR::ASSET PACK:: " << path << " is not a version " << VERSION << " asset pack" << std::endl;
+            file.Close();
+            return false;
+        }
+        entries = reinterpret_cast<const Entry*>(file.Data() + sizeof(Header));
+        for (uint32_t i = 0; i < header->entryCount; i++)
+            if (entries[i].offset > file.Size() || entries[i].size > file.Size() - entries[i].offset ||
+                entries[i].nameOffset >= header->namesSize)
+            {
+                std::cout << "ERROR::ASSET PACK:: " << path << " is truncated" << std::endl;
+                file.Close();
+                entries = nullptr;
+                return false;
+            }
+        entryCount = header->entryCount;
+        names = reinterpret_cast<const char*>(file.Data() + header->namesOffset);
+        namesSize = header->namesSize;
+        return true;
+    }
+
+    void Close()
+    {
+        file.Close();
+        entries = nullptr;
+        entryCount = 0;
+        names = nullptr;
+        namesSize = 0;
+    }
+
+    bool IsOpen() const { return file.IsOpen(); }
+    size_t Count() const { return entryCount; }
+    size_t Bytes() const { return file.Size(); }
+
+    // looks path up in the index; the view points into the mapping, nothing is copied
+    bool Find(const std::string &path, AssetView &view) const
+    {
+        if (!entries)
+            return false;
+        std::string normalized = NormalizeAssetPath(path);
+        uint64_t hash = HashBytes(normalized.data(), normalized.size());
+        const Entry *end = entries + entryCount;
+        const Entry *entry = std::lower_bound(entries, end, hash, [](const Entry &e, uint64_t h) { return e.pathHash < h; });
+        for (; entry != end && entry->pathHash == hash; entry++)
+        {
+            const char *name = names + entry->nameOffset;
+            if (std::strncmp(name, normalized.c_str(), namesSize - entry->nameOffset) != 0)
+                continue;
+            view.data = file.Data() + entry->offset;
+            view.size = (size_t)entry->size;
+            view.format = (AssetFormat)entry->format;
+            return true;
+        }
+        return false;
+    }
+
+    bool Contains(const std::string &path) const
+    {
+        AssetView view;
+        return Find(path, view);
+    }
+
+    // packs every file below root into packPath (written under a temporary name and renamed into place)
+    static int Build(const std::string &root, const std::string &packPath)
+    {
+        auto start = std::chrono::steady_clock::now();
+        struct Source {
+            std::string path;
+            uint64_t size;
+        };
+        std::vector<Source> sources;
+        std::error_code error;
+        for (const auto &item : std::filesystem::recursive_directory_iterator(root, error))
+        {
+            std::string path = NormalizeAssetPath(item.path().string());
+            if (!item.is_regular_file() || path == NormalizeAssetPath(packPath) || item.path().extension() == ".tmp")
+                continue;
+            sources.push_back(Source{ path, (uint64_t)item.file_size() });
+        }
+        if (error)
+        {
+            std::cout << "ERROR::ASSET PACK:: could not read " << root << ": " << error.message() << std::endl;
+            return 1;
+        }
+
+        // index sorted by hash; the path strings follow it, then the payloads in path order
+        std::vector<Entry> index(sources.size());
+        std::string nameTable;
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            Entry &e = index[i];
+            std::memset(&e, 0, sizeof(e));
+            e.pathHash = HashBytes(sources[i].path.data(), sources[i].path.size());
+            e.size = sources[i].size;
+            e.format = AssetFormatFor(sources[i].path);
+            e.nameOffset = (uint32_t)nameTable.size();
+            nameTable += sources[i].path;
+            nameTable.push_back('\0');
+        }
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.entryCount = (uint32_t)index.size();
+        header.entrySize = sizeof(Entry);
+        header.alignment = ALIGNMENT;
+        header.namesOffset = sizeof(Header) + index.size() * sizeof(Entry);
+        header.namesSize = nameTable.size();
+        uint64_t offset = align(header.namesOffset + header.namesSize);
+        for (Entry &e : index)
+        {
+            e.offset = offset;
+            offset = align(offset + e.size);
+        }
+        std::vector<Entry> sorted(index);
+        std::sort(sorted.begin(), sorted.end(), [](const Entry &a, const Entry &b) { return a.pathHash < b.pathHash; });
+        for (size_t i = 1; i < sorted.size(); i++)
+            if (sorted[i].pathHash == sorted[i - 1].pathHash)
+                std::cout << "ERROR::ASSET PACK:: hash collision between " << &nameTable[sorted[i].nameOffset] << " and "
+                          << &nameTable[sorted[i - 1].nameOffset] << ", both are kept" << std::endl;
+
+        std::string tempPath = packPath + ".tmp";
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cout << "ERROR::ASSET PACK:: could not write " << tempPath << std::endl;
+            return 1;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(sorted.data()), sorted.size() * sizeof(Entry));
+        out.write(nameTable.data(), nameTable.size());
+        uint64_t written = header.namesOffset + header.namesSize;
+        bool failed = false;
+        for (size_t i = 0; i < sources.size() && !failed; i++)
+        {
+            pad(out, written, index[i].offset);
+            MappedFile source(sources[i].path);
+            if (sources[i].size && (!source.IsOpen() || source.Size() != sources[i].size))
+            {
+                std::cout << "ERROR::ASSET PACK:: could not read " << sources[i].path << std::endl;
+                failed = true;
+                break;
+            }
+            out.write(reinterpret_cast<const char*>(source.Data()), (std::streamsize)source.Size());
+            written += source.Size();
+        }
+        pad(out, written, offset);
+        out.close();
+        if (failed || !out || std::rename(tempPath.c_str(), packPath.c_str()) != 0)
+        {
+            std::remove(tempPath.c_str());
+            std::cout << "ERROR::ASSET PACK:: could not write " << packPath << std::endl;
+            return 1;
+        }
+
+        uint64_t payload = 0;
+        for (const Source &source : sources)
+            payload += source.size;
+        char line[256];
+        std::snprintf(line, sizeof(line), "ASSET PACK:: %zu files (%.1f MB) from %s into %s (%.1f MB) in %.1fms",
+                      sources.size(), payload / (1024.0 * 1024.0), root.c_str(), packPath.c_str(), offset / (1024.0 * 1024.0),
+                      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::cout << line << std::endl;
+        return 0;
+    }
+
+private:
+    static constexpr const char MAGIC[9] = "ASSETPAK";
+
+    MappedFile file;
+    const Entry *entries = nullptr;
+    size_t entryCount = 0;
+    const char *names = nullptr;
+    uint64_t namesSize = 0;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + ALIGNMENT - 1) & ~(uint64_t)(ALIGNMENT - 1);
+    }
+
+    static void pad(std::ofstream &out, uint64_t &written, uint64_t target)
+    {
+        static const char zeros[ALIGNMENT] = {};
+        if (target > written)
+            out.write(zeros, (std::streamsize)(target - written));
+        written = target;
+    }
+};
+
+// the pack every loader reads from; opened once at startup, before any loading starts
+inline AssetPack& Assets()
+{
+    static AssetPack pack;
+    return pack;
+}
+
+// The bytes of an asset: a view into the pack if it has the file, otherwise the file on disk, memory mapped.
+// Drop-in for MappedFile in the loaders.
+class AssetFile
+{
+public:
+    AssetFile() {}
+    explicit AssetFile(const std::string &path)
+    {
+        Open(path);
+    }
+
+    AssetFile(const AssetFile&) = delete;
+    AssetFile& operator=(const AssetFile&) = delete;
+    AssetFile(AssetFile &&other) noexcept : file(std::move(other.file)), data(other.data), size(other.size)
+    {
+        other.data = nullptr;
+        other.size = 0;
+    }
+    AssetFile& operator=(AssetFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            file = std::move(other.file);
+            data = other.data;
+            size = other.size;
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    bool Open(const std::string &path)
+    {
+        Close();
+        AssetView view;
+        if (Assets().Find(path, view))
+        {
+            data = view.data;
+            size = view.size;
+            return true;
+        }
+        if (!file.Open(path))
+            return false;
+        data = file.Data();
+        size = file.Size();
+        return true;
+    }
+
+    void Close()
+    {
+        file.Close();
+        data = nullptr;
+        size = 0;
+    }
+
+    bool IsOpen() const { return data != nullptr; }
+    bool FromPack() const { return data != nullptr && !file.IsOpen(); }
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    MappedFile file;   // only for loose files
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+#endif
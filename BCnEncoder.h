@@ -0,0 +1,495 @@
+#ifndef BCNENCODER_H
+#define BCNENCODER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "ThreadPool.h"
+
+// CPU block-compression encoders for the GPU formats we ship (BC1, BC3, BC4, BC5 and BC7 mode 6) plus the box
+// filtered mip chain they are built from. Nothing in here needs a GL context or a GPU, so textures can be baked on a
+// headless build machine. Block encoders take 16 RGBA pixels (row-major 4x4) and write one compressed block.
+
+enum class BCFormat : uint32_t {
+    BC1 = 1,   // RGB, 4 bpp
+    BC3 = 3,   // RGBA, 8 bpp (BC4 alpha + BC1 color)
+    BC4 = 4,   // single channel, 4 bpp
+    BC5 = 5,   // two channels, 8 bpp (two BC4 blocks)
+    BC7 = 7    // RGBA, 8 bpp, mode 6 only
+};
+
+inline size_t BCBlockBytes(BCFormat format)
+{
+    return (format == BCFormat::BC1 || format == BCFormat::BC4) ? 8 : 16;
+}
+
+inline const char* BCFormatName(BCFormat format)
+{
+    switch (format)
+    {
+        case BCFormat::BC1: return "BC1";
+        case BCFormat::BC3: return "BC3";
+        case BCFormat::BC4: return "BC4";
+        case BCFormat::BC5: return "BC5";
+        case BCFormat::BC7: return "BC7";
+    }
+    return "?";
+}
+
+// an uncompressed RGBA8 image, one level of a mip chain
+struct RGBAImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// ------------------------------------------------------------------------
+// helpers
+
+inline float bcClamp(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// principal axis of the colors (first `channels` channels) by power iteration on the covariance matrix
+inline void bcPrincipalAxis(const uint8_t *rgba, int channels, float mean[4], float axis[4])
+{
+    for (int c = 0; c < 4; c++)
+        mean[c] = 0.0f;
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += rgba[i * 4 + c];
+    for (int c = 0; c < channels; c++)
+        mean[c] /= 16.0f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                cov[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+
+    // start from the bounding box diagonal, which is already close for most blocks
+    float lo[4] = { 255, 255, 255, 255 }, hi[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+        {
+            lo[c] = std::min(lo[c], (float)rgba[i * 4 + c]);
+            hi[c] = std::max(hi[c], (float)rgba[i * 4 + c]);
+        }
+    for (int c = 0; c < 4; c++)
+        axis[c] = c < channels ? hi[c] - lo[c] : 0.0f;
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                next[a] += cov[a][b] * axis[b];
+        float length = 0.0f;
+        for (int c = 0; c < channels; c++)
+            length = std::max(length, std::fabs(next[c]));
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+    float length = 0.0f;
+    for (int c = 0; c < channels; c++)
+        length += axis[c] * axis[c];
+    length = std::sqrt(length);
+    for (int c = 0; c < channels; c++)
+        axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+}
+
+// endpoints of the block along its principal axis, inset slightly to reduce error at the ends
+inline void bcAxisEndpoints(const uint8_t *rgba, int channels, float lo[4], float hi[4])
+{
+    float mean[4], axis[4];
+    bcPrincipalAxis(rgba, channels, mean, axis);
+    float tMin = 1e9f, tMax = -1e9f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    float inset = (tMax - tMin) / 16.0f;
+    tMin += inset;
+    tMax -= inset;
+    for (int c = 0; c < 4; c++)
+    {
+        lo[c] = c < channels ? bcClamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f) : 255.0f;
+        hi[c] = c < channels ? bcClamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f) : 255.0f;
+    }
+}
+
+// ------------------------------------------------------------------------
+// BC1
+
+inline uint16_t bcPack565(const float c[3])
+{
+    int r = (int)(bcClamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(bcClamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(bcClamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void bcUnpack565(uint16_t packed, int c[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+// picks the best of the four palette entries for every pixel, returns the packed indices and the total error
+inline uint32_t bcSelectBC1Indices(const uint8_t *rgba, uint16_t c0, uint16_t c1, int &error)
+{
+    int palette[4][3];
+    bcUnpack565(c0, palette[0]);
+    bcUnpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    error = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 4; p++)
+        {
+            int dr = rgba[i * 4] - palette[p][0], dg = rgba[i * 4 + 1] - palette[p][1], db = rgba[i * 4 + 2] - palette[p][2];
+            int e = dr * dr + dg * dg + db * db;
+            if (e < bestError)
+            {
+                bestError = e;
+                best = p;
+            }
+        }
+        indices |= (uint32_t)best << (i * 2);
+        error += bestError;
+    }
+    return indices;
+}
+
+inline void bcWriteBC1(uint8_t *out, uint16_t c0, uint16_t c1, uint32_t indices)
+{
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+// four-color BC1 block (c0 > c1); this interpretation is also what BC3's color half always uses
+inline void EncodeBC1Block(const uint8_t *rgba, uint8_t *out)
+{
+    float lo[4], hi[4];
+    bcAxisEndpoints(rgba, 3, lo, hi);
+    uint16_t c0 = bcPack565(hi), c1 = bcPack565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    if (c0 == c1)
+    {
+        // flat block: every pixel takes color 0
+        bcWriteBC1(out, c0, c1, 0);
+        return;
+    }
+    int error;
+    uint32_t indices = bcSelectBC1Indices(rgba, c0, c1, error);
+
+    // one least-squares refit of the endpoints to the chosen indices
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0, bb = 0, ab = 0, ax[3] = {}, bx[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+        aa += a * a; bb += b * b; ab += a * b;
+        for (int c = 0; c < 3; c++)
+        {
+            ax[c] += a * rgba[i * 4 + c];
+            bx[c] += b * rgba[i * 4 + c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) > 1e-6f)
+    {
+        float e0[3], e1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+            e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+        uint16_t r0 = bcPack565(e0), r1 = bcPack565(e1);
+        if (r0 < r1)
+            std::swap(r0, r1);
+        if (r0 != r1)
+        {
+            int refitError;
+            uint32_t refitIndices = bcSelectBC1Indices(rgba, r0, r1, refitError);
+            if (refitError < error)
+            {
+                c0 = r0; c1 = r1; indices = refitIndices;
+            }
+        }
+    }
+    bcWriteBC1(out, c0, c1, indices);
+}
+
+// ------------------------------------------------------------------------
+// BC4 / BC5 / BC3 alpha
+
+// single channel block from 16 values, using the eight-value mode (a0 > a1)
+inline void EncodeBC4Values(const uint8_t values[16], uint8_t *out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        lo = std::min(lo, (int)values[i]);
+        hi = std::max(hi, (int)values[i]);
+    }
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    uint64_t indices = 0;
+    if (hi > lo)
+    {
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; p++)
+            {
+                int e = std::abs(values[i] - palette[p]);
+                if (e < bestError)
+                {
+                    bestError = e;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+inline void EncodeBC4Block(const uint8_t *rgba, uint8_t *out, int channel = 0)
+{
+    uint8_t values[16];
+    for (int i = 0; i < 16; i++)
+        values[i] = rgba[i * 4 + channel];
+    EncodeBC4Values(values, out);
+}
+
+inline void EncodeBC5Block(const uint8_t *rgba, uint8_t *out)
+{
+    EncodeBC4Block(rgba, out, 0);
+    EncodeBC4Block(rgba, out + 8, 1);
+}
+
+inline void EncodeBC3Block(const uint8_t *rgba, uint8_t *out)
+{
+    EncodeBC4Block(rgba, out, 3);
+    EncodeBC1Block(rgba, out + 8);
+}
+
+// ------------------------------------------------------------------------
+// BC7 (mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each, 4-bit indices)
+
+struct bcBitWriter {
+    uint8_t *out;
+    int position = 0;
+
+    void Write(uint32_t value, int bits)
+    {
+        for (int i = 0; i < bits; i++, position++)
+            if (value & (1u << i))
+                out[position >> 3] |= (uint8_t)(1u << (position & 7));
+    }
+};
+
+inline void EncodeBC7Block(const uint8_t *rgba, uint8_t *out)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    float lo[4], hi[4];
+    bcAxisEndpoints(rgba, 4, lo, hi);
+
+    int bestError = 1 << 30;
+    int bestEndpoints[2][4] = {}, bestP[2] = {}, bestIndices[16] = {};
+    for (int pbits = 0; pbits < 4; pbits++)
+    {
+        int p[2] = { pbits & 1, pbits >> 1 };
+        int quantized[2][4], expanded[2][4];
+        for (int c = 0; c < 4; c++)
+        {
+            const float ends[2] = { lo[c], hi[c] };
+            for (int e = 0; e < 2; e++)
+            {
+                int q = (int)std::floor((ends[e] - p[e]) / 2.0f + 0.5f);
+                quantized[e][c] = std::max(0, std::min(127, q));
+                expanded[e][c] = (quantized[e][c] << 1) | p[e];
+            }
+        }
+        int palette[16][4];
+        for (int w = 0; w < 16; w++)
+            for (int c = 0; c < 4; c++)
+                palette[w][c] = ((64 - weights[w]) * expanded[0][c] + weights[w] * expanded[1][c] + 32) >> 6;
+        int error = 0, indices[16];
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestPixelError = 1 << 30;
+            for (int w = 0; w < 16; w++)
+            {
+                int e = 0;
+                for (int c = 0; c < 4; c++)
+                {
+                    int d = rgba[i * 4 + c] - palette[w][c];
+                    e += d * d;
+                }
+                if (e < bestPixelError)
+                {
+                    bestPixelError = e;
+                    best = w;
+                }
+            }
+            indices[i] = best;
+            error += bestPixelError;
+        }
+        if (error < bestError)
+        {
+            bestError = error;
+            std::memcpy(bestEndpoints, quantized, sizeof(quantized));
+            bestP[0] = p[0];
+            bestP[1] = p[1];
+            std::memcpy(bestIndices, indices, sizeof(indices));
+        }
+    }
+
+    // the anchor (first) index is stored with its top bit implied zero, so flip the block if needed
+    if (bestIndices[0] & 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+        std::swap(bestP[0], bestP[1]);
+        for (int i = 0; i < 16; i++)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    std::memset(out, 0, 16);
+    bcBitWriter writer{out};
+    writer.Write(1u << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        writer.Write(bestEndpoints[0][c], 7);
+        writer.Write(bestEndpoints[1][c], 7);
+    }
+    writer.Write(bestP[0], 1);
+    writer.Write(bestP[1], 1);
+    writer.Write(bestIndices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.Write(bestIndices[i], 4);
+}
+
+// ------------------------------------------------------------------------
+// images
+
+// expands 1-4 channel 8-bit pixels to RGBA (grey is replicated, missing alpha is opaque)
+inline RGBAImage ToRGBA(const uint8_t *pixels, int width, int height, int components)
+{
+    RGBAImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 4);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        const uint8_t *src = pixels + i * components;
+        uint8_t *dst = &image.pixels[i * 4];
+        if (components >= 3)
+        {
+            dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+        }
+        else
+        {
+            dst[0] = dst[1] = dst[2] = src[0];
+        }
+        dst[3] = components == 4 ? src[3] : (components == 2 ? src[1] : 255);
+    }
+    return image;
+}
+
+// next mip level with a 2x2 box filter (odd sizes clamp to the edge)
+inline RGBAImage DownsampleRGBA(const RGBAImage &source)
+{
+    RGBAImage level;
+    level.width = std::max(1, source.width / 2);
+    level.height = std::max(1, source.height / 2);
+    level.pixels.resize((size_t)level.width * level.height * 4);
+    for (int y = 0; y < level.height; y++)
+        for (int x = 0; x < level.width; x++)
+        {
+            int x0 = std::min(x * 2, source.width - 1), x1 = std::min(x * 2 + 1, source.width - 1);
+            int y0 = std::min(y * 2, source.height - 1), y1 = std::min(y * 2 + 1, source.height - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] + source.pixels[((size_t)y0 * source.width + x1) * 4 + c] +
+                          source.pixels[((size_t)y1 * source.width + x0) * 4 + c] + source.pixels[((size_t)y1 * source.width + x1) * 4 + c];
+                level.pixels[((size_t)y * level.width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    return level;
+}
+
+// full mip chain down to 1x1, level 0 first
+inline std::vector<RGBAImage> BuildMipChain(RGBAImage base)
+{
+    std::vector<RGBAImage> levels;
+    levels.push_back(std::move(base));
+    while (levels.back().width > 1 || levels.back().height > 1)
+        levels.push_back(DownsampleRGBA(levels.back()));
+    return levels;
+}
+
+// compresses one level; rows of blocks are spread over the pool when there is one
+inline std::vector<uint8_t> CompressRGBA(const RGBAImage &image, BCFormat format, ThreadPool *pool = nullptr)
+{
+    int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+    size_t blockBytes = BCBlockBytes(format);
+    std::vector<uint8_t> out((size_t)blocksX * blocksY * blockBytes);
+    auto encodeRow = [&](size_t by) {
+        uint8_t block[64];
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            // gather the 4x4 block, clamping at the right and bottom edges
+            for (int y = 0; y < 4; y++)
+                for (int x = 0; x < 4; x++)
+                {
+                    int sx = std::min(bx * 4 + x, image.width - 1), sy = std::min((int)by * 4 + y, image.height - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, &image.pixels[((size_t)sy * image.width + sx) * 4], 4);
+                }
+            uint8_t *dst = &out[((size_t)by * blocksX + bx) * blockBytes];
+            switch (format)
+            {
+                case BCFormat::BC1: EncodeBC1Block(block, dst); break;
+                case BCFormat::BC3: EncodeBC3Block(block, dst); break;
+                case BCFormat::BC4: EncodeBC4Block(block, dst); break;
+                case BCFormat::BC5: EncodeBC5Block(block, dst); break;
+                case BCFormat::BC7: EncodeBC7Block(block, dst); break;
+            }
+        }
+    };
+    if (pool)
+        pool->ParallelFor((size_t)blocksY, encodeRow);
+    else
+        for (int by = 0; by < blocksY; by++)
+            encodeRow(by);
+    return out;
+}
+#endif
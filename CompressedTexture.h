@@ -0,0 +1,484 @@
+#ifndef COMPRESSEDTEXTURE_H
+#define COMPRESSEDTEXTURE_H
+
+#include <GL/glew.h>
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AssetPack.h"
+#include "BCnEncoder.h"
+#include "GLState.h"
+#include "Image.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+// Block-compressed texture cache. Every source image "foo.png" gets a baked "foo.png.ktx2" next to it holding a
+// BCn encoded, fully precomputed mip chain. The files follow the KTX2 layout (header, level index, basic data format
+// descriptor, key/value data) with one extra key recording the source file's mtime and size, so a changed PNG is
+// re-baked. Loading maps the file and feeds glCompressedTexImage2D straight from the mapping.
+
+struct TextureCompressionSettings {
+    bool enabled = true;        // use baked .ktx2 files when they are current
+    bool bakeOnFirstRun = true; // bake missing or stale .ktx2 files after decoding the source image
+    bool useBC7 = false;        // BC7 instead of BC1/BC3 for color (needs ARB_texture_compression_bptc at runtime)
+};
+
+inline TextureCompressionSettings& TextureCompression()
+{
+    static TextureCompressionSettings settings;
+    return settings;
+}
+
+// a mapped .ktx2 file (or its bytes in the asset pack) and the location of each of its mip levels
+struct CompressedImage {
+    struct Level {
+        size_t offset;
+        size_t size;
+        int width;
+        int height;
+    };
+
+    AssetFile file;
+    BCFormat format = BCFormat::BC1;
+    int width = 0;
+    int height = 0;
+    std::vector<Level> levels; // level 0 (largest) first
+
+    bool Valid() const { return file.IsOpen() && !levels.empty(); }
+    const unsigned char* LevelData(size_t level) const { return file.Data() + levels[level].offset; }
+};
+
+// ------------------------------------------------------------------------
+// format tables
+
+inline uint32_t VkFormatFor(BCFormat format)
+{
+    switch (format)
+    {
+        case BCFormat::BC1: return 131; // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case BCFormat::BC3: return 137; // VK_FORMAT_BC3_UNORM_BLOCK
+        case BCFormat::BC4: return 139; // VK_FORMAT_BC4_UNORM_BLOCK
+        case BCFormat::BC5: return 141; // VK_FORMAT_BC5_UNORM_BLOCK
+        case BCFormat::BC7: return 145; // VK_FORMAT_BC7_UNORM_BLOCK
+    }
+    return 0;
+}
+
+inline bool BCFormatFromVk(uint32_t vkFormat, BCFormat &format)
+{
+    const BCFormat all[] = { BCFormat::BC1, BCFormat::BC3, BCFormat::BC4, BCFormat::BC5, BCFormat::BC7 };
+    for (BCFormat f : all)
+        if (VkFormatFor(f) == vkFormat)
+        {
+            format = f;
+            return true;
+        }
+    return false;
+}
+
+inline GLenum GLFormatFor(BCFormat format)
+{
+    switch (format)
+    {
+        case BCFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BCFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BCFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BCFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BCFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return 0;
+}
+
+// whether the current context can sample the format (RGTC is core since 3.0)
+inline bool CompressedFormatSupported(BCFormat format)
+{
+    switch (format)
+    {
+        case BCFormat::BC1:
+        case BCFormat::BC3: return GLEW_EXT_texture_compression_s3tc;
+        case BCFormat::BC4:
+        case BCFormat::BC5: return true;
+        case BCFormat::BC7: return GLEW_ARB_texture_compression_bptc || GLEW_VERSION_4_2;
+    }
+    return false;
+}
+
+// for an image whose material role is unknown (the offline bake): whether its file name, not its directory, says
+// it is a normal map, in any case ("Bus_Normal.png", "brick_normalmap.png")
+inline bool IsNormalMapName(const std::string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    for (char &c : name)
+        c = (char)std::tolower((unsigned char)c);
+    return name.find("normal") != std::string::npos;
+}
+
+// picks a format from what the image holds: grey -> BC4, normal maps -> BC5, alpha -> BC3/BC7, else BC1/BC7.
+// normalMap is the material's word for it (a texture_normal reference)
+inline BCFormat ChooseBCFormat(const RGBAImage &image, bool normalMap)
+{
+    bool grey = true, opaque = true;
+    for (size_t i = 0; i < image.pixels.size(); i += 4)
+    {
+        const uint8_t *p = &image.pixels[i];
+        grey = grey && p[0] == p[1] && p[1] == p[2];
+        opaque = opaque && p[3] == 255;
+    }
+    if (normalMap)
+        return BCFormat::BC5;
+    if (grey && opaque)
+        return BCFormat::BC4;
+    if (TextureCompression().useBC7)
+        return BCFormat::BC7;
+    return opaque ? BCFormat::BC1 : BCFormat::BC3;
+}
+
+// ------------------------------------------------------------------------
+// KTX2 container
+
+class Ktx2
+{
+public:
+    struct SourceStamp {
+        int64_t mtime;
+        uint64_t size;
+    };
+
+    // matches the key/value data against the source file it claims to be baked from
+    struct SourceStampCheck {
+        bool hasSource = false;
+        SourceStamp stamp = {};
+
+        bool Matches(const unsigned char *kvd, size_t length) const
+        {
+            if (!hasSource)
+                return true; // shipped without the source image, the baked file is all we have
+            size_t pos = 0;
+            while (pos + 4 <= length)
+            {
+                uint32_t entryLength;
+                std::memcpy(&entryLength, kvd + pos, 4);
+                const char *key = reinterpret_cast<const char*>(kvd + pos + 4);
+                size_t keyLength = std::strlen(STAMP_KEY) + 1;
+                if (entryLength == keyLength + sizeof(SourceStamp) && pos + 4 + entryLength <= length && std::memcmp(key, STAMP_KEY, keyLength) == 0)
+                {
+                    SourceStamp stored;
+                    std::memcpy(&stored, kvd + pos + 4 + keyLength, sizeof(stored));
+                    return stored.mtime == stamp.mtime && stored.size == stamp.size;
+                }
+                pos += 4 + ((entryLength + 3) & ~3u);
+            }
+            return false;
+        }
+    };
+
+    static std::string PathFor(const std::string &sourcePath)
+    {
+        return sourcePath + ".ktx2";
+    }
+
+    // writes levels (level 0 first) of the given format; sourcePath's stamp goes into the key/value data
+    static bool Write(const std::string &path, BCFormat format, int width, int height,
+                      const std::vector<std::vector<uint8_t>> &levels, const std::string &sourcePath)
+    {
+        std::vector<uint8_t> dfd = basicDescriptor(format);
+        std::vector<uint8_t> kvd;
+        SourceStamp stamp = {};
+        FileStamp(sourcePath, stamp.mtime, stamp.size);
+        appendKeyValue(kvd, STAMP_KEY, &stamp, sizeof(stamp));
+
+        const uint64_t headerSize = 80, levelIndexSize = 24 * levels.size();
+        uint64_t dfdOffset = headerSize + levelIndexSize;
+        uint64_t kvdOffset = dfdOffset + dfd.size();
+        uint64_t offset = kvdOffset + kvd.size();
+
+        // mip data is stored smallest level first, each level aligned to the block size
+        size_t blockBytes = BCBlockBytes(format);
+        std::vector<uint64_t> levelOffsets(levels.size());
+        for (size_t i = levels.size(); i-- > 0; )
+        {
+            offset = (offset + blockBytes - 1) / blockBytes * blockBytes;
+            levelOffsets[i] = offset;
+            offset += levels[i].size();
+        }
+
+        std::string tempPath = path + ".tmp";
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+        out.write(reinterpret_cast<const char*>(identifier), sizeof(identifier));
+        uint32_t header[9] = { VkFormatFor(format), 1, (uint32_t)width, (uint32_t)height, 0, 0, 1, (uint32_t)levels.size(), 0 };
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        uint32_t index[4] = { (uint32_t)dfdOffset, (uint32_t)dfd.size(), (uint32_t)kvdOffset, (uint32_t)kvd.size() };
+        out.write(reinterpret_cast<const char*>(index), sizeof(index));
+        uint64_t sgd[2] = { 0, 0 };
+        out.write(reinterpret_cast<const char*>(sgd), sizeof(sgd));
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            uint64_t entry[3] = { levelOffsets[i], levels[i].size(), levels[i].size() };
+            out.write(reinterpret_cast<const char*>(entry), sizeof(entry));
+        }
+        out.write(reinterpret_cast<const char*>(dfd.data()), dfd.size());
+        out.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+        uint64_t written = kvdOffset + kvd.size();
+        for (size_t i = levels.size(); i-- > 0; )
+        {
+            static const char zeros[16] = {};
+            out.write(zeros, (std::streamsize)(levelOffsets[i] - written));
+            out.write(reinterpret_cast<const char*>(levels[i].data()), levels[i].size());
+            written = levelOffsets[i] + levels[i].size();
+        }
+        out.close();
+        if (!out || std::rename(tempPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // parses an in-memory KTX2 file; level offsets are relative to data
+    static bool Parse(const unsigned char *data, size_t size, CompressedImage &image, SourceStampCheck *check = nullptr)
+    {
+        static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+        if (size < 80 || std::memcmp(data, identifier, sizeof(identifier)) != 0)
+            return false;
+        uint32_t header[9];
+        std::memcpy(header, data + 12, sizeof(header));
+        uint32_t index[4];
+        std::memcpy(index, data + 48, sizeof(index));
+        uint32_t levelCount = std::max(1u, header[7]);
+        if (!BCFormatFromVk(header[0], image.format) || header[4] != 0 || header[6] != 1 || header[8] != 0)
+            return false;
+        if (80 + 24ull * levelCount > size || (uint64_t)index[2] + index[3] > size)
+            return false;
+        if (check && !check->Matches(data + index[2], index[3]))
+            return false;
+
+        image.width = (int)header[2];
+        image.height = (int)header[3];
+        image.levels.clear();
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            uint64_t entry[3];
+            std::memcpy(entry, data + 80 + 24 * i, sizeof(entry));
+            if (entry[0] > size || entry[1] > size - entry[0])
+                return false;
+            CompressedImage::Level level;
+            level.offset = (size_t)entry[0];
+            level.size = (size_t)entry[1];
+            level.width = std::max(1, image.width >> i);
+            level.height = std::max(1, image.height >> i);
+            image.levels.push_back(level);
+        }
+        return true;
+    }
+
+    // maps sourcePath's .ktx2 if it exists and was baked from the current version of the source
+    static bool Open(const std::string &sourcePath, CompressedImage &image)
+    {
+        if (!image.file.Open(PathFor(sourcePath)))
+            return false;
+        SourceStampCheck check;
+        check.hasSource = FileStamp(sourcePath, check.stamp.mtime, check.stamp.size);
+        if (!Parse(image.file.Data(), image.file.Size(), image, &check))
+        {
+            image.file.Close();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char *STAMP_KEY = "GPsourceStamp";
+
+    static void appendKeyValue(std::vector<uint8_t> &kvd, const char *key, const void *value, size_t valueLength)
+    {
+        uint32_t length = (uint32_t)(std::strlen(key) + 1 + valueLength);
+        const uint8_t *lengthBytes = reinterpret_cast<const uint8_t*>(&length);
+        kvd.insert(kvd.end(), lengthBytes, lengthBytes + 4);
+        kvd.insert(kvd.end(), key, key + std::strlen(key) + 1);
+        const uint8_t *valueBytes = static_cast<const uint8_t*>(value);
+        kvd.insert(kvd.end(), valueBytes, valueBytes + valueLength);
+        while (kvd.size() % 4)
+            kvd.push_back(0);
+    }
+
+    // KHR basic data format descriptor for the block format
+    static std::vector<uint8_t> basicDescriptor(BCFormat format)
+    {
+        struct Sample { uint32_t bitOffset, bitLength, channel; };
+        std::vector<Sample> samples;
+        uint32_t colorModel = 0;
+        switch (format)
+        {
+            case BCFormat::BC1: colorModel = 128; samples = { { 0, 64, 0 } }; break;
+            case BCFormat::BC3: colorModel = 130; samples = { { 0, 64, 15 }, { 64, 64, 0 } }; break;
+            case BCFormat::BC4: colorModel = 131; samples = { { 0, 64, 0 } }; break;
+            case BCFormat::BC5: colorModel = 132; samples = { { 0, 64, 0 }, { 64, 64, 1 } }; break;
+            case BCFormat::BC7: colorModel = 134; samples = { { 0, 128, 0 } }; break;
+        }
+        uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+        std::vector<uint32_t> words;
+        words.push_back(4 + blockSize);                         // dfdTotalSize
+        words.push_back(0);                                     // vendorId / descriptorType
+        words.push_back(2 | (blockSize << 16));                 // versionNumber / descriptorBlockSize
+        words.push_back(colorModel | (1 << 8) | (1 << 16));     // model, BT.709 primaries, linear transfer, flags
+        words.push_back(3 | (3 << 8));                          // 4x4x1x1 texel block
+        words.push_back((uint32_t)BCBlockBytes(format));        // bytesPlane0..3
+        words.push_back(0);                                     // bytesPlane4..7
+        for (const Sample &s : samples)
+        {
+            words.push_back(s.bitOffset | ((s.bitLength - 1) << 16) | (s.channel << 24));
+            words.push_back(0);                                 // sample position
+            words.push_back(0);                                 // sampleLower
+            words.push_back(0xFFFFFFFF);                        // sampleUpper
+        }
+        std::vector<uint8_t> bytes(words.size() * 4);
+        std::memcpy(bytes.data(), words.data(), bytes.size());
+        return bytes;
+    }
+};
+
+// ------------------------------------------------------------------------
+// baking and uploading
+
+// compresses a decoded image (with its full mip chain) into sourcePath's .ktx2; blocks are encoded on the pool
+inline bool BakeCompressedTexture(const std::string &sourcePath, const uint8_t *pixels, int width, int height, int components,
+                                  bool normalMap, ThreadPool *pool = nullptr, BCFormat *chosen = nullptr)
+{
+    if (!pixels || width <= 0 || height <= 0)
+        return false;
+    std::vector<RGBAImage> chain = BuildMipChain(ToRGBA(pixels, width, height, components));
+    BCFormat format = ChooseBCFormat(chain[0], normalMap);
+    std::vector<std::vector<uint8_t>> levels;
+    for (const RGBAImage &level : chain)
+        levels.push_back(CompressRGBA(level, format, pool));
+    if (chosen)
+        *chosen = format;
+    if (!Ktx2::Write(Ktx2::PathFor(sourcePath), format, width, height, levels, sourcePath))
+    {
+        std::cout << "ERROR::KTX2:: could not write " << Ktx2::PathFor(sourcePath) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// bakes directory/path's .ktx2 from an image that was just decoded, unless first-run baking is off or it is current;
+// normalMap as the material references it
+inline void BakeCompressedTextureIfStale(const char *path, const std::string &directory, const DecodedImage &image, bool normalMap,
+                                         ThreadPool *pool)
+{
+    if (!TextureCompression().enabled || !TextureCompression().bakeOnFirstRun || !image.pixels)
+        return;
+    std::string sourcePath = directory + '/' + path;
+    int64_t mtime;
+    uint64_t size;
+    if (!FileStamp(sourcePath, mtime, size))
+        return; // decoded from the asset pack, there is no directory to bake into
+    CompressedImage existing;
+    if (Ktx2::Open(sourcePath, existing))
+        return; // current but not usable by this context (BC7 without BPTC), re-baking would not help
+    BakeCompressedTexture(sourcePath, image.pixels.get(), image.width, image.height, image.components, normalMap, pool);
+}
+
+// offline bake: compresses every PNG below root into .ktx2 (files and blocks in parallel); needs no GL context
+inline int BakeTextures(const std::string &root, bool useBC7)
+{
+    TextureCompression().useBC7 = useBC7;
+    std::vector<std::string> sources;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(root))
+        if (entry.is_regular_file() && entry.path().extension() == ".png")
+            sources.push_back(entry.path().string());
+
+    ThreadPool pool;
+    std::vector<std::string> lines(sources.size());
+    std::atomic<int> failures{0};
+    auto start = std::chrono::steady_clock::now();
+    pool.ParallelFor(sources.size(), [&](size_t i) {
+        auto fileStart = std::chrono::steady_clock::now();
+        std::string directory = sources[i].substr(0, sources[i].find_last_of('/'));
+        std::string name = sources[i].substr(sources[i].find_last_of('/') + 1);
+        DecodedImage image = DecodeTexture(name.c_str(), directory);
+        BCFormat format = BCFormat::BC1;
+        if (!BakeCompressedTexture(sources[i], image.pixels.get(), image.width, image.height, image.components,
+                                   IsNormalMapName(sources[i]), &pool, &format))
+        {
+            failures++;
+            lines[i] = "  FAILED " + sources[i];
+            return;
+        }
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-40s %4dx%-4d %s %8.1f KB -> %8.1f KB %7.1fms", sources[i].c_str(), image.width, image.height,
+                      BCFormatName(format), image.Bytes() * 4.0 / 3.0 / 1024.0, std::filesystem::file_size(Ktx2::PathFor(sources[i])) / 1024.0,
+                      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fileStart).count());
+        lines[i] = line;
+    });
+    std::cout << "TEXTURE BAKE (" << pool.Size() << " threads)" << std::endl;
+    for (const std::string &line : lines)
+        std::cout << line << std::endl;
+    std::cout << "  " << sources.size() << " textures in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << "ms" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// opens directory/path's baked texture if compression is enabled, current and usable by this context
+inline bool OpenCompressedTexture(const char *path, const std::string &directory, CompressedImage &image)
+{
+    if (!TextureCompression().enabled)
+        return false;
+    if (!Ktx2::Open(directory + '/' + path, image))
+        return false;
+    if (!CompressedFormatSupported(image.format))
+    {
+        image.file.Close();
+        return false;
+    }
+    return true;
+}
+
+// sampling state shared by all compressed uploads; single channel textures read as grey like their RGB source
+inline void SetCompressedTextureParameters(const CompressedImage &image)
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (image.format == BCFormat::BC4)
+    {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+}
+
+// uploads every level of a mapped compressed image into the given texture, straight from the mapping
+inline void UploadCompressedLevels(unsigned int textureID, const CompressedImage &image)
+{
+    GLState::Instance().BindTexture(textureID);
+    for (size_t i = 0; i < image.levels.size(); i++)
+    {
+        const CompressedImage::Level &level = image.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, GLFormatFor(image.format), level.width, level.height, 0, (GLsizei)level.size, image.LevelData(i));
+    }
+    SetCompressedTextureParameters(image);
+}
+
+inline unsigned int UploadCompressedTexture(const CompressedImage &image)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    UploadCompressedLevels(textureID, image);
+    return textureID;
+}
+#endif
@@ -0,0 +1,253 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+#include <cstdio>
+#include <iostream>
+
+// Tracks the GL state the renderer changes - current program, vertex array, texture per unit, buffer per target,
+// capabilities, depth and blend functions - and skips calls that would not change it. It knows only what went
+// through it, so everything in the renderer binds, enables and deletes through here (deleting unbinds, as GL does).
+// Starts from the defaults of a fresh context; call Invalidate() after code that changes state behind its back.
+// GL thread only.
+class GLState
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    static GLState& Instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (!changed(program, id))
+            return;
+        glUseProgram(id);
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (!changed(vertexArray, id))
+            return;
+        glBindVertexArray(id);
+        // the element buffer binding belongs to the vertex array: whatever the new one has is unknown here
+        buffers[ELEMENT_ARRAY] = UNKNOWN;
+    }
+
+    // binds texture on unit, which becomes the active one
+    void BindTexture(GLuint unit, GLuint texture)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+        {
+            ActiveTexture(unit);
+            issued++;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            return;
+        }
+        if (textures[unit] == texture)
+        {
+            skipped++;
+            return;
+        }
+        ActiveTexture(unit);
+        textures[unit] = texture;
+        issued++;
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // on the active unit, for code that only wants to specify or query the texture
+    void BindTexture(GLuint texture)
+    {
+        BindTexture(activeUnit, texture);
+    }
+
+    void ActiveTexture(GLuint unit)
+    {
+        if (!changed(activeUnit, unit))
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void BindBuffer(GLenum target, GLuint buffer)
+    {
+        int slot = bufferSlot(target);
+        if (slot >= 0 && !changed(buffers[slot], buffer))
+            return;
+        if (slot < 0)
+            issued++;
+        glBindBuffer(target, buffer);
+    }
+
+    // also binds the buffer to the generic target, as GL does
+    void BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        int slot = bufferSlot(target);
+        if (slot >= 0)
+            buffers[slot] = buffer;
+        issued++;
+        glBindBufferBase(target, index, buffer);
+    }
+
+    void SetEnabled(GLenum capability, bool enabled)
+    {
+        int slot = capabilitySlot(capability);
+        if (slot >= 0 && !changed(capabilities[slot], enabled ? ENABLED : DISABLED))
+            return;
+        if (slot < 0)
+            issued++;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void DepthFunc(GLenum function)
+    {
+        if (!changed(depthFunction, function))
+            return;
+        glDepthFunc(function);
+    }
+
+    void DepthMask(bool write)
+    {
+        if (!changed(depthWrite, write ? ENABLED : DISABLED))
+            return;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == source && blendDestination == destination)
+        {
+            skipped++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        issued++;
+        glBlendFunc(source, destination);
+    }
+
+    void DeleteTextures(GLsizei count, const GLuint *ids)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            for (GLuint &bound : textures)
+                if (ids[i] && bound == ids[i])
+                    bound = 0;
+        glDeleteTextures(count, ids);
+    }
+
+    void DeleteBuffers(GLsizei count, const GLuint *ids)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            for (GLuint &bound : buffers)
+                if (ids[i] && bound == ids[i])
+                    bound = 0;
+        glDeleteBuffers(count, ids);
+    }
+
+    void DeleteVertexArrays(GLsizei count, const GLuint *ids)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            if (ids[i] && vertexArray == ids[i])
+            {
+                vertexArray = 0;
+                buffers[ELEMENT_ARRAY] = UNKNOWN;
+            }
+        glDeleteVertexArrays(count, ids);
+    }
+
+    // forgets everything, so the next call of each kind is issued
+    void Invalidate()
+    {
+        program = vertexArray = activeUnit = depthFunction = blendSource = blendDestination = depthWrite = UNKNOWN;
+        for (GLuint &texture : textures)
+            texture = UNKNOWN;
+        for (GLuint &buffer : buffers)
+            buffer = UNKNOWN;
+        for (GLuint &capability : capabilities)
+            capability = UNKNOWN;
+    }
+
+    // calls made and calls skipped since the start
+    size_t Issued() const { return issued; }
+    size_t Skipped() const { return skipped; }
+
+    // per frame since the last report
+    void Report(size_t frames)
+    {
+        if (!frames)
+            return;
+        size_t calls = issued - issuedAtReport, skips = skipped - skippedAtReport;
+        char line[160];
+        std::snprintf(line, sizeof(line), "GL STATE:: %.1f state calls per frame issued, %.1f skipped (%.0f%%)",
+                      (double)calls / frames, (double)skips / frames, calls + skips ? 100.0 * skips / (calls + skips) : 0.0);
+        std::cout << line << std::endl;
+        issuedAtReport = issued;
+        skippedAtReport = skipped;
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    static const GLuint ENABLED = 1, DISABLED = 0;
+    enum { ARRAY, ELEMENT_ARRAY, COPY_READ, COPY_WRITE, PIXEL_PACK, PIXEL_UNPACK, UNIFORM, BUFFER_TARGETS };
+    enum { DEPTH_TEST, BLEND, CULL_FACE, SCISSOR_TEST, STENCIL_TEST, CAPABILITIES };
+
+    // a fresh context: nothing bound, everything disabled, depth test GL_LESS with writes on, blend GL_ONE/GL_ZERO
+    GLuint program = 0, vertexArray = 0, activeUnit = 0;
+    GLuint textures[MAX_TEXTURE_UNITS] = {};
+    GLuint buffers[BUFFER_TARGETS] = {};
+    GLuint capabilities[CAPABILITIES] = {};
+    GLuint depthFunction = GL_LESS, depthWrite = ENABLED;
+    GLuint blendSource = GL_ONE, blendDestination = GL_ZERO;
+    size_t issued = 0, skipped = 0;
+    size_t issuedAtReport = 0, skippedAtReport = 0;
+
+    GLState() {}
+
+    // records value and counts the call; false if it was already set
+    bool changed(GLuint &current, GLuint value)
+    {
+        if (current == value)
+        {
+            skipped++;
+            return false;
+        }
+        current = value;
+        issued++;
+        return true;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_ARRAY_BUFFER: return ARRAY;
+            case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_ARRAY;
+            case GL_COPY_READ_BUFFER: return COPY_READ;
+            case GL_COPY_WRITE_BUFFER: return COPY_WRITE;
+            case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK;
+            case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK;
+            case GL_UNIFORM_BUFFER: return UNIFORM;
+        }
+        return -1;
+    }
+
+    static int capabilitySlot(GLenum capability)
+    {
+        switch (capability)
+        {
+            case GL_DEPTH_TEST: return DEPTH_TEST;
+            case GL_BLEND: return BLEND;
+            case GL_CULL_FACE: return CULL_FACE;
+            case GL_SCISSOR_TEST: return SCISSOR_TEST;
+            case GL_STENCIL_TEST: return STENCIL_TEST;
+        }
+        return -1;
+    }
+};
+#endif
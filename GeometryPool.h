@@ -0,0 +1,350 @@
+#ifndef GEOMETRYPOOL_H
+#define GEOMETRYPOOL_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "GLState.h"
+#include "Residency.h"
+#include "VertexLayout.h"
+
+// first-fit sub-allocation of a range [0, capacity) with a free list kept sorted by offset; freed ranges merge with
+// their neighbours, so unloading models leaves no more holes than the load order makes
+class RangeAllocator
+{
+public:
+    // adds [Capacity(), capacity) to the free space
+    void Grow(size_t capacity)
+    {
+        if (capacity <= total)
+            return;
+        release(total, capacity - total);
+        total = capacity;
+    }
+
+    // false if no free range can hold size bytes at the alignment (a power of two)
+    bool Allocate(size_t size, size_t alignment, size_t &offset)
+    {
+        for (size_t i = 0; i < free.size(); i++)
+        {
+            Range range = free[i];
+            size_t start = (range.offset + alignment - 1) & ~(alignment - 1);
+            if (start + size > range.offset + range.size)
+                continue;
+            // the alignment padding in front and whatever is left behind stay free
+            free.erase(free.begin() + i);
+            size_t end = range.offset + range.size;
+            if (end > start + size)
+                free.insert(free.begin() + i, Range{ start + size, end - start - size });
+            if (start > range.offset)
+                free.insert(free.begin() + i, Range{ range.offset, start - range.offset });
+            used += size;
+            offset = start;
+            return true;
+        }
+        return false;
+    }
+
+    // a range Allocate() returned
+    void Free(size_t offset, size_t size)
+    {
+        used -= size;
+        release(offset, size);
+    }
+
+    size_t Capacity() const { return total; }
+    size_t Used() const { return used; }
+    size_t FreeRanges() const { return free.size(); }
+
+private:
+    struct Range {
+        size_t offset;
+        size_t size;
+    };
+
+    std::vector<Range> free;
+    size_t total = 0;
+    size_t used = 0;
+
+    void release(size_t offset, size_t size)
+    {
+        if (!size)
+            return;
+        auto it = std::lower_bound(free.begin(), free.end(), offset, [](const Range &r, size_t o) { return r.offset < o; });
+        it = free.insert(it, Range{ offset, size });
+        // merge with the next range, then with the previous one
+        if (it + 1 != free.end() && it->offset + it->size == (it + 1)->offset)
+        {
+            it->size += (it + 1)->size;
+            free.erase(it + 1);
+        }
+        if (it != free.begin() && (it - 1)->offset + (it - 1)->size == it->offset)
+        {
+            (it - 1)->size += it->size;
+            free.erase(it);
+        }
+    }
+};
+
+// a mesh's share of a GeometryPool; moves (leaving nothing allocated behind) but does not copy
+struct GeometryRange {
+    size_t slot = 0;          // the pool's record of it
+    bool allocated = false;
+
+    GeometryRange() {}
+    GeometryRange(GeometryRange &&other) noexcept { *this = std::move(other); }
+    GeometryRange& operator=(GeometryRange &&other) noexcept
+    {
+        std::swap(slot, other.slot);
+        std::swap(allocated, other.allocated);
+        return *this;
+    }
+};
+
+// where a range's vertices and indices are in the pool right now; an evicted range comes back wherever there is room
+struct GeometryPlacement {
+    size_t firstVertex = 0;   // the base vertex of its draws
+    size_t indexOffset = 0;   // in bytes, into the pool's index buffer
+};
+
+// what every pool reports, whatever its layout
+class GeometryPoolBase
+{
+public:
+    virtual ~GeometryPoolBase() {}
+    virtual void Report() const = 0;
+
+    // the pools created so far, for ReportGeometryPools()
+    static std::vector<const GeometryPoolBase*>& All()
+    {
+        static std::vector<const GeometryPoolBase*> pools;
+        return pools;
+    }
+};
+
+// Holds the vertices and indices of every mesh in one vertex layout: one vertex buffer of Layout::Packed, one index
+// buffer with the 16- and 32-bit indices of all meshes, and one VAO over both. Meshes get a GeometryRange and are
+// drawn with glDrawElementsBaseVertex at the range's current GeometryPlacement, so the indices stay relative to the
+// mesh. When a buffer is full it is doubled (copied on the GPU, the offsets stay valid); ranges freed by unloaded
+// meshes are reused. Each range, not the shared buffers, is tracked by the residency manager: evicting it copies it
+// to host memory and frees its space for other meshes, and Use() puts it back on its next draw. The buffers never
+// shrink, so the budget bounds the geometry in use, and the pool's capacity is its high-water mark. GL thread only.
+template <typename Layout>
+class GeometryPool : public GeometryPoolBase
+{
+public:
+    static const size_t INITIAL_VERTICES = 64 * 1024;
+    static const size_t INITIAL_INDEX_BYTES = 1 << 20;
+
+    static GeometryPool& Instance()
+    {
+        static GeometryPool pool;
+        return pool;
+    }
+
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    ~GeometryPool()
+    {
+        // at shutdown the context may already be gone, and the driver frees everything anyway
+        if (vao && glfwGetCurrentContext())
+        {
+            GLuint buffers[2] = { vbo, ebo };
+            GLState::Instance().DeleteBuffers(2, buffers);
+            GLState::Instance().DeleteVertexArrays(1, &vao);
+        }
+    }
+
+    // reserves room for a mesh and copies its data in; indices are 4-byte aligned so either index type can follow
+    void Add(const typename Layout::Packed *vertices, size_t vertexCount, const void *indices, size_t indexBytes, GeometryRange &range)
+    {
+        if (!vao)
+            create();
+        size_t slot;
+        if (freeSlots.empty())
+        {
+            slot = slots.size();
+            slots.emplace_back();
+        }
+        else
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        Slot &entry = slots[slot];
+        entry.vertexCount = vertexCount;
+        entry.indexBytes = indexBytes;
+        place(entry, vertices, indices);
+        entry.residencyKey = ResidencyManager::Instance().TrackRange(entry.vertexCount * sizeof(typename Layout::Packed) + entry.indexBytes,
+                                                                     [this, slot]() { evict(slots[slot]); });
+        range.slot = slot;
+        range.allocated = true;
+        meshes++;
+    }
+
+    // gives the range back for other meshes to use
+    void Remove(GeometryRange &range)
+    {
+        if (!range.allocated)
+            return;
+        Slot &entry = slots[range.slot];
+        ResidencyManager::Instance().ForgetRange(entry.residencyKey);
+        if (entry.host.empty())
+            release(entry);
+        entry = Slot();
+        freeSlots.push_back(range.slot);
+        range = GeometryRange();
+        meshes--;
+    }
+
+    GLuint VAO() const { return vao; }
+
+    // tells the residency manager the range is drawn, bringing it back first if it was evicted; returns where it is
+    const GeometryPlacement& Use(const GeometryRange &range)
+    {
+        Slot &entry = slots[range.slot];
+        if (ResidencyManager::Instance().UseRange(entry.residencyKey))
+        {
+            const unsigned char *vertices = entry.host.data();
+            place(entry, reinterpret_cast<const typename Layout::Packed*>(vertices), vertices + entry.vertexCount * sizeof(typename Layout::Packed));
+            std::vector<unsigned char>().swap(entry.host);
+        }
+        return entry.placement;
+    }
+
+    // a range's bytes, on the GPU or evicted
+    void AddUsage(const GeometryRange &range, ResidencyUsage &usage) const
+    {
+        ResidencyManager::Instance().AddRangeUsage(slots[range.slot].residencyKey, usage);
+    }
+
+    void Report() const override
+    {
+        const double MB = 1024.0 * 1024.0;
+        size_t vertexSize = sizeof(typename Layout::Packed);
+        char line[256];
+        std::snprintf(line, sizeof(line), "GEOMETRY POOL:: %-6s %u meshes, vertices %.1f of %.1f MB (%zu free ranges), indices %.1f of %.1f MB (%zu free ranges), %u grows",
+                      Layout::name, meshes, vertexSpace.Used() * vertexSize / MB, vertexSpace.Capacity() * vertexSize / MB, vertexSpace.FreeRanges(),
+                      indexSpace.Used() / MB, indexSpace.Capacity() / MB, indexSpace.FreeRanges(), grows);
+        std::cout << line << std::endl;
+    }
+
+private:
+    struct Slot {
+        GeometryPlacement placement;
+        size_t vertexCount = 0;
+        size_t indexBytes = 0;
+        size_t residencyKey = 0;
+        std::vector<unsigned char> host;   // the vertices, then the indices, while evicted
+    };
+
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    RangeAllocator vertexSpace;   // in vertices
+    RangeAllocator indexSpace;    // in bytes
+    std::vector<Slot> slots;      // by GeometryRange::slot
+    std::vector<size_t> freeSlots;
+    unsigned int meshes = 0, grows = 0;
+
+    GeometryPool()
+    {
+        All().push_back(this);
+    }
+
+    void create()
+    {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        GLState::Instance().BindVertexArray(vao);
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, INITIAL_VERTICES * sizeof(typename Layout::Packed), NULL, GL_STATIC_DRAW);
+        GLState::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, INITIAL_INDEX_BYTES, NULL, GL_STATIC_DRAW);
+        SetupVertexAttributes<Layout>();
+        GLState::Instance().BindVertexArray(0);
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+        vertexSpace.Grow(INITIAL_VERTICES);
+        indexSpace.Grow(INITIAL_INDEX_BYTES);
+    }
+
+    // finds room for the slot's data (growing the buffers if there is none) and uploads it there
+    void place(Slot &entry, const typename Layout::Packed *vertices, const void *indices)
+    {
+        size_t offset;
+        while (!vertexSpace.Allocate(entry.vertexCount, 1, offset))
+            grow(vbo, vertexSpace, std::max(vertexSpace.Capacity() * 2, vertexSpace.Capacity() + entry.vertexCount), sizeof(typename Layout::Packed));
+        entry.placement.firstVertex = offset;
+        while (!indexSpace.Allocate(entry.indexBytes, 4, offset))
+            grow(ebo, indexSpace, std::max(indexSpace.Capacity() * 2, indexSpace.Capacity() + entry.indexBytes + 4), 1);
+        entry.placement.indexOffset = offset;
+
+        // through the copy targets, so the VAO and GL_ARRAY_BUFFER bindings don't change
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, entry.placement.firstVertex * sizeof(typename Layout::Packed), entry.vertexCount * sizeof(typename Layout::Packed), vertices);
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, entry.placement.indexOffset, entry.indexBytes, indices);
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void release(Slot &entry)
+    {
+        vertexSpace.Free(entry.placement.firstVertex, entry.vertexCount);
+        indexSpace.Free(entry.placement.indexOffset, entry.indexBytes);
+    }
+
+    // called by the residency manager: copies the slot's data to host memory and frees its space in the buffers
+    void evict(Slot &entry)
+    {
+        size_t vertexBytes = entry.vertexCount * sizeof(typename Layout::Packed);
+        entry.host.resize(vertexBytes + entry.indexBytes);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, vbo);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, entry.placement.firstVertex * sizeof(typename Layout::Packed), vertexBytes, entry.host.data());
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, ebo);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, entry.placement.indexOffset, entry.indexBytes, entry.host.data() + vertexBytes);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, 0);
+        release(entry);
+    }
+
+    // replaces buffer with one of capacity units, copying the contents over on the GPU, and points the VAO at it
+    void grow(GLuint &buffer, RangeAllocator &space, size_t capacity, size_t unit)
+    {
+        GLuint larger;
+        glGenBuffers(1, &larger);
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, larger);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * unit, NULL, GL_STATIC_DRAW);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, space.Capacity() * unit);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, 0);
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        GLState::Instance().DeleteBuffers(1, &buffer);
+        buffer = larger;
+        space.Grow(capacity);
+        grows++;
+
+        GLState::Instance().BindVertexArray(vao);
+        if (&buffer == &vbo)
+        {
+            GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, vbo);
+            SetupVertexAttributes<Layout>();
+            GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        else
+            GLState::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        GLState::Instance().BindVertexArray(0);
+    }
+};
+
+// one line per vertex layout in use
+inline void ReportGeometryPools()
+{
+    for (const GeometryPoolBase *pool : GeometryPoolBase::All())
+        pool->Report();
+}
+#endif
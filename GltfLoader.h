@@ -0,0 +1,677 @@
+#ifndef GLTFLOADER_H
+#define GLTFLOADER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "AssetIOSystem.h"
+#include "CompressedTexture.h"
+#include "Image.h"
+#include "Json.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// glTF 2.0 importer for .glb files (and .gltf with external buffers), a fast path around ASSIMP.
+// The file and its buffers are memory mapped and stay so until the model is uploaded. A primitive the shaders can
+// read as the file stores it - triangles, float or normalized integer attributes, 16/32-bit indices, all in one
+// buffer, under a node without a transform - becomes DirectGeometry: its buffer range and index data are uploaded
+// straight from the mapping, with attribute pointers taken from the accessors, so nothing is converted per vertex.
+// Other primitives, and all of them when the model's options rework the meshes, are read into MeshData (positions,
+// normals and tangents transformed by their node). Images embedded in a buffer (PNG, JPEG or KTX2) are decoded or
+// mapped straight from the file; images by URI are ordinary texture files next to the model.
+// Anything else (sparse accessors, data: URIs, ...) makes Load() fail with a reason, and ModelT falls back to ASSIMP.
+
+// an image stored inside a glTF buffer, or a .ktx2 referenced by URI: Model::Import() loads these itself, the
+// texture loaders only know files
+struct GltfImage {
+    std::string file;               // the mapped file holding it
+    const unsigned char *data = nullptr;
+    size_t offset = 0;              // of data in file
+    size_t size = 0;
+    bool ktx2 = false;
+};
+
+// decodes (or for KTX2 maps) an image the glTF loader found; data must still be mapped
+inline void LoadGltfImage(const GltfImage &image, DecodedImage &decoded, CompressedImage &compressed)
+{
+    if (image.ktx2)
+    {
+        // the level offsets Parse() finds are relative to the image, the mapping is the whole file
+        if (compressed.file.Open(image.file) && image.offset + image.size <= compressed.file.Size() &&
+            Ktx2::Parse(compressed.file.Data() + image.offset, image.size, compressed) && CompressedFormatSupported(compressed.format))
+        {
+            for (CompressedImage::Level &level : compressed.levels)
+                level.offset += image.offset;
+            return;
+        }
+        compressed.file.Close();
+        compressed.levels.clear();
+        std::cout << "ERROR::GLTF:: unsupported KTX2 image in " << image.file << std::endl;
+        return;
+    }
+    decoded.pixels.reset(stbi_load_from_memory(image.data, (int)image.size, &decoded.width, &decoded.height, &decoded.components, 0));
+}
+
+class GltfLoader
+{
+public:
+    // blobs (see AssetIOSystem.h) are served instead of files, like the ASSIMP path does
+    explicit GltfLoader(const std::vector<AssetBlob> *blobs = nullptr) : blobs(blobs) {}
+
+    // Reads path into one MeshData per primitive drawn by the default scene. With allowDirect, primitives that can
+    // be are loaded as DirectGeometry; normal mapped ones only if the file has their tangents or needTangents is
+    // false. The mapped files go to TakeSources(), and must stay open until the meshes and images are uploaded.
+    bool Load(const std::string &path, std::vector<MeshData> &meshes, ThreadPool *pool, bool allowDirect, bool needTangents)
+    {
+        error.clear();
+        sources.clear();
+        images.clear();
+        buffers.clear();
+        directory = path.substr(0, path.find_last_of('/') + 1);
+        fileName = path.substr(path.find_last_of('/') + 1);
+
+        sources.emplace_back();
+        Source &main = sources.back();
+        if (!open(path, main))
+            return fail("cannot open " + path);
+
+        // GLB: 12 byte header, a JSON chunk, an optional BIN chunk
+        const char *jsonText = reinterpret_cast<const char*>(main.data);
+        size_t jsonLength = main.size;
+        GltfBuffer binChunk;
+        if (main.size >= 12 && std::memcmp(main.data, "glTF", 4) == 0)
+        {
+            uint32_t header[3];
+            std::memcpy(header, main.data, sizeof(header));
+            if (header[1] != 2)
+                return fail("glTF container version " + std::to_string(header[1]));
+            size_t length = std::min<size_t>(header[2], main.size), offset = 12;
+            bool first = true;
+            while (offset + 8 <= length)
+            {
+                uint32_t chunk[2];
+                std::memcpy(chunk, main.data + offset, sizeof(chunk));
+                if (offset + 8 + chunk[0] > length)
+                    return fail("truncated GLB chunk");
+                if (first && chunk[1] != 0x4E4F534A)   // "JSON"
+                    return fail("GLB does not start with a JSON chunk");
+                if (first)
+                {
+                    jsonText = reinterpret_cast<const char*>(main.data + offset + 8);
+                    jsonLength = chunk[0];
+                }
+                else if (chunk[1] == 0x004E4942 && !binChunk.data)   // "BIN\0"
+                {
+                    binChunk.data = main.data + offset + 8;
+                    binChunk.size = chunk[0];
+                    binChunk.file = path;
+                    binChunk.offset = offset + 8;
+                }
+                first = false;
+                offset += 8 + ((chunk[0] + 3) & ~3u);
+            }
+        }
+        if (!JsonValue::Parse(jsonText, jsonLength, gltf, error))
+            return fail("invalid JSON: " + error);
+        if (gltf["asset"]["version"].String().compare(0, 2, "2.") != 0)
+            return fail("not a glTF 2.0 asset");
+        for (const char *extension : { "KHR_draco_mesh_compression", "EXT_meshopt_compression" })
+            for (size_t i = 0; i < gltf["extensionsRequired"].Size(); i++)
+                if (gltf["extensionsRequired"][i].String() == extension)
+                    return fail(std::string("required extension ") + extension);
+
+        // buffers: the GLB chunk or external files
+        const JsonValue &bufferList = gltf["buffers"];
+        for (size_t i = 0; i < bufferList.Size(); i++)
+        {
+            const JsonValue &buffer = bufferList[i];
+            GltfBuffer b;
+            if (!buffer.Has("uri"))
+            {
+                if (i != 0 || !binChunk.data)
+                    return fail("buffer without data");
+                b = binChunk;
+            }
+            else
+            {
+                std::string uri = decodeUri(buffer["uri"].String());
+                if (uri.compare(0, 5, "data:") == 0)
+                    return fail("data: URIs are not supported");
+                sources.emplace_back();
+                if (!open(directory + uri, sources.back()))
+                    return fail("cannot open buffer " + directory + uri);
+                b.data = sources.back().data;
+                b.size = sources.back().size;
+                b.file = directory + uri;
+            }
+            if ((size_t)buffer["byteLength"].Integer() > b.size)
+                return fail("buffer shorter than its byteLength");
+            buffers.push_back(b);
+        }
+
+        // what the default scene draws, with the node transforms
+        std::vector<Instance> instances;
+        const JsonValue &scenes = gltf["scenes"];
+        const JsonValue &nodes = gltf["nodes"];
+        if (scenes.Size() > 0)
+        {
+            const JsonValue &scene = scenes[(size_t)gltf["scene"].Integer(0)];
+            for (size_t i = 0; i < scene["nodes"].Size(); i++)
+                if (!collect((size_t)scene["nodes"][i].Integer(), glm::mat4(1.0f), true, 0, instances))
+                    return false;
+        }
+        else
+        {
+            // no scene: every root node
+            std::vector<bool> child(nodes.Size(), false);
+            for (size_t i = 0; i < nodes.Size(); i++)
+                for (size_t c = 0; c < nodes[i]["children"].Size(); c++)
+                    if ((size_t)nodes[i]["children"][c].Integer() < child.size())
+                        child[(size_t)nodes[i]["children"][c].Integer()] = true;
+            for (size_t i = 0; i < nodes.Size(); i++)
+                if (!child[i] && !collect(i, glm::mat4(1.0f), true, 0, instances))
+                    return false;
+        }
+        if (instances.empty())
+            return fail("no triangles");
+
+        // textures as processMesh names them; metallic/roughness have no sampler yet
+        std::vector<std::vector<TextureRef>> textures(instances.size());
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            const JsonValue &material = gltf["materials"][(size_t)(*instances[i].primitive)["material"].Integer(-1)];
+            if (!textureRef(material["pbrMetallicRoughness"]["baseColorTexture"], "texture_diffuse", textures[i], error) ||
+                !textureRef(material["normalTexture"], "texture_normal", textures[i], error))
+                return false;
+        }
+
+        // convert (or map) every primitive, in parallel
+        std::vector<MeshData> built(instances.size());
+        std::vector<std::string> errors(instances.size());
+        auto build = [&](size_t i) {
+            built[i].textures = textures[i];
+            buildMesh(instances[i], allowDirect, needTangents, built[i], errors[i]);
+        };
+        if (pool)
+            pool->ParallelFor(instances.size(), build);
+        else
+            for (size_t i = 0; i < instances.size(); i++)
+                build(i);
+        for (const std::string &e : errors)
+            if (!e.empty())
+                return fail(e);
+        meshes.clear();
+        for (MeshData &mesh : built)
+            if (mesh.direct.Valid() || !mesh.indices.empty())
+                meshes.push_back(std::move(mesh));
+        if (meshes.empty())
+            return fail("no triangles");
+        return true;
+    }
+
+    const std::string& Error() const { return error; }
+
+    // the images Load() referenced that Model has to load itself, by TextureRef path
+    const std::map<std::string, GltfImage>& Images() const { return images; }
+
+    // the mapped files, to be kept open until everything is uploaded
+    std::vector<AssetFile> TakeSources()
+    {
+        std::vector<AssetFile> files;
+        for (Source &source : sources)
+            if (source.file.IsOpen())
+                files.push_back(std::move(source.file));
+        sources.clear();
+        return files;
+    }
+
+private:
+    struct Source {
+        AssetFile file;
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+    };
+
+    struct GltfBuffer {
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+        std::string file;
+        size_t offset = 0;   // of data in file
+    };
+
+    struct Accessor {
+        const unsigned char *data = nullptr;   // first element
+        size_t buffer = 0;
+        size_t offset = 0;      // of the first element in the buffer
+        size_t count = 0;
+        size_t stride = 0;
+        size_t elementSize = 0;
+        int componentType = 0;
+        int components = 0;
+        bool normalized = false;
+    };
+
+    // a primitive as placed by a node
+    struct Instance {
+        const JsonValue *primitive;
+        glm::mat4 transform;
+        bool identity;
+    };
+
+    const std::vector<AssetBlob> *blobs;
+    std::string error, directory, fileName;
+    JsonValue gltf;
+    std::vector<Source> sources;
+    std::vector<GltfBuffer> buffers;
+    std::map<std::string, GltfImage> images;
+
+    bool fail(const std::string &reason)
+    {
+        error = reason;
+        return false;
+    }
+
+    bool open(const std::string &path, Source &source) const
+    {
+        if (blobs)
+        {
+            std::string normalized = NormalizeAssetPath(path);
+            for (const AssetBlob &blob : *blobs)
+                if (NormalizeAssetPath(blob.path) == normalized)
+                {
+                    source.data = static_cast<const unsigned char*>(blob.data);
+                    source.size = blob.size;
+                    return true;
+                }
+        }
+        if (!source.file.Open(path))
+            return false;
+        source.data = source.file.Data();
+        source.size = source.file.Size();
+        return true;
+    }
+
+    // URIs are relative paths with %XX escapes
+    static std::string decodeUri(const std::string &uri)
+    {
+        std::string out;
+        for (size_t i = 0; i < uri.size(); i++)
+        {
+            if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((unsigned char)uri[i + 1]) && std::isxdigit((unsigned char)uri[i + 2]))
+            {
+                out += (char)std::strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            }
+            else
+                out += uri[i];
+        }
+        return out;
+    }
+
+    // ------------------------------------------------------------------------
+    // scene graph
+
+    static glm::mat4 localTransform(const JsonValue &node, bool &identity)
+    {
+        identity = true;
+        glm::mat4 m(1.0f);
+        if (node["matrix"].Size() == 16)
+        {
+            for (int i = 0; i < 16; i++)
+                glm::value_ptr(m)[i] = (float)node["matrix"][i].Number();   // column major, as glm
+            identity = m == glm::mat4(1.0f);
+            return m;
+        }
+        const JsonValue &t = node["translation"], &r = node["rotation"], &s = node["scale"];
+        glm::vec3 translation(t[(size_t)0].Number(0.0), t[1].Number(0.0), t[2].Number(0.0));
+        glm::quat rotation((float)r[3].Number(1.0), (float)r[(size_t)0].Number(0.0), (float)r[1].Number(0.0), (float)r[2].Number(0.0));
+        glm::vec3 scale(s[(size_t)0].Number(1.0), s[1].Number(1.0), s[2].Number(1.0));
+        identity = translation == glm::vec3(0.0f) && rotation == glm::quat(1.0f, 0.0f, 0.0f, 0.0f) && scale == glm::vec3(1.0f);
+        glm::mat4 rotationMatrix = glm::mat4_cast(rotation);
+        m = rotationMatrix;
+        m[0] *= scale.x;
+        m[1] *= scale.y;
+        m[2] *= scale.z;
+        m[3] = glm::vec4(translation, 1.0f);
+        return m;
+    }
+
+    bool collect(size_t index, const glm::mat4 &parent, bool parentIdentity, int depth, std::vector<Instance> &instances)
+    {
+        const JsonValue &nodes = gltf["nodes"];
+        if (index >= nodes.Size())
+            return fail("node index out of range");
+        if (depth > 64)
+            return fail("node hierarchy too deep (or cyclic)");
+        const JsonValue &node = nodes[index];
+        bool identity;
+        glm::mat4 local = localTransform(node, identity);
+        glm::mat4 world = parent * local;
+        identity = identity && parentIdentity;
+        if (node.Has("mesh"))
+        {
+            const JsonValue &mesh = gltf["meshes"][(size_t)node["mesh"].Integer()];
+            if (mesh.IsNull())
+                return fail("mesh index out of range");
+            for (size_t p = 0; p < mesh["primitives"].Size(); p++)
+            {
+                const JsonValue &primitive = mesh["primitives"][p];
+                if (primitive["mode"].Integer(4) != 4)
+                    continue;   // points and lines; the renderer draws triangles only
+                instances.push_back(Instance{ &primitive, world, identity });
+            }
+        }
+        for (size_t c = 0; c < node["children"].Size(); c++)
+            if (!collect((size_t)node["children"][c].Integer(), world, identity, depth + 1, instances))
+                return false;
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    // accessors
+
+    static int componentCount(const std::string &type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    static size_t componentSize(int componentType)
+    {
+        switch (componentType)
+        {
+        case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+        default: return 0;
+        }
+    }
+
+    // finds and bounds-checks accessor index
+    bool accessor(int64_t index, Accessor &out, std::string &failure) const
+    {
+        const JsonValue &a = gltf["accessors"][(size_t)index];
+        if (index < 0 || a.IsNull())
+        {
+            failure = "accessor index out of range";
+            return false;
+        }
+        if (a.Has("sparse"))
+        {
+            failure = "sparse accessors are not supported";
+            return false;
+        }
+        out.componentType = (int)a["componentType"].Integer();
+        out.components = componentCount(a["type"].String());
+        out.normalized = a["normalized"].Bool(false);
+        out.count = (size_t)a["count"].Integer();
+        out.elementSize = componentSize(out.componentType) * out.components;
+        const JsonValue &view = gltf["bufferViews"][(size_t)a["bufferView"].Integer(-1)];
+        if (out.elementSize == 0 || view.IsNull())
+        {
+            failure = "unsupported accessor";
+            return false;
+        }
+        out.buffer = (size_t)view["buffer"].Integer();
+        out.stride = view["byteStride"].Integer(0) > 0 ? (size_t)view["byteStride"].Integer() : out.elementSize;
+        size_t viewOffset = (size_t)view["byteOffset"].Integer(0), viewLength = (size_t)view["byteLength"].Integer(0);
+        size_t accessorOffset = (size_t)a["byteOffset"].Integer(0);
+        if (out.buffer >= buffers.size() || viewOffset + viewLength > buffers[out.buffer].size ||
+            (out.count > 0 && accessorOffset + out.stride * (out.count - 1) + out.elementSize > viewLength))
+        {
+            failure = "accessor outside its buffer";
+            return false;
+        }
+        out.offset = viewOffset + accessorOffset;
+        out.data = buffers[out.buffer].data + out.offset;
+        return true;
+    }
+
+    static float component(const unsigned char *p, int componentType, bool normalized)
+    {
+        switch (componentType)
+        {
+        case GL_FLOAT: { float v; std::memcpy(&v, p, 4); return v; }
+        case GL_UNSIGNED_BYTE: return normalized ? *p / 255.0f : *p;
+        case GL_BYTE: { int8_t v = (int8_t)*p; return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+        case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return normalized ? v / 65535.0f : v; }
+        case GL_SHORT: { int16_t v; std::memcpy(&v, p, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+        case GL_UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return (float)v; }
+        default: return 0.0f;
+        }
+    }
+
+    static unsigned int index(const Accessor &a, size_t i)
+    {
+        const unsigned char *p = a.data + a.stride * i;
+        switch (a.componentType)
+        {
+        case GL_UNSIGNED_BYTE: return *p;
+        case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+        default: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+        }
+    }
+
+    static glm::vec4 element(const Accessor &a, size_t i)
+    {
+        glm::vec4 v(0.0f);
+        const unsigned char *p = a.data + a.stride * i;
+        size_t size = componentSize(a.componentType);
+        for (int c = 0; c < a.components; c++)
+            v[c] = component(p + c * size, a.componentType, a.normalized);
+        return v;
+    }
+
+    // ------------------------------------------------------------------------
+    // materials
+
+    // the TextureRef path of texture index, registering images Model has to load itself
+    bool textureRef(const JsonValue &textureInfo, const char *type, std::vector<TextureRef> &out, std::string &failure)
+    {
+        if (textureInfo.IsNull())
+            return true;
+        const JsonValue &texture = gltf["textures"][(size_t)textureInfo["index"].Integer(-1)];
+        int64_t source = texture["source"].Integer(-1);
+        if (texture["extensions"]["KHR_texture_basisu"].Has("source"))
+            source = texture["extensions"]["KHR_texture_basisu"]["source"].Integer(-1);
+        const JsonValue &image = gltf["images"][(size_t)source];
+        if (source < 0 || image.IsNull())
+            return true;   // no image, like a material without the map
+
+        std::string name;
+        GltfImage embedded;
+        if (image.Has("bufferView"))
+        {
+            const JsonValue &view = gltf["bufferViews"][(size_t)image["bufferView"].Integer()];
+            size_t buffer = (size_t)view["buffer"].Integer(), offset = (size_t)view["byteOffset"].Integer(0), size = (size_t)view["byteLength"].Integer(0);
+            if (view.IsNull() || buffer >= buffers.size() || offset + size > buffers[buffer].size)
+            {
+                failure = "image outside its buffer";
+                return false;
+            }
+            embedded.file = buffers[buffer].file;
+            embedded.data = buffers[buffer].data + offset;
+            embedded.offset = buffers[buffer].offset + offset;
+            embedded.size = size;
+            embedded.ktx2 = image["mimeType"].String() == "image/ktx2";
+            name = fileName + "#image" + std::to_string(source);
+        }
+        else
+        {
+            name = decodeUri(image["uri"].String());
+            if (name.compare(0, 5, "data:") == 0)
+            {
+                failure = "data: URIs are not supported";
+                return false;
+            }
+            // a .ktx2 by URI is the texture itself, not a source image the texture loaders could bake
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".ktx2") == 0)
+            {
+                embedded.file = directory + name;
+                embedded.ktx2 = true;
+                AssetFile probe(embedded.file);
+                embedded.size = probe.Size();
+            }
+        }
+        if (embedded.file.size())
+            images[name] = embedded;
+        out.push_back(TextureRef{ type, name });
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    // meshes
+
+    void buildMesh(const Instance &instance, bool allowDirect, bool needTangents, MeshData &data, std::string &failure)
+    {
+        const JsonValue &primitive = *instance.primitive;
+        const JsonValue &attributes = primitive["attributes"];
+        Accessor position, normal, texCoord, tangent, indices;
+        if (!attributes.Has("POSITION"))
+        {
+            failure = "primitive without positions";
+            return;
+        }
+        if (!accessor(attributes["POSITION"].Integer(), position, failure))
+            return;
+        bool hasNormals = attributes.Has("NORMAL"), hasTexCoords = attributes.Has("TEXCOORD_0"), hasTangents = attributes.Has("TANGENT");
+        bool hasIndices = primitive.Has("indices");
+        if ((hasNormals && !accessor(attributes["NORMAL"].Integer(), normal, failure)) ||
+            (hasTexCoords && !accessor(attributes["TEXCOORD_0"].Integer(), texCoord, failure)) ||
+            (hasTangents && !accessor(attributes["TANGENT"].Integer(), tangent, failure)) ||
+            (hasIndices && !accessor(primitive["indices"].Integer(), indices, failure)))
+            return;
+        if (position.components != 3 || (hasNormals && normal.components != 3) || (hasTexCoords && texCoord.components != 2) ||
+            (hasTangents && tangent.components != 4) || (hasIndices && indices.components != 1))
+        {
+            failure = "unexpected accessor type";
+            return;
+        }
+        for (const Accessor *a : { &normal, &texCoord, &tangent })
+            if (a->data && a->count < position.count)
+            {
+                failure = "attribute shorter than POSITION";
+                return;
+            }
+
+        bool normalMapped = any_of(data.textures.begin(), data.textures.end(), [](const TextureRef &t) { return t.type == "texture_normal"; });
+        // tangents only matter with a normal map to use them
+        hasTangents = hasTangents && normalMapped && hasNormals && hasTexCoords;
+        data.attributes = (hasNormals ? VERTEX_NORMALS : 0) | (hasTexCoords ? VERTEX_TEXCOORDS : 0) | (hasTangents ? VERTEX_TANGENTS : 0);
+
+        size_t vertexCount = position.count;
+        size_t indexCount = hasIndices ? indices.count : vertexCount;
+        if (vertexCount == 0 || indexCount < 3)
+            return;
+        if (hasIndices)
+        {
+            if (indices.componentType != GL_UNSIGNED_BYTE && indices.componentType != GL_UNSIGNED_SHORT && indices.componentType != GL_UNSIGNED_INT)
+            {
+                failure = "unexpected index type";
+                return;
+            }
+            // out of range indices would read outside the buffers on the GPU
+            for (size_t i = 0; i < indices.count; i++)
+                if (index(indices, i) >= vertexCount)
+                {
+                    failure = "index out of range";
+                    return;
+                }
+        }
+
+        bool sameBuffer = (!hasNormals || normal.buffer == position.buffer) && (!hasTexCoords || texCoord.buffer == position.buffer) &&
+                          (!hasTangents || tangent.buffer == position.buffer);
+        bool direct = allowDirect && instance.identity && sameBuffer && hasNormals && hasIndices &&
+                      (indices.componentType == GL_UNSIGNED_SHORT || indices.componentType == GL_UNSIGNED_INT) &&
+                      indices.stride == indices.elementSize && (!normalMapped || !needTangents || hasTangents);
+        if (direct)
+        {
+            DirectGeometry &geometry = data.direct;
+            size_t begin = SIZE_MAX, end = 0;
+            for (const Accessor *a : { &position, &normal, &texCoord, &tangent })
+                if (a->data)
+                {
+                    begin = std::min(begin, a->offset);
+                    end = std::max(end, a->offset + a->stride * (a->count - 1) + a->elementSize);
+                }
+            geometry.vertexData = buffers[position.buffer].data + begin;
+            geometry.vertexBytes = end - begin;
+            geometry.vertexCount = vertexCount;
+            auto add = [&](GLuint location, const Accessor &a) {
+                geometry.attributes.push_back(DirectAttribute{ location, a.components, (GLenum)a.componentType,
+                                                               (GLboolean)(a.normalized ? GL_TRUE : GL_FALSE), (GLsizei)a.stride, a.offset - begin });
+            };
+            add(0, position);
+            add(1, normal);
+            if (hasTexCoords)
+                add(2, texCoord);
+            if (hasTangents)
+                add(3, tangent);
+            geometry.indexData = indices.data;
+            geometry.indexCount = indexCount;
+            geometry.indexType = (GLenum)indices.componentType;
+            // POSITION must have min and max, but compute them if it doesn't
+            const JsonValue &a = gltf["accessors"][(size_t)attributes["POSITION"].Integer()];
+            if (a["min"].Size() == 3 && a["max"].Size() == 3)
+                for (int c = 0; c < 3; c++)
+                {
+                    geometry.boundsMin[c] = (float)a["min"][c].Number();
+                    geometry.boundsMax[c] = (float)a["max"][c].Number();
+                }
+            else
+                for (size_t i = 0; i < vertexCount; i++)
+                {
+                    glm::vec3 p = glm::vec3(element(position, i));
+                    geometry.boundsMin = i ? glm::min(geometry.boundsMin, p) : p;
+                    geometry.boundsMax = i ? glm::max(geometry.boundsMax, p) : p;
+                }
+            return;
+        }
+
+        // converted into Vertex, in world space
+        glm::mat3 linear = glm::mat3(instance.transform);
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+        bool mirrored = glm::determinant(linear) < 0.0f;
+        data.vertices.assign(vertexCount, Vertex{});
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            Vertex &v = data.vertices[i];
+            glm::vec3 p = glm::vec3(element(position, i));
+            v.Position = instance.identity ? p : glm::vec3(instance.transform * glm::vec4(p, 1.0f));
+            if (hasNormals)
+            {
+                glm::vec3 n = glm::vec3(element(normal, i));
+                v.Normal = instance.identity ? n : glm::normalize(normalMatrix * n);
+            }
+            if (hasTexCoords)
+                v.TexCoords = glm::vec2(element(texCoord, i));
+            if (hasTangents)
+            {
+                glm::vec4 t = element(tangent, i);
+                v.Tangent = instance.identity ? glm::vec3(t) : glm::normalize(linear * glm::vec3(t));
+                v.Bitangent = glm::cross(v.Normal, v.Tangent) * (t.w < 0.0f ? -1.0f : 1.0f);
+            }
+        }
+        data.indices.resize(indexCount);
+        for (size_t i = 0; i < indexCount; i++)
+            data.indices[i] = hasIndices ? index(indices, i) : (unsigned int)i;
+        data.indices.resize(indexCount / 3 * 3);
+        // a mirroring transform turns the triangles inside out
+        if (mirrored)
+            for (size_t t = 0; t < data.indices.size(); t += 3)
+                std::swap(data.indices[t + 1], data.indices[t + 2]);
+    }
+};
+#endif
@@ -0,0 +1,32 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#define STB_IMAGE_IMPLEMENTATION
+#include <assimp/stb_image.h>
+
+#include <memory>
+#include <string>
+#include "AssetPack.h"
+
+// pixels of an image file decoded on the CPU, ready to be uploaded
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels{nullptr, stbi_image_free};
+
+    size_t Bytes() const { return (size_t)width * height * components; }
+};
+
+// decodes directory/path (from the asset pack if it has it); no GL calls, safe to use from worker threads
+inline DecodedImage DecodeTexture(const char *path, const std::string &directory)
+{
+    std::string filename = std::string(path);
+    filename = directory + '/' + filename;
+
+    DecodedImage image;
+    AssetFile file(filename);
+    if (file.IsOpen())
+        image.pixels.reset(stbi_load_from_memory(file.Data(), (int)file.Size(), &image.width, &image.height, &image.components, 0));
+    return image;
+}
+#endif
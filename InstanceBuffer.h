@@ -0,0 +1,110 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include "GLState.h"
+#include "Residency.h"
+
+// one copy of a model in an instanced draw (see Model::DrawInstanced)
+struct InstanceData {
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(1.0f);   // transpose(inverse(model)), so the shader doesn't invert per vertex
+
+    InstanceData() {}
+    explicit InstanceData(const glm::mat4 &model) : model(model), normalMatrix(glm::transpose(glm::inverse(glm::mat3(model)))) {}
+};
+
+// The per-instance attributes of instanced draws, streamed through one buffer: Upload() appends a frame's
+// instances behind the previous ones with an unsynchronized map, and starts over in fresh (orphaned) storage when
+// the buffer is full, so the GPU never waits for the CPU nor the CPU for the GPU. Bind() points the bound VAO's
+// instance attributes at an upload: the model matrix at locations 8-11 and the normal matrix at 12-14.
+// GL thread only.
+class InstanceBuffer
+{
+public:
+    static const GLuint MODEL_LOCATION = 8;
+    static const GLuint NORMAL_MATRIX_LOCATION = 12;
+    static constexpr size_t INITIAL_BYTES = 1 << 20;
+
+    static InstanceBuffer& Instance()
+    {
+        static InstanceBuffer buffer;
+        return buffer;
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // copies the instances into the buffer and returns where they start, for Bind()
+    size_t Upload(const InstanceData *instances, size_t count)
+    {
+        size_t bytes = count * sizeof(InstanceData);
+        if (!buffer)
+            glGenBuffers(1, &buffer);
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        ResidencyManager::Instance().UseBuffer(buffer);
+        if (bytes > capacity || head + bytes > capacity)
+        {
+            // orphan: the draws still reading the old storage keep it until they are done
+            capacity = std::max(capacity, std::max(bytes, INITIAL_BYTES));
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+            ResidencyManager::Instance().TrackBuffer(buffer, capacity, GL_STREAM_DRAW);
+            head = 0;
+        }
+        size_t offset = head;
+        if (bytes)
+        {
+            void *dst = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (dst)
+            {
+                std::memcpy(dst, instances, bytes);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            else
+                glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, instances);
+        }
+        GLState::Instance().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        head += bytes;
+        return offset;
+    }
+
+    // sets up the instance attributes of the bound VAO to read from offset on, one element per instance
+    void Bind(size_t offset)
+    {
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint column = 0; column < 4; column++)
+        {
+            GLuint location = MODEL_LOCATION + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location, 1);
+        }
+        for (GLuint column = 0; column < 3; column++)
+        {
+            GLuint location = NORMAL_MATRIX_LOCATION + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + sizeof(glm::mat4) + column * sizeof(glm::vec3)));
+            glVertexAttribDivisor(location, 1);
+        }
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // turns the bound VAO's instance attributes off again, for the draws that use the model uniform
+    void Unbind()
+    {
+        for (GLuint location = MODEL_LOCATION; location < NORMAL_MATRIX_LOCATION + 3; location++)
+            glDisableVertexAttribArray(location);
+    }
+
+private:
+    GLuint buffer = 0;
+    size_t capacity = 0;
+    size_t head = 0;
+
+    InstanceBuffer() {}
+};
+#endif
@@ -0,0 +1,338 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A small JSON reader, enough for glTF: Parse() builds a tree of JsonValues, and lookups on it never fail - a
+// missing member or index, or a value of the wrong type, reads as null, and the accessors return the given default.
+// Numbers are doubles, strings are unescaped to UTF-8.
+class JsonValue
+{
+public:
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    JsonValue() {}
+
+    Type GetType() const { return type; }
+    bool IsNull() const { return type == NUL; }
+    bool IsNumber() const { return type == NUMBER; }
+    bool IsString() const { return type == STRING; }
+    bool IsArray() const { return type == ARRAY; }
+    bool IsObject() const { return type == OBJECT; }
+
+    double Number(double fallback = 0.0) const { return type == NUMBER ? number : fallback; }
+    int64_t Integer(int64_t fallback = 0) const { return type == NUMBER ? (int64_t)number : fallback; }
+    bool Bool(bool fallback = false) const { return type == BOOLEAN ? boolean : fallback; }
+    const std::string& String() const { return type == STRING ? text : empty().text; }
+
+    // elements of an array, members of an object, 0 otherwise
+    size_t Size() const { return type == ARRAY ? elements.size() : type == OBJECT ? members.size() : 0; }
+
+    const JsonValue& operator[](size_t index) const
+    {
+        return type == ARRAY && index < elements.size() ? elements[index] : empty();
+    }
+
+    const JsonValue& operator[](const char *name) const
+    {
+        if (type == OBJECT)
+            for (const auto &member : members)
+                if (member.first == name)
+                    return member.second;
+        return empty();
+    }
+
+    bool Has(const char *name) const { return !(*this)[name].IsNull(); }
+
+    const std::vector<std::pair<std::string, JsonValue>>& Members() const { return members; }
+
+    // parses text[0, length) into value; false (with a reason) on malformed input
+    static bool Parse(const char *text, size_t length, JsonValue &value, std::string &error)
+    {
+        Parser parser{ text, text + length, std::string() };
+        parser.skipSpace();
+        if (!parser.value(value, 0))
+        {
+            error = parser.error + " at byte " + std::to_string(parser.p - text);
+            return false;
+        }
+        parser.skipSpace();
+        if (parser.p != parser.end)
+        {
+            error = "trailing characters at byte " + std::to_string(parser.p - text);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string text;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    static const JsonValue& empty()
+    {
+        static const JsonValue value;
+        return value;
+    }
+
+    struct Parser {
+        const char *p;
+        const char *end;
+        std::string error;
+
+        static const int MAX_DEPTH = 256;
+
+        bool fail(const char *reason)
+        {
+            error = reason;
+            return false;
+        }
+
+        void skipSpace()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                p++;
+        }
+
+        bool literal(const char *word)
+        {
+            size_t length = std::strlen(word);
+            if ((size_t)(end - p) < length || std::memcmp(p, word, length) != 0)
+                return fail("invalid literal");
+            p += length;
+            return true;
+        }
+
+        bool value(JsonValue &out, int depth)
+        {
+            if (depth > MAX_DEPTH)
+                return fail("nested too deeply");
+            if (p == end)
+                return fail("unexpected end");
+            switch (*p)
+            {
+            case '{': return object(out, depth);
+            case '[': return array(out, depth);
+            case '"': out.type = STRING; return string(out.text);
+            case 't': out.type = BOOLEAN; out.boolean = true; return literal("true");
+            case 'f': out.type = BOOLEAN; out.boolean = false; return literal("false");
+            case 'n': out.type = NUL; return literal("null");
+            default: out.type = NUMBER; return numberValue(out.number);
+            }
+        }
+
+        bool object(JsonValue &out, int depth)
+        {
+            out.type = OBJECT;
+            p++;
+            skipSpace();
+            if (p < end && *p == '}')
+            {
+                p++;
+                return true;
+            }
+            while (true)
+            {
+                skipSpace();
+                if (p == end || *p != '"')
+                    return fail("expected a member name");
+                out.members.emplace_back();
+                if (!string(out.members.back().first))
+                    return false;
+                skipSpace();
+                if (p == end || *p != ':')
+                    return fail("expected ':'");
+                p++;
+                skipSpace();
+                if (!value(out.members.back().second, depth + 1))
+                    return false;
+                skipSpace();
+                if (p < end && *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == '}')
+                {
+                    p++;
+                    return true;
+                }
+                return fail("expected ',' or '}'");
+            }
+        }
+
+        bool array(JsonValue &out, int depth)
+        {
+            out.type = ARRAY;
+            p++;
+            skipSpace();
+            if (p < end && *p == ']')
+            {
+                p++;
+                return true;
+            }
+            while (true)
+            {
+                skipSpace();
+                out.elements.emplace_back();
+                if (!value(out.elements.back(), depth + 1))
+                    return false;
+                skipSpace();
+                if (p < end && *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == ']')
+                {
+                    p++;
+                    return true;
+                }
+                return fail("expected ',' or ']'");
+            }
+        }
+
+        bool numberValue(double &out)
+        {
+            // validate the JSON grammar, then let strtod convert the token
+            const char *start = p;
+            if (p < end && *p == '-')
+                p++;
+            if (p == end || *p < '0' || *p > '9')
+                return fail("invalid number");
+            if (*p == '0')
+                p++;
+            else
+                while (p < end && *p >= '0' && *p <= '9')
+                    p++;
+            if (p < end && *p == '.')
+            {
+                p++;
+                if (p == end || *p < '0' || *p > '9')
+                    return fail("invalid number");
+                while (p < end && *p >= '0' && *p <= '9')
+                    p++;
+            }
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                p++;
+                if (p < end && (*p == '+' || *p == '-'))
+                    p++;
+                if (p == end || *p < '0' || *p > '9')
+                    return fail("invalid number");
+                while (p < end && *p >= '0' && *p <= '9')
+                    p++;
+            }
+            std::string token(start, p);
+            out = std::strtod(token.c_str(), nullptr);
+            return true;
+        }
+
+        static void appendUtf8(std::string &out, uint32_t c)
+        {
+            if (c < 0x80)
+                out += (char)c;
+            else if (c < 0x800)
+            {
+                out += (char)(0xC0 | (c >> 6));
+                out += (char)(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                out += (char)(0xE0 | (c >> 12));
+                out += (char)(0x80 | ((c >> 6) & 0x3F));
+                out += (char)(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                out += (char)(0xF0 | (c >> 18));
+                out += (char)(0x80 | ((c >> 12) & 0x3F));
+                out += (char)(0x80 | ((c >> 6) & 0x3F));
+                out += (char)(0x80 | (c & 0x3F));
+            }
+        }
+
+        bool hex4(uint32_t &out)
+        {
+            if (end - p < 4)
+                return fail("invalid escape");
+            out = 0;
+            for (int i = 0; i < 4; i++, p++)
+            {
+                char c = *p;
+                uint32_t digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 16;
+                if (digit == 16)
+                    return fail("invalid escape");
+                out = out * 16 + digit;
+            }
+            return true;
+        }
+
+        bool string(std::string &out)
+        {
+            p++;
+            while (true)
+            {
+                const char *start = p;
+                while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20)
+                    p++;
+                out.append(start, p);
+                if (p == end)
+                    return fail("unterminated string");
+                if (*p == '"')
+                {
+                    p++;
+                    return true;
+                }
+                if (*p != '\\')
+                    return fail("control character in string");
+                p++;
+                if (p == end)
+                    return fail("unterminated string");
+                char c = *p++;
+                switch (c)
+                {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    uint32_t code;
+                    if (!hex4(code))
+                        return false;
+                    // a surrogate pair is two escapes
+                    if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        p += 2;
+                        uint32_t low;
+                        if (!hex4(low))
+                            return false;
+                        if (low < 0xDC00 || low >= 0xE000)
+                            return fail("invalid surrogate pair");
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    return fail("invalid escape");
+                }
+            }
+        }
+    };
+};
+#endif
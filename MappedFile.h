@@ -0,0 +1,109 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping is released when the object goes out of scope.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    explicit MappedFile(const std::string &path)
+    {
+        Open(path);
+    }
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile &&other) noexcept : data(other.data), size(other.size)
+    {
+        other.data = nullptr;
+        other.size = 0;
+    }
+    MappedFile& operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            data = other.data;
+            size = other.size;
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    // maps the file at path, returns false if it does not exist or cannot be mapped
+    bool Open(const std::string &path)
+    {
+        Close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if (ptr == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char*>(ptr);
+        size = (size_t)st.st_size;
+        return true;
+    }
+
+    void Close()
+    {
+        if (data)
+            munmap(const_cast<unsigned char*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+
+    bool IsOpen() const { return data != nullptr; }
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+// 64-bit FNV-1a, used to fingerprint file contents for the asset caches
+inline uint64_t HashBytes(const void *bytes, size_t length, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(bytes);
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// modification time (seconds) and size of a file, returns false if it does not exist
+inline bool FileStamp(const std::string &path, int64_t &mtime, uint64_t &size)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    mtime = (int64_t)st.st_mtime;
+    size = (uint64_t)st.st_size;
+    return true;
+}
+#endif
@@ -0,0 +1,140 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#elif defined(__unix__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Process memory as the loaders report it: heap allocations counted by the operator new below, and the resident
+// set size from the OS (0 where that is not known).
+
+struct AllocationCounters {
+    std::atomic<size_t> count{ 0 };
+    std::atomic<size_t> bytes{ 0 };
+};
+
+// constant-initialized, so safe to use from operator new before main()
+inline AllocationCounters& Allocations()
+{
+    static AllocationCounters counters;
+    return counters;
+}
+
+struct MemorySnapshot {
+    size_t allocations = 0;       // operator new calls so far
+    size_t allocatedBytes = 0;    // bytes they asked for
+    size_t residentBytes = 0;     // current RSS
+    size_t peakResidentBytes = 0; // highest RSS since the start, or since ResetPeakResident()
+};
+
+inline size_t ResidentBytes()
+{
+#if defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+        return info.resident_size;
+    return 0;
+#elif defined(__linux__)
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    unsigned long pages = 0, resident = 0;
+    int read = std::fscanf(statm, "%lu %lu", &pages, &resident);
+    std::fclose(statm);
+    return read == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+inline size_t PeakResidentBytes()
+{
+#if defined(__APPLE__) || defined(__unix__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;          // bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024;   // kilobytes
+#endif
+#else
+    return 0;
+#endif
+}
+
+// restarts the peak at the current RSS where the OS allows it (Linux), so a load's own peak can be measured;
+// returns false where the peak can only be the process lifetime's
+inline bool ResetPeakResident()
+{
+#if defined(__linux__)
+    FILE *clearRefs = std::fopen("/proc/self/clear_refs", "w");
+    if (!clearRefs)
+        return false;
+    bool written = std::fputs("5", clearRefs) >= 0;
+    return std::fclose(clearRefs) == 0 && written;
+#else
+    return false;
+#endif
+}
+
+inline MemorySnapshot CurrentMemory()
+{
+    MemorySnapshot snapshot;
+    snapshot.allocations = Allocations().count.load(std::memory_order_relaxed);
+    snapshot.allocatedBytes = Allocations().bytes.load(std::memory_order_relaxed);
+    snapshot.residentBytes = ResidentBytes();
+    snapshot.peakResidentBytes = PeakResidentBytes();
+    return snapshot;
+}
+
+// "1234 allocations (56.7 MB), RSS 89.0 MB, peak 120.3 MB" for what happened between two snapshots
+inline void FormatMemoryDelta(char *line, size_t size, const MemorySnapshot &before, const MemorySnapshot &after)
+{
+    const double MB = 1024.0 * 1024.0;
+    std::snprintf(line, size, "%zu allocations (%.1f MB), RSS %.1f -> %.1f MB, peak %.1f MB",
+                  after.allocations - before.allocations, (after.allocatedBytes - before.allocatedBytes) / MB,
+                  before.residentBytes / MB, after.residentBytes / MB, after.peakResidentBytes / MB);
+}
+
+// Counting replacements of the global operator new/delete. The array, nothrow and sized forms all end up here;
+// over-aligned allocations keep the library's and are not counted. Like Model.h's functions, this header must be
+// included by one translation unit only. (Not inlined: GCC would then pair the library's operator new with free()
+// and warn about a mismatch.)
+#if defined(__GNUC__)
+#define MEMORY_STATS_NOINLINE __attribute__((noinline))
+#else
+#define MEMORY_STATS_NOINLINE
+#endif
+
+MEMORY_STATS_NOINLINE void* operator new(size_t size)
+{
+    AllocationCounters &counters = Allocations();
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+MEMORY_STATS_NOINLINE void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+MEMORY_STATS_NOINLINE void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+#endif
@@ -6,74 +6,459 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include "GLState.h"
 #include "Shader.h"
 #include "VertexBuffer.h"
+#include "VertexLayout.h"
+#include "GeometryPool.h"
+#include "InstanceBuffer.h"
+#include "Meshlets.h"
+#include "ScratchArena.h"
+#include "Residency.h"
+#include "TextureFeedback.h"
 
 #ifndef MESH_H
 #define MESH_H
 
+#include <algorithm>
+#include <cmath>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
-	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
-class Mesh {
+// a texture a mesh refers to, before it has been loaded into OpenGL
+struct TextureRef {
+    string type;
+    string path;
+};
+
+// one level of detail: a range of the mesh's index buffer (see MeshSimplifier.h)
+struct MeshLod {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float error;   // largest deviation from the full mesh, in model units
+};
+
+// a vertex attribute read where a file's buffer has it (see DirectGeometry)
+struct DirectAttribute {
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    size_t offset;   // into DirectGeometry::vertexData
+};
+
+// geometry uploaded as a file stores it (see GltfLoader.h) instead of through Vertex and the layout: the vertex
+// bytes and the indices point into a mapping that must stay open until the mesh is created
+struct DirectGeometry {
+    const unsigned char *vertexData = nullptr;
+    size_t vertexBytes = 0;
+    size_t vertexCount = 0;
+    vector<DirectAttribute> attributes;
+    const unsigned char *indexData = nullptr;
+    size_t indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+
+    bool Valid() const { return vertexData != nullptr; }
+};
+
+// CPU-side result of importing a single mesh; turned into a Mesh once a GL context is available
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;    // the full mesh, followed by the LOD levels if there are any
+    vector<TextureRef>   textures;
+    unsigned int         attributes = 0; // VertexAttributeFlags the source mesh actually has
+    vector<MeshLod>      lods;       // empty, or one entry per level with the full mesh first
+    vector<Meshlet>      meshlets;   // clusters of the full-detail level, empty if not built
+    DirectGeometry       direct;     // set instead of vertices and indices for meshes uploaded straight from the file
+};
+
+// the camera state LOD selection and culling need, set once per frame
+struct ViewState {
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    bool culling = false;        // frustum/backface culling of meshes and meshlets; off until Set() is called
+    float pixelsPerUnit = 0.0f;  // on-screen size of one unit at distance 1; 0 disables LOD selection
+    float pixelError = 1.0f;     // largest error a LOD may show, in pixels
+
+    void Set(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &position, float viewportHeight)
+    {
+        cameraPosition = position;
+        viewProjection = projection * view;
+        culling = true;
+        // projection[1][1] is cot(fovy / 2)
+        pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+    }
+};
+
+inline ViewState& CurrentView()
+{
+    static ViewState view;
+    return view;
+}
+
+// what was submitted since the last Reset(), to see what LODs and culling save
+struct DrawStats {
+    size_t draws = 0;
+    size_t triangles = 0;
+    size_t fullTriangles = 0;  // what the same draws would have cost at full detail without culling
+    size_t meshesCulled = 0;
+    size_t meshletsTested = 0;
+    size_t meshletsCulled = 0;
+
+    void Reset() { draws = triangles = fullTriangles = meshesCulled = meshletsTested = meshletsCulled = 0; }
+};
+
+inline DrawStats& FrameDrawStats()
+{
+    static DrawStats stats;
+    return stats;
+}
+
+// the texture units the object shader samples: material.diffuse on 0, material.specular on 1
+const unsigned int SAMPLED_TEXTURE_UNITS = 2;
+
+// binds no texture to the sampled units from first on, so a draw that doesn't fill them reads black rather than
+// whatever the previous draw left bound
+inline void ClearSampledTextures(unsigned int first = 0)
+{
+    for (unsigned int unit = first; unit < SAMPLED_TEXTURE_UNITS; unit++)
+        GLState::Instance().BindTexture(unit, 0);
+}
+
+// the name of a GL object a class owns: moves (leaving 0 behind) but does not copy, so the owner can't be copied by
+// accident and delete its objects twice
+struct GLName {
+    unsigned int id = 0;
+
+    GLName() {}
+    GLName(GLName &&other) noexcept : id(other.id) { other.id = 0; }
+    GLName& operator=(GLName &&other) noexcept
+    {
+        std::swap(id, other.id);
+        return *this;
+    }
+    operator unsigned int() const { return id; }
+};
+
+// a mesh uploaded in the given vertex layout (see VertexLayout.h). Its vertices and indices live in the layout's
+// GeometryPool, which it gives them back to when destroyed; a mesh uploaded straight from a file's buffers owns its
+// VAO and buffers instead. Moving it hands either over.
+template <typename Layout>
+class MeshT {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    vector<MeshLod>      lods;
+    vector<Meshlet>      meshlets;
+    GLName VAO;   // only for meshes with their own buffers (see DirectGeometry); pooled ones use the pool's
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; pass the vectors with move() to hand them over without a copy. The packed upload data is
+    // built in scratch if given (see ScratchArena.h), in a temporary arena otherwise.
+    MeshT(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<MeshLod> lods = vector<MeshLod>(), vector<Meshlet> meshlets = vector<Meshlet>(), ScratchArena *scratch = nullptr)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = move(vertices);
+        this->indices = move(indices);
+        this->textures = move(textures);
+        this->lods = move(lods);
+        this->meshlets = move(meshlets);
+        meshletCullData.Set(this->meshlets);
+        if (this->lods.empty())
+            this->lods.push_back(MeshLod{ 0, (unsigned int)this->indices.size(), 0.0f });
+        vertexCount = this->vertices.size();
+        indexCount = this->indices.size();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        this->setupMesh();
+        if (scratch)
+            this->setupMesh(*scratch);
+        else
+        {
+            ScratchArena local;
+            this->setupMesh(local);
+        }
+    }
+
+    // a mesh whose buffers are the file's own (see DirectGeometry); it keeps no CPU copy and ignores Layout
+    MeshT(const DirectGeometry &direct, vector<Texture> textures)
+    {
+        this->textures = move(textures);
+        this->lods.push_back(MeshLod{ 0, (unsigned int)direct.indexCount, 0.0f });
+        vertexCount = direct.vertexCount;
+        indexCount = direct.indexCount;
+        this->setupDirect(direct);
+    }
+
+    MeshT(MeshT&&) = default;
+    MeshT& operator=(MeshT&&) = default;
+
+    ~MeshT()
+    {
+        GeometryPool<Layout>::Instance().Remove(geometry);
+        ResidencyManager::Instance().ForgetBuffer(VBO);
+        ResidencyManager::Instance().ForgetBuffer(EBO);
+        // at shutdown the context may already be gone, and the driver frees everything anyway
+        if (VAO && glfwGetCurrentContext())
+        {
+            GLuint buffers[2] = { VBO, EBO };
+            GLState::Instance().DeleteBuffers(2, buffers);
+            GLState::Instance().DeleteVertexArrays(1, &VAO.id);
+        }
+    }
+
+    // render the mesh at full detail
+    void Draw(Shader &shader)
+    {
+        if (MipFeedback().listening)
+            for (const Texture &texture : textures)
+                MipFeedback().Want(texture.id, TextureFeedback::FULL_DETAIL);
+        drawLevel(shader, 0);
+    }
+
+    // render the mesh as seen from CurrentView(): nothing if it is outside the frustum, otherwise at the coarsest
+    // level that stays within the pixel error at its distance, and at full detail only the meshlets that can be seen
+    void Draw(Shader &shader, const glm::mat4 &model)
+    {
+        const ViewState &view = CurrentView();
+        if (!view.culling)
+        {
+            requestTextureDetail(model, view);
+            drawLevel(shader, SelectLod(model, view));
+            return;
+        }
+        // planes in model space, so the bounds need no transforming
+        FrustumPlanes frustum(view.viewProjection * model);
+        DrawStats &stats = FrameDrawStats();
+        if (!frustum.ContainsSphere(boundsCenter, boundsRadius))
+        {
+            stats.meshesCulled++;
+            stats.fullTriangles += lods[0].indexCount / 3;
+            return;
+        }
+        unsigned int level = SelectLod(model, view);
+        requestTextureDetail(model, view);
+        if (level > 0 || meshlets.empty())
+        {
+            drawLevel(shader, level);
+            return;
+        }
+
+        glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(view.cameraPosition, 1.0f));
+        CullMeshlets(meshletCullData, frustum, camera, meshletVisible);
+        // neighbouring survivors are adjacent in the index buffer: merge them into ranges
+        rangeCounts.clear();
+        rangeOffsets.clear();
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        unsigned int visibleIndices = 0;
+        for (size_t i = 0; i < meshlets.size(); i++)
+        {
+            if (!meshletVisible[i])
+                continue;
+            const Meshlet &m = meshlets[i];
+            visibleIndices += m.indexCount;
+            if (i > 0 && meshletVisible[i - 1])
+                rangeCounts.back() += m.indexCount;
+            else
+            {
+                rangeCounts.push_back((GLsizei)m.indexCount);
+                rangeOffsets.push_back((const void*)(m.indexOffset * indexSize));
+            }
+        }
+        stats.meshletsTested += meshlets.size();
+        stats.meshletsCulled += meshlets.size() - (size_t)count(meshletVisible.begin(), meshletVisible.end(), 1);
+        stats.fullTriangles += lods[0].indexCount / 3;
+        if (rangeCounts.empty())
+            return;
+        stats.triangles += visibleIndices / 3;
+        stats.draws++;
+
+        bindTextures(shader);
+        GeometryPlacement placed = useBuffers();
+        // the ranges are relative to the mesh until now: an evicted mesh only gets its place in the pool back here
+        for (const void *&offset : rangeOffsets)
+            offset = (const char*)offset + placed.indexOffset;
+        rangeBaseVertices.assign(rangeCounts.size(), (GLint)placed.firstVertex);
+        GLState::Instance().BindVertexArray(vertexArray());
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, rangeCounts.data(), indexType, rangeOffsets.data(), (GLsizei)rangeCounts.size(), rangeBaseVertices.data());
+    }
+
+    // renders count instances whose attributes were uploaded to the InstanceBuffer at offset, in one draw, at the
+    // level of detail of closest (the instance that needs the most detail, see Model::DrawInstanced)
+    void DrawInstanced(Shader &shader, size_t offset, size_t count, const glm::mat4 &closest)
+    {
+        const ViewState &view = CurrentView();
+        unsigned int level = SelectLod(closest, view);
+        requestTextureDetail(closest, view);
+        bindTextures(shader);
+
+        const MeshLod &lod = lods[level];
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        GeometryPlacement placed = useBuffers();
+        GLState::Instance().BindVertexArray(vertexArray());
+        InstanceBuffer::Instance().Bind(offset);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<unsigned int>(lod.indexCount), indexType, (void*)(placed.indexOffset + lod.indexOffset * indexSize),
+                                          (GLsizei)count, (GLint)placed.firstVertex);
+        InstanceBuffer::Instance().Unbind();
+
+        DrawStats &stats = FrameDrawStats();
+        stats.draws++;
+        stats.triangles += count * (lod.indexCount / 3);
+        stats.fullTriangles += count * (lods[0].indexCount / 3);
+    }
+
+    unsigned int SelectLod(const glm::mat4 &model, const ViewState &view) const
+    {
+        if (lods.size() < 2 || view.pixelsPerUnit <= 0.0f)
+            return 0;
+        float scale, distance;
+        placement(model, view, scale, distance);
+        unsigned int level = 0;
+        while (level + 1 < lods.size() && lods[level + 1].error * scale / distance * view.pixelsPerUnit <= view.pixelError)
+            level++;
+        return level;
+    }
+
+    // bytes uploaded for vertices and indices, and what they would take as Vertex and 32-bit indices
+    size_t GpuBytes() const { return gpuBytes; }
+    size_t UncompressedBytes() const { return vertexCount * sizeof(Vertex) + indexCount * sizeof(unsigned int); }
+
+    // vertices and indices held on the CPU, which nothing needs once they are uploaded
+    // what the buffers take now, on the GPU or evicted (see Residency.h)
+    void AddGpuUsage(ResidencyUsage &usage) const
+    {
+        if (geometry.allocated)
+            GeometryPool<Layout>::Instance().AddUsage(geometry, usage);
+        ResidencyManager::Instance().AddBufferUsage(VBO, usage);
+        ResidencyManager::Instance().AddBufferUsage(EBO, usage);
+    }
+
+    size_t CpuBytes() const { return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int); }
+
+    // frees the CPU copies of the uploaded vertices and indices; lods and meshlets stay for drawing
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+private:
+    // render data 
+    GLName VBO, EBO;          // direct meshes only
+    GeometryRange geometry;   // pooled meshes: where the vertices and indices are in the pool
+    float uvPerUnit = 0.0f;   // texture coordinate units per model unit (from the areas), 0 if unknown
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    size_t gpuBytes = 0;
+    size_t vertexCount = 0, indexCount = 0;   // as uploaded, known after ReleaseCpuData()
+    bool compact = Layout::quantized;   // what the vertex shader has to decode
+    MeshletCullData meshletCullData;
+    // per-draw scratch, kept to avoid reallocating every frame
+    vector<uint8_t> meshletVisible;
+    vector<GLsizei> rangeCounts;
+    vector<const void*> rangeOffsets;
+    vector<GLint> rangeBaseVertices;
+    // the uniforms of the shader last drawn with
+    struct {
+        unsigned int program = 0;
+        vector<UniformHandle> samplers;   // one per texture
+        UniformHandle compactVertex, positionOffset, positionScale;
+    } uniforms;
+
+    // largest scale factor of model, and the distance from the camera to the nearest point of the bounding sphere
+    void placement(const glm::mat4 &model, const ViewState &view, float &scale, float &distance) const
+    {
+        scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 center = glm::vec3(model * glm::vec4(boundsCenter, 1.0f));
+        distance = std::max(glm::length(center - view.cameraPosition) - boundsRadius * scale, 1e-3f);
+    }
+
+    // tells the mip streamer how fine the textures have to be: the mesh's nearest point covers
+    // pixelsPerUnit * scale / distance pixels per model unit, which is that over uvPerUnit pixels per UV unit
+    void requestTextureDetail(const glm::mat4 &model, const ViewState &view) const
+    {
+        if (!MipFeedback().listening || textures.empty())
+            return;
+        float texelsPerUv = TextureFeedback::FULL_DETAIL;
+        if (uvPerUnit > 0.0f && view.pixelsPerUnit > 0.0f)
+        {
+            float scale, distance;
+            placement(model, view, scale, distance);
+            texelsPerUv = view.pixelsPerUnit * scale / distance / uvPerUnit;
+        }
+        for (const Texture &texture : textures)
+            MipFeedback().Want(texture.id, texelsPerUv);
+    }
+
+    void drawLevel(Shader &shader, unsigned int level)
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        const MeshLod &lod = lods[level];
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        GeometryPlacement placed = useBuffers();
+        GLState::Instance().BindVertexArray(vertexArray());
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<unsigned int>(lod.indexCount), indexType, (void*)(placed.indexOffset + lod.indexOffset * indexSize), (GLint)placed.firstVertex);
+
+        DrawStats &stats = FrameDrawStats();
+        stats.draws++;
+        stats.triangles += lod.indexCount / 3;
+        stats.fullTriangles += lods[0].indexCount / 3;
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    // binds the textures and sets the per-mesh uniforms; the textures and the VAO stay bound after the draw, so
+    // the next mesh with the same ones doesn't bind them again
+    void bindTextures(Shader &shader)
     {
+        if (uniforms.program != shader.ID)
+            resolveUniforms(shader);
+        // mark the textures used first: reloading a reduced one rebinds the active unit, which must not undo the
+        // binds below
+        for (const Texture &texture : textures)
+            ResidencyManager::Instance().UseTexture(texture.id);
         // bind appropriate textures
+        for(unsigned int i = 0; i < this->textures.size(); i++)
+        {
+            // set the sampler to the texture unit and bind the texture to it
+            shader.setInt(uniforms.samplers[i], i);
+            GLState::Instance().BindTexture(i, textures[i].id);
+        }
+        ClearSampledTextures((unsigned int)textures.size());
+        
+        // how the vertex shader has to read the attributes
+        shader.setBool(uniforms.compactVertex, compact);
+        shader.setVec3(uniforms.positionOffset, positionOffset);
+        shader.setVec3(uniforms.positionScale, positionScale);
+    }
+
+    // looks up the uniforms bindTextures() sets, once per shader the mesh is drawn with
+    void resolveUniforms(Shader &shader)
+    {
+        uniforms.program = shader.ID;
+        uniforms.samplers.clear();
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < this->textures.size(); i++)
+        for (const Texture &texture : textures)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = texture.type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if(name == "texture_specular")
@@ -82,73 +467,252 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to string
              else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to string
+            uniforms.samplers.push_back(shader.Uniform(name + number));
+        }
+        uniforms.compactVertex = shader.Uniform("compactVertex");
+        uniforms.positionOffset = shader.Uniform("positionOffset");
+        uniforms.positionScale = shader.Uniform("positionScale");
+    }
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    // tells the residency manager the geometry is drawn (bringing it back if it was evicted) and returns where it
+    // is in the pool; direct meshes start at the beginning of their own buffers
+    GeometryPlacement useBuffers()
+    {
+        if (geometry.allocated)
+            return GeometryPool<Layout>::Instance().Use(geometry);
+        ResidencyManager::Instance().UseBuffer(VBO);
+        ResidencyManager::Instance().UseBuffer(EBO);
+        return GeometryPlacement();
+    }
+
+    GLuint vertexArray() const
+    {
+        return geometry.allocated ? GeometryPool<Layout>::Instance().VAO() : (GLuint)VAO;
+    }
+
+    // puts the vertices and indices into the layout's pool
+    void setupMesh(ScratchArena &scratch)
+    {
+        // bounding sphere for LOD selection
+        if (!vertices.empty())
+        {
+            glm::vec3 lo = vertices[0].Position, hi = lo;
+            for (const Vertex &v : vertices)
+            {
+                lo = glm::min(lo, v.Position);
+                hi = glm::max(hi, v.Position);
+            }
+            boundsCenter = (lo + hi) * 0.5f;
+            boundsRadius = glm::length(hi - lo) * 0.5f;
+        }
+
+        // how texture space maps onto the surface, for mip streaming
+        double worldArea = 0.0, uvArea = 0.0;
+        for (size_t i = 0; i + 2 < lods[0].indexCount; i += 3)
+        {
+            const Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+            worldArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+            glm::vec2 u = b.TexCoords - a.TexCoords, v = c.TexCoords - a.TexCoords;
+            uvArea += std::abs(u.x * v.y - u.y * v.x);
+        }
+        uvPerUnit = worldArea > 0.0 && uvArea > 0.0 ? (float)std::sqrt(uvArea / worldArea) : 0.0f;
+
+        // pack the vertices into the layout, quantizing positions to the mesh bounds if it asks for that
+        PositionQuantization bounds;
+        if (Layout::quantized && !vertices.empty())
+        {
+            glm::vec3 lo = vertices[0].Position, hi = lo;
+            for (const Vertex &v : vertices)
+            {
+                lo = glm::min(lo, v.Position);
+                hi = glm::max(hi, v.Position);
+            }
+            bounds = PositionQuantization(lo, hi);
+            positionOffset = bounds.offset;
+            positionScale = bounds.scale;
+        }
+        // FullLayout's Packed is Vertex itself: upload the vertices as they are
+        const typename Layout::Packed *packed;
+        if (is_same<typename Layout::Packed, Vertex>::value)
+            packed = reinterpret_cast<const typename Layout::Packed*>(vertices.data());
+        else
+        {
+            typename Layout::Packed *out = scratch.Allocate<typename Layout::Packed>(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++)
+                Layout::Pack(vertices[i], out[i], bounds);
+            packed = out;
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
 
-        // Always good practice to set everything back to defaults once configured.
-        for ( GLuint i = 0; i < this->textures.size( ); i++ )
+        // 16-bit indices whenever every vertex can be addressed with them (they stay relative to the mesh's first
+        // vertex in the pool)
+        const void *indexData = indices.data();
+        if (vertices.size() <= 65536)
         {
-            glActiveTexture( GL_TEXTURE0 + i );
-            glBindTexture( GL_TEXTURE_2D, 0 );
+            uint16_t *shortIndices = scratch.Allocate<uint16_t>(indices.size());
+            copy(indices.begin(), indices.end(), shortIndices);
+            indexData = shortIndices;
+            indexType = GL_UNSIGNED_SHORT;
         }
+        size_t indexBytes = indices.size() * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int));
+        GeometryPool<Layout>::Instance().Add(packed, vertices.size(), indexData, indexBytes, geometry);
+        gpuBytes = vertices.size() * sizeof(typename Layout::Packed) + indexBytes;
+        scratch.Reset();
+    }
+
+    // uploads the file's bytes as they are, with the attribute pointers of the file
+    void setupDirect(const DirectGeometry &direct)
+    {
+        glGenVertexArrays(1, &VAO.id);
+        glGenBuffers(1, &VBO.id);
+        glGenBuffers(1, &EBO.id);
+        boundsCenter = (direct.boundsMin + direct.boundsMax) * 0.5f;
+        boundsRadius = glm::length(direct.boundsMax - direct.boundsMin) * 0.5f;
+        compact = false;
+
+        GLState::Instance().BindVertexArray(VAO);
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, direct.vertexBytes, direct.vertexData, GL_STATIC_DRAW);
+        size_t indexSize = direct.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        GLState::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, direct.indexCount * indexSize, direct.indexData, GL_STATIC_DRAW);
+        indexType = direct.indexType;
+        gpuBytes = direct.vertexBytes + direct.indexCount * indexSize;
+        ResidencyManager::Instance().TrackBuffer(VBO, direct.vertexBytes);
+        ResidencyManager::Instance().TrackBuffer(EBO, direct.indexCount * indexSize);
+        for (const DirectAttribute &a : direct.attributes)
+        {
+            glEnableVertexAttribArray(a.location);
+            glVertexAttribPointer(a.location, a.components, a.type, a.normalized, a.stride, (void*)a.offset);
+        }
+        GLState::Instance().BindVertexArray(0);
+    }
+};
+
+// the original mesh: all attributes as floats
+typedef MeshT<FullLayout> Mesh;
+
+// the meshes of a model, all in one layout
+template <typename Layout>
+class MeshSet {
+public:
+    static constexpr unsigned int provides = Layout::provides;   // what the meshes can carry
+
+    // takes the vertices, indices, LODs and meshlets out of data
+    void Add(MeshData &&data, vector<Texture> &&textures, ScratchArena *scratch = nullptr)
+    {
+        if (data.direct.Valid())
+            meshes.emplace_back(data.direct, move(textures));
+        else
+            meshes.emplace_back(move(data.vertices), move(data.indices), move(textures), move(data.lods), move(data.meshlets), scratch);
+    }
+
+    void Draw(Shader &shader)
+    {
+        for (MeshT<Layout> &mesh : meshes)
+            mesh.Draw(shader);
+    }
+
+    void Draw(Shader &shader, const glm::mat4 &model)
+    {
+        for (MeshT<Layout> &mesh : meshes)
+            mesh.Draw(shader, model);
+    }
+
+    void DrawInstanced(Shader &shader, size_t offset, size_t count, const glm::mat4 &closest)
+    {
+        for (MeshT<Layout> &mesh : meshes)
+            mesh.DrawInstanced(shader, offset, count, closest);
+    }
+
+    // calls f on every mesh, whatever its layout
+    template <typename F>
+    void ForEach(F f)
+    {
+        for (MeshT<Layout> &mesh : meshes)
+            f(mesh);
+    }
+
+    size_t Size() const { return meshes.size(); }
+    void Clear() { meshes.clear(); }
+
+    // "lit:3" style summary of the layouts used
+    string Describe() const
+    {
+        return meshes.empty() ? string() : string(Layout::name) + ":" + to_string(meshes.size());
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    vector<MeshT<Layout>> meshes;
+};
+
+// meshes of a model that each get the smallest of Layouts covering their attributes; they are stored and drawn
+// grouped by layout
+template <typename... Layouts>
+class MeshSet<SmallestLayout<Layouts...>> {
+public:
+    static constexpr unsigned int provides = (Layouts::provides | ...);   // what any of them can carry
+
+    void Add(MeshData &&data, vector<Texture> &&textures, ScratchArena *scratch = nullptr)
+    {
+        bool added = false;
+        // the first layout that covers the attributes wins, so Layouts must be listed smallest first
+        ((!added && VertexLayoutCovers<Layouts>(data.attributes) ? (get<MeshSet<Layouts>>(sets).Add(move(data), move(textures), scratch), added = true) : false), ...);
+        // nothing covers it: use the most complete layout and drop what it can't carry
+        if (!added)
+            get<sizeof...(Layouts) - 1>(sets).Add(move(data), move(textures), scratch);
     }
+
+    void Draw(Shader &shader)
+    {
+        (get<MeshSet<Layouts>>(sets).Draw(shader), ...);
+    }
+
+    void Draw(Shader &shader, const glm::mat4 &model)
+    {
+        (get<MeshSet<Layouts>>(sets).Draw(shader, model), ...);
+    }
+
+    void DrawInstanced(Shader &shader, size_t offset, size_t count, const glm::mat4 &closest)
+    {
+        (get<MeshSet<Layouts>>(sets).DrawInstanced(shader, offset, count, closest), ...);
+    }
+
+    template <typename F>
+    void ForEach(F f)
+    {
+        (get<MeshSet<Layouts>>(sets).ForEach(f), ...);
+    }
+
+    size_t Size() const
+    {
+        return (get<MeshSet<Layouts>>(sets).Size() + ...);
+    }
+
+    void Clear()
+    {
+        (get<MeshSet<Layouts>>(sets).Clear(), ...);
+    }
+
+    string Describe() const
+    {
+        string description;
+        for (const string &part : { get<MeshSet<Layouts>>(sets).Describe()... })
+            if (!part.empty())
+                description += (description.empty() ? "" : " ") + part;
+        return description;
+    }
+
+private:
+    static constexpr bool sortedBySize()
+    {
+        size_t sizes[] = { sizeof(typename Layouts::Packed)... };
+        for (size_t i = 1; i < sizeof...(Layouts); i++)
+            if (sizes[i] < sizes[i - 1])
+                return false;
+        return true;
+    }
+    static_assert(sortedBySize(), "SmallestLayout must list its layouts from the smallest vertex to the largest");
+
+    tuple<MeshSet<Layouts>...> sets;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+#include "AssetPack.h"
+#include "MappedFile.h"
+
+// Binary cache of the final per-mesh Vertex/index arrays (with LOD ranges and meshlets) of an imported model, stored next to the asset as
+// "<asset>.meshcache". All records are fixed size and all arrays are 16-byte aligned, so a load is a memory map
+// (or a view into the asset pack), a handful of header checks and a memcpy per array. The cache is rebuilt whenever the format version, the Vertex
+// layout, the import flags, the source file or one of its side files (the .mtl libraries of an .obj) change; a side
+// file that was missing at import counts as changed once it appears.
+class MeshCache
+{
+public:
+    static const uint32_t VERSION = 5;
+
+    struct Header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t vertexSize;       // sizeof(Vertex) when written, catches struct layout changes
+        uint64_t importHash;       // hash of the post-process flags and options that shaped the data
+        int64_t  sourceMtime;
+        uint64_t sourceSize;
+        uint64_t sourceHash;       // FNV-1a of the source file, checked when only the mtime differs
+        uint32_t meshCount;
+        uint32_t textureRecordSize;
+        uint64_t sideFileOffset;   // SideFileRecords, right after the mesh entries
+        uint32_t sideFileCount;
+        uint32_t sideFileRecordSize;
+    };
+
+    struct MeshEntry {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t textureOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t attributes; // MeshData::attributes
+        uint64_t lodOffset;
+        uint32_t lodCount;
+        uint32_t meshletCount;
+        uint64_t meshletOffset;
+    };
+
+    struct TextureRecord {
+        char type[32];
+        char path[224];
+    };
+
+    // a file the import read besides the source, stamped like the source
+    struct SideFileRecord {
+        char     path[232];
+        uint32_t present;          // 0 if the importer looked for it and found nothing
+        uint32_t reserved;
+        int64_t  mtime;
+        uint64_t size;
+        uint64_t hash;
+    };
+
+    static std::string PathFor(const std::string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // fills meshes from the cache of sourcePath, returns false if there is no usable (current) cache
+    static bool Load(const std::string &sourcePath, uint64_t importHash, std::vector<MeshData> &meshes)
+    {
+        AssetFile file(PathFor(sourcePath));
+        if (!file.IsOpen() || file.Size() < sizeof(Header))
+            return false;
+
+        const unsigned char *base = file.Data();
+        const Header *header = reinterpret_cast<const Header*>(base);
+        if (std::memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION ||
+            header->vertexSize != sizeof(Vertex) || header->textureRecordSize != sizeof(TextureRecord) ||
+            header->sideFileRecordSize != sizeof(SideFileRecord))
+            return false;
+        if (header->importHash != importHash)
+            return false;
+        if (!isCurrent(sourcePath, *header))
+            return false;
+        if (!inBounds(header->sideFileOffset, (uint64_t)header->sideFileCount * sizeof(SideFileRecord), file.Size()))
+            return false;
+        const SideFileRecord *sideFiles = reinterpret_cast<const SideFileRecord*>(base + header->sideFileOffset);
+        for (uint32_t i = 0; i < header->sideFileCount; i++)
+            if (!isCurrent(sideFiles[i]))
+                return false;
+
+        uint64_t entriesEnd = sizeof(Header) + (uint64_t)header->meshCount * sizeof(MeshEntry);
+        if (entriesEnd > file.Size())
+            return false;
+        const MeshEntry *entries = reinterpret_cast<const MeshEntry*>(base + sizeof(Header));
+        // validate every range before touching anything, a truncated file must not be half-loaded
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshEntry &e = entries[i];
+            if (!inBounds(e.vertexOffset, (uint64_t)e.vertexCount * sizeof(Vertex), file.Size()) ||
+                !inBounds(e.indexOffset, (uint64_t)e.indexCount * sizeof(unsigned int), file.Size()) ||
+                !inBounds(e.textureOffset, (uint64_t)e.textureCount * sizeof(TextureRecord), file.Size()) ||
+                !inBounds(e.lodOffset, (uint64_t)e.lodCount * sizeof(MeshLod), file.Size()) ||
+                !inBounds(e.meshletOffset, (uint64_t)e.meshletCount * sizeof(Meshlet), file.Size()))
+                return false;
+        }
+
+        meshes.clear();
+        meshes.resize(header->meshCount);
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshEntry &e = entries[i];
+            MeshData &mesh = meshes[i];
+            const Vertex *vertices = reinterpret_cast<const Vertex*>(base + e.vertexOffset);
+            const unsigned int *indices = reinterpret_cast<const unsigned int*>(base + e.indexOffset);
+            const TextureRecord *textures = reinterpret_cast<const TextureRecord*>(base + e.textureOffset);
+            mesh.vertices.assign(vertices, vertices + e.vertexCount);
+            mesh.indices.assign(indices, indices + e.indexCount);
+            mesh.attributes = e.attributes;
+            const MeshLod *lods = reinterpret_cast<const MeshLod*>(base + e.lodOffset);
+            mesh.lods.assign(lods, lods + e.lodCount);
+            const Meshlet *meshlets = reinterpret_cast<const Meshlet*>(base + e.meshletOffset);
+            mesh.meshlets.assign(meshlets, meshlets + e.meshletCount);
+            mesh.textures.resize(e.textureCount);
+            for (uint32_t t = 0; t < e.textureCount; t++)
+            {
+                mesh.textures[t].type = textures[t].type;
+                mesh.textures[t].path = textures[t].path;
+            }
+        }
+        return true;
+    }
+
+    // writes the cache for sourcePath, with the side files the import read (or looked for); the file is written
+    // under a temporary name and renamed into place
+    static bool Store(const std::string &sourcePath, uint64_t importHash, const std::vector<MeshData> &meshes,
+                      const std::vector<std::string> &sideFilePaths)
+    {
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.importHash = importHash;
+        header.meshCount = (uint32_t)meshes.size();
+        header.textureRecordSize = sizeof(TextureRecord);
+        if (!FileStamp(sourcePath, header.sourceMtime, header.sourceSize))
+            return false;
+        MappedFile source(sourcePath);
+        header.sourceHash = source.IsOpen() ? HashBytes(source.Data(), source.Size()) : 0;
+
+        // texture records have fixed-size names: a truncated path would load the wrong file from a "current" cache
+        for (const MeshData &mesh : meshes)
+            for (const TextureRef &ref : mesh.textures)
+                if (ref.type.size() >= sizeof(TextureRecord::type) || ref.path.size() >= sizeof(TextureRecord::path))
+                    return false;
+
+        std::vector<SideFileRecord> sideFiles;
+        for (const std::string &path : sideFilePaths)
+        {
+            if (path.size() >= sizeof(SideFileRecord::path))
+                return false;   // could not be checked later: better no cache than a stale one
+            SideFileRecord record;
+            std::memset(&record, 0, sizeof(record));
+            std::memcpy(record.path, path.data(), path.size());
+            record.present = FileStamp(path, record.mtime, record.size);
+            if (record.present)
+            {
+                MappedFile side(path);
+                record.hash = side.IsOpen() ? HashBytes(side.Data(), side.Size()) : 0;
+            }
+            sideFiles.push_back(record);
+        }
+        header.sideFileRecordSize = sizeof(SideFileRecord);
+        header.sideFileCount = (uint32_t)sideFiles.size();
+
+        // lay out the payload: entries and side files first, then per mesh vertices, indices and texture records
+        std::vector<MeshEntry> entries(meshes.size());
+        header.sideFileOffset = sizeof(Header) + entries.size() * sizeof(MeshEntry);
+        uint64_t offset = align(header.sideFileOffset + sideFiles.size() * sizeof(SideFileRecord));
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            MeshEntry &e = entries[i];
+            std::memset(&e, 0, sizeof(e));
+            e.vertexCount = (uint32_t)meshes[i].vertices.size();
+            e.indexCount = (uint32_t)meshes[i].indices.size();
+            e.textureCount = (uint32_t)meshes[i].textures.size();
+            e.attributes = meshes[i].attributes;
+            e.vertexOffset = offset;
+            offset = align(offset + (uint64_t)e.vertexCount * sizeof(Vertex));
+            e.indexOffset = offset;
+            offset = align(offset + (uint64_t)e.indexCount * sizeof(unsigned int));
+            e.textureOffset = offset;
+            offset = align(offset + (uint64_t)e.textureCount * sizeof(TextureRecord));
+            e.lodCount = (uint32_t)meshes[i].lods.size();
+            e.lodOffset = offset;
+            offset = align(offset + (uint64_t)e.lodCount * sizeof(MeshLod));
+            e.meshletCount = (uint32_t)meshes[i].meshlets.size();
+            e.meshletOffset = offset;
+            offset = align(offset + (uint64_t)e.meshletCount * sizeof(Meshlet));
+        }
+
+        std::string cachePath = PathFor(sourcePath);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cout << "ERROR::MESHCACHE:: could not write " << tempPath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshEntry));
+        uint64_t written = sizeof(header) + entries.size() * sizeof(MeshEntry);
+        writeArray(out, written, sideFiles.data(), sideFiles.size() * sizeof(SideFileRecord));
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const MeshEntry &e = entries[i];
+            pad(out, written, e.vertexOffset);
+            writeArray(out, written, meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+            pad(out, written, e.indexOffset);
+            writeArray(out, written, meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int));
+            pad(out, written, e.textureOffset);
+            for (const TextureRef &ref : meshes[i].textures)
+            {
+                TextureRecord record;
+                std::memset(&record, 0, sizeof(record));
+                std::memcpy(record.type, ref.type.data(), ref.type.size());
+                std::memcpy(record.path, ref.path.data(), ref.path.size());
+                writeArray(out, written, &record, sizeof(record));
+            }
+            pad(out, written, e.lodOffset);
+            writeArray(out, written, meshes[i].lods.data(), meshes[i].lods.size() * sizeof(MeshLod));
+            pad(out, written, e.meshletOffset);
+            writeArray(out, written, meshes[i].meshlets.data(), meshes[i].meshlets.size() * sizeof(Meshlet));
+        }
+        out.close();
+        if (!out || std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+        {
+            std::remove(tempPath.c_str());
+            std::cout << "ERROR::MESHCACHE:: could not write " << cachePath << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char MAGIC[9] = "MSHCACHE";
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+
+    static bool inBounds(uint64_t offset, uint64_t length, size_t fileSize)
+    {
+        return offset <= fileSize && length <= fileSize - offset;
+    }
+
+    // the cache is current if the source is unchanged; a touched but identical source still counts as current
+    static bool isCurrent(const std::string &sourcePath, const Header &header)
+    {
+        int64_t mtime;
+        uint64_t size;
+        if (!FileStamp(sourcePath, mtime, size))
+            return true; // shipped without the source asset, the cache is all we have
+        if (size != header.sourceSize)
+            return false;
+        if (mtime == header.sourceMtime)
+            return true;
+        MappedFile source(sourcePath);
+        return source.IsOpen() && HashBytes(source.Data(), source.Size()) == header.sourceHash;
+    }
+
+    // a side file is current if it is unchanged; one that was there and is gone now was shipped without its
+    // sources, like the source above, but one that was missing and exists now is new
+    static bool isCurrent(const SideFileRecord &record)
+    {
+        std::string path(record.path, strnlen(record.path, sizeof(record.path)));
+        int64_t mtime;
+        uint64_t size;
+        if (!FileStamp(path, mtime, size))
+            return true;
+        if (!record.present || size != record.size)
+            return false;
+        if (mtime == record.mtime)
+            return true;
+        MappedFile side(path);
+        return side.IsOpen() && HashBytes(side.Data(), side.Size()) == record.hash;
+    }
+
+    static void pad(std::ofstream &out, uint64_t &written, uint64_t target)
+    {
+        static const char zeros[16] = {};
+        if (target > written)
+            out.write(zeros, (std::streamsize)(target - written));
+        written = target;
+    }
+
+    static void writeArray(std::ofstream &out, uint64_t &written, const void *data, size_t bytes)
+    {
+        if (bytes)
+            out.write(static_cast<const char*>(data), (std::streamsize)bytes);
+        written += bytes;
+    }
+};
+#endif
@@ -0,0 +1,386 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+// Import-time optimization of an indexed triangle mesh, run on the CPU before upload:
+//   1. weld vertices that are bit-for-bit identical
+//   2. reorder triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm)
+//   3. split that order into clusters and sort them front-to-back from the outside in, to reduce overdraw
+//   4. renumber vertices in first-use order, so vertex fetch walks the buffer linearly
+// plus the analysis used to report the effect of each step.
+
+struct MeshEfficiency {
+    float acmr = 0.0f;     // average cache miss ratio: transformed vertices per triangle (0.5 - 3.0)
+    float atvr = 0.0f;     // average transform to vertex ratio: transformed vertices per unique vertex (1.0 is ideal)
+    float overdraw = 0.0f; // shaded fragments per covered pixel, averaged over six axis-aligned views
+};
+
+struct MeshOptimizationStats {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    MeshEfficiency before;
+    MeshEfficiency after;
+};
+
+// ------------------------------------------------------------------------
+// analysis
+
+// simulated FIFO post-transform cache, the model used by most hardware
+inline unsigned int CountCacheMisses(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    unsigned int time = cacheSize + 1, misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (time - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// software rasterization from the six axis directions with depth testing and back-face culling
+inline float AnalyzeOverdraw(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    const int size = 256;
+    if (indices.empty())
+        return 0.0f;
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const Vertex &v : vertices)
+    {
+        lo = glm::min(lo, v.Position);
+        hi = glm::max(hi, v.Position);
+    }
+    float extent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), std::max(hi.z - lo.z, 1e-6f));
+    float scale = (size - 1) / extent;
+
+    std::vector<float> depth(size * size);
+    unsigned long long shaded = 0, covered = 0;
+    for (int axis = 0; axis < 3; axis++)
+        for (int side = 0; side < 2; side++)
+        {
+            std::fill(depth.begin(), depth.end(), 2.0f);
+            int u = (axis + 1) % 3, w = (axis + 2) % 3;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                glm::vec3 p[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    glm::vec3 q = (vertices[indices[t + k]].Position - lo) * scale;
+                    float d = q[axis] / (extent * scale + 1e-6f);
+                    p[k] = glm::vec3(q[u], q[w], side ? 1.0f - d : d);
+                }
+                float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+                // looking from the other side flips the winding, so cull the opposite half
+                if ((side ? -area : area) <= 0.0f)
+                    continue;
+                int x0 = std::max(0, (int)std::floor(std::min(p[0].x, std::min(p[1].x, p[2].x))));
+                int x1 = std::min(size - 1, (int)std::ceil(std::max(p[0].x, std::max(p[1].x, p[2].x))));
+                int y0 = std::max(0, (int)std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y))));
+                int y1 = std::min(size - 1, (int)std::ceil(std::max(p[0].y, std::max(p[1].y, p[2].y))));
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++)
+                    {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float b0 = (p[1].x - px) * (p[2].y - py) - (p[2].x - px) * (p[1].y - py);
+                        float b1 = (p[2].x - px) * (p[0].y - py) - (p[0].x - px) * (p[2].y - py);
+                        float b2 = (p[0].x - px) * (p[1].y - py) - (p[1].x - px) * (p[0].y - py);
+                        if ((area > 0 && (b0 < 0 || b1 < 0 || b2 < 0)) || (area < 0 && (b0 > 0 || b1 > 0 || b2 > 0)))
+                            continue;
+                        float z = (b0 * p[0].z + b1 * p[1].z + b2 * p[2].z) / area;
+                        float &stored = depth[y * size + x];
+                        if (z < stored)
+                        {
+                            if (stored > 1.5f)
+                                covered++;
+                            stored = z;
+                            shaded++;
+                        }
+                    }
+            }
+        }
+    return covered ? (float)shaded / covered : 0.0f;
+}
+
+inline MeshEfficiency AnalyzeMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    MeshEfficiency result;
+    if (indices.empty())
+        return result;
+    std::vector<bool> used(vertices.size(), false);
+    size_t unique = 0;
+    for (unsigned int index : indices)
+        if (!used[index])
+        {
+            used[index] = true;
+            unique++;
+        }
+    unsigned int misses = CountCacheMisses(indices, vertices.size());
+    result.acmr = (float)misses / (indices.size() / 3);
+    result.atvr = (float)misses / unique;
+    result.overdraw = AnalyzeOverdraw(vertices, indices);
+    return result;
+}
+
+// ------------------------------------------------------------------------
+// passes
+
+// merges vertices with identical bytes and rewrites the indices to match
+inline void WeldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    struct Hash {
+        size_t operator()(const Vertex &v) const
+        {
+            uint64_t h = 14695981039346656037ULL;
+            const unsigned char *p = reinterpret_cast<const unsigned char*>(&v);
+            for (size_t i = 0; i < sizeof(Vertex); i++)
+                h = (h ^ p[i]) * 1099511628211ULL;
+            return (size_t)h;
+        }
+    };
+    struct Equal {
+        bool operator()(const Vertex &a, const Vertex &b) const { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; }
+    };
+    std::unordered_map<Vertex, unsigned int, Hash, Equal> unique;
+    unique.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = unique.emplace(vertices[i], (unsigned int)welded.size());
+        if (inserted.second)
+            welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+    for (unsigned int &index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+// Forsyth's "linear-speed vertex cache optimisation": greedily emits the triangle whose vertices score highest,
+// where the score favours vertices recently used (still in the simulated LRU cache) and vertices with few
+// triangles left (so they are finished off and leave the cache).
+inline void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    const int cacheSize = 32;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    auto vertexScore = [](int cachePosition, unsigned int remaining) -> float {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+            score = cachePosition < 3 ? 0.75f : std::pow(1.0f - (cachePosition - 3) / float(cacheSize - 3), 1.5f);
+        return score + 2.0f / std::sqrt((float)remaining);
+    };
+
+    // vertex -> triangles adjacency, compressed rows
+    std::vector<unsigned int> offsets(vertexCount + 1, 0), remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount), triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache, nextCache;
+    size_t cursor = 0;
+    long best = 0;
+    for (size_t t = 1; t < triangleCount; t++)
+        if (triangleScore[t] > triangleScore[best])
+            best = (long)t;
+
+    while (best >= 0)
+    {
+        emitted[best] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[best * 3 + k];
+            result.push_back(v);
+            nextCache.push_back(v);
+            // drop the triangle from the vertex's list of remaining triangles
+            unsigned int *begin = &adjacency[offsets[v]], *end = begin + remaining[v];
+            *std::find(begin, end, (unsigned int)best) = *(end - 1);
+            remaining[v]--;
+        }
+        for (unsigned int v : cache)
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+                nextCache.push_back(v);
+
+        // rescore everything that was or is in the cache, and the triangles around it
+        for (size_t i = 0; i < nextCache.size(); i++)
+        {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < (size_t)cacheSize ? (int)i : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        best = -1;
+        float bestScore = -1e30f;
+        for (unsigned int v : nextCache)
+            for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; a++)
+            {
+                unsigned int t = adjacency[a];
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = (long)t;
+                }
+            }
+        if (nextCache.size() > (size_t)cacheSize)
+            nextCache.resize(cacheSize);
+        cache.swap(nextCache);
+
+        // nothing connected to the cache: continue with the next triangle not emitted yet
+        if (best < 0)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+                cursor++;
+            if (cursor < triangleCount)
+                best = (long)cursor;
+        }
+    }
+    indices.swap(result);
+}
+
+// Splits a cache-optimized triangle order into clusters at the points where the cache starts over, then sorts the
+// clusters so the ones facing outward (likely to occlude the rest) are drawn first. Clusters are kept intact, so the
+// cache efficiency is mostly preserved; threshold bounds how much ACMR a cluster split may give up.
+inline void OptimizeOverdraw(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, float threshold = 1.05f)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // cluster boundaries: triangles whose three vertices all miss the cache, as long as the cluster so far is
+    // within threshold of the mesh's overall ACMR
+    const unsigned int cacheSize = 16;
+    float meshAcmr = (float)CountCacheMisses(indices, vertices.size(), cacheSize) / triangleCount;
+    std::vector<unsigned int> timestamps(vertices.size(), 0);
+    unsigned int time = cacheSize + 1;
+    std::vector<size_t> clusterStarts(1, 0);
+    unsigned int clusterMisses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (time - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        size_t clusterTriangles = t - clusterStarts.back();
+        if (misses == 3 && clusterTriangles > 0 && (float)clusterMisses / clusterTriangles <= meshAcmr * threshold)
+        {
+            clusterStarts.push_back(t);
+            clusterMisses = 0;
+        }
+        clusterMisses += misses;
+    }
+    clusterStarts.push_back(triangleCount);
+
+    // centroid and area-weighted normal of the mesh and of every cluster
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++)
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position, &p1 = vertices[indices[t * 3 + 1]].Position, &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+            centroids[c] += center * area;
+            normals[c] += normal;
+            areas[c] += area;
+            meshCentroid += center * area;
+            meshArea += area;
+        }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid = areas[c] > 0.0f ? centroids[c] / areas[c] : meshCentroid;
+        float length = glm::length(normals[c]);
+        glm::vec3 normal = length > 0.0f ? normals[c] / length : glm::vec3(0.0f);
+        sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+    }
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+    indices.swap(result);
+}
+
+// renumbers vertices in the order the index buffer first uses them (unused vertices are dropped)
+inline void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unassigned = 0xFFFFFFFFu;
+    std::vector<unsigned int> remap(vertices.size(), unassigned);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unassigned)
+        {
+            remap[index] = (unsigned int)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+// runs all passes on the mesh and returns its before/after analysis
+inline MeshOptimizationStats OptimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    MeshOptimizationStats stats;
+    stats.verticesBefore = vertices.size();
+    stats.before = AnalyzeMesh(vertices, indices);
+    WeldVertices(vertices, indices);
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(vertices, indices);
+    OptimizeVertexFetch(vertices, indices);
+    stats.verticesAfter = vertices.size();
+    stats.after = AnalyzeMesh(vertices, indices);
+    return stats;
+}
+#endif
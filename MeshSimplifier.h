@@ -0,0 +1,282 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+// Level-of-detail generation by quadric error edge collapse (Garland & Heckbert), run at import time.
+// Collapses are half-edge collapses: a vertex is merged into one of its neighbours, so every LOD only uses vertices
+// that already exist and all levels share the base vertex buffer - a LOD is nothing but another index range.
+// The collapse cost is the position quadric plus a penalty for the normal and texture coordinate change, so seams
+// and shading discontinuities go last. Vertices on open borders and UV/normal seams never move.
+
+struct LodSettings {
+    unsigned int maxLods = 4;        // levels after the base mesh
+    float reduction = 0.5f;          // triangle count of each level relative to the previous one
+    float maxError = 0.05f;          // largest geometric error allowed, relative to the mesh extent
+    float attributeWeight = 0.05f;   // cost of a unit normal/UV change, relative to the mesh extent
+};
+
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const LodSettings &settings)
+        : vertices(vertices), settings(settings), triangles(indices)
+    {
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (const Vertex &v : vertices)
+        {
+            lo = glm::min(lo, v.Position);
+            hi = glm::max(hi, v.Position);
+        }
+        extent = vertices.empty() ? 0.0f : glm::length(hi - lo);
+        findLockedVertices();
+        buildQuadrics();
+    }
+
+    // appends each level's indices to indices and returns the level ranges, base mesh first
+    std::vector<MeshLod> Generate(std::vector<unsigned int> &indices)
+    {
+        std::vector<MeshLod> lods;
+        lods.push_back(MeshLod{ 0, (unsigned int)indices.size(), 0.0f });
+        size_t previous = triangles.size() / 3;
+        for (unsigned int level = 0; level < settings.maxLods; level++)
+        {
+            size_t target = (size_t)(previous * settings.reduction);
+            if (target < 4 || !simplify(target))
+                break;
+            size_t count = triangles.size() / 3;
+            // not worth a level of its own
+            if (count > previous * 0.9f)
+                break;
+            lods.push_back(MeshLod{ (unsigned int)indices.size(), (unsigned int)triangles.size(), error });
+            indices.insert(indices.end(), triangles.begin(), triangles.end());
+            previous = count;
+        }
+        return lods;
+    }
+
+private:
+    // symmetric 4x4 matrix of a sum of squared plane distances, weighted by area
+    struct Quadric {
+        double a[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        double area = 0.0;
+
+        void AddPlane(const glm::dvec3 &n, double d, double weight)
+        {
+            a[0] += weight * n.x * n.x; a[1] += weight * n.x * n.y; a[2] += weight * n.x * n.z; a[3] += weight * n.x * d;
+            a[4] += weight * n.y * n.y; a[5] += weight * n.y * n.z; a[6] += weight * n.y * d;
+            a[7] += weight * n.z * n.z; a[8] += weight * n.z * d;
+            a[9] += weight * d * d;
+            area += weight;
+        }
+        void Add(const Quadric &q)
+        {
+            for (int i = 0; i < 10; i++)
+                a[i] += q.a[i];
+            area += q.area;
+        }
+        double Evaluate(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                     + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                     + a[7] * z * z + 2 * a[8] * z + a[9];
+            return e > 0.0 ? e : 0.0;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from, to;
+        float cost;   // squared distance equivalent
+    };
+
+    const std::vector<Vertex> &vertices;
+    LodSettings settings;
+    std::vector<unsigned int> triangles;  // current level
+    std::vector<Quadric> quadrics;
+    std::vector<bool> locked;
+    float extent = 0.0f;
+    float error = 0.0f;                   // largest collapse error so far, in model units
+
+    // vertices sharing a position with a different normal/UV (seams), or on an edge with only one triangle
+    // (borders) or more than two (non-manifold) are locked
+    void findLockedVertices()
+    {
+        struct PositionHash {
+            size_t operator()(const glm::vec3 &p) const
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+            }
+        };
+        std::unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+        std::vector<unsigned int> position(vertices.size());
+        locked.assign(vertices.size(), false);
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            auto inserted = firstAt.emplace(vertices[i].Position, (unsigned int)i);
+            position[i] = inserted.first->second;
+            if (!inserted.second)
+            {
+                locked[i] = true;
+                locked[inserted.first->second] = true;
+            }
+        }
+
+        std::unordered_map<uint64_t, unsigned int> edgeUse;
+        edgeUse.reserve(triangles.size());
+        for (size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+                edgeUse[edgeKey(position[triangles[t + k]], position[triangles[t + (k + 1) % 3]])]++;
+        for (size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = triangles[t + k], b = triangles[t + (k + 1) % 3];
+                if (edgeUse[edgeKey(position[a], position[b])] != 2)
+                    locked[a] = locked[b] = true;
+            }
+    }
+
+    static uint64_t edgeKey(unsigned int a, unsigned int b)
+    {
+        return a < b ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+    }
+
+    void buildQuadrics()
+    {
+        quadrics.assign(vertices.size(), Quadric());
+        for (size_t t = 0; t < triangles.size(); t += 3)
+        {
+            glm::dvec3 p0 = vertices[triangles[t]].Position, p1 = vertices[triangles[t + 1]].Position, p2 = vertices[triangles[t + 2]].Position;
+            glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(n);
+            if (length <= 0.0)
+                continue;
+            n /= length;
+            for (int k = 0; k < 3; k++)
+                quadrics[triangles[t + k]].AddPlane(n, -glm::dot(n, p0), length * 0.5);
+        }
+    }
+
+    float collapseCost(unsigned int from, unsigned int to) const
+    {
+        const Quadric &q = quadrics[from];
+        const Vertex &a = vertices[from], &b = vertices[to];
+        float attributes = glm::dot(a.Normal - b.Normal, a.Normal - b.Normal) + glm::dot(a.TexCoords - b.TexCoords, a.TexCoords - b.TexCoords);
+        float weight = settings.attributeWeight * extent;
+        double area = q.area > 0.0 ? q.area : 1.0;
+        return (float)(q.Evaluate(b.Position) / area) + weight * weight * attributes;
+    }
+
+    // would moving from to the position of to flip or squash any of from's triangles?
+    bool flips(unsigned int from, unsigned int to, const std::vector<unsigned int> &around) const
+    {
+        for (unsigned int t : around)
+        {
+            unsigned int i0 = triangles[t], i1 = triangles[t + 1], i2 = triangles[t + 2];
+            if (i0 == to || i1 == to || i2 == to)
+                continue;  // collapses away
+            glm::vec3 p0 = vertices[i0].Position, p1 = vertices[i1].Position, p2 = vertices[i2].Position;
+            glm::vec3 before = glm::cross(p1 - p0, p2 - p0);
+            (i0 == from ? p0 : i1 == from ? p1 : p2) = vertices[to].Position;
+            glm::vec3 after = glm::cross(p1 - p0, p2 - p0);
+            float lengths = glm::length(before) * glm::length(after);
+            if (lengths <= 0.0f || glm::dot(before, after) < 0.25f * lengths)
+                return true;
+        }
+        return false;
+    }
+
+    // collapses edges in passes until at most target triangles are left; returns false if nothing could be removed
+    bool simplify(size_t target)
+    {
+        float maxCost = settings.maxError * extent;
+        maxCost *= maxCost;
+        size_t startCount = triangles.size() / 3;
+        while (triangles.size() / 3 > target)
+        {
+            // vertex -> triangles (by first index) for the current level
+            std::vector<unsigned int> offsets(vertices.size() + 1, 0);
+            for (unsigned int index : triangles)
+                offsets[index + 1]++;
+            for (size_t v = 0; v < vertices.size(); v++)
+                offsets[v + 1] += offsets[v];
+            std::vector<unsigned int> around(triangles.size()), fill(offsets.begin(), offsets.end() - 1);
+            for (size_t t = 0; t < triangles.size(); t += 3)
+                for (int k = 0; k < 3; k++)
+                    around[fill[triangles[t + k]]++] = (unsigned int)t;
+
+            std::vector<Collapse> candidates;
+            candidates.reserve(triangles.size() * 2);
+            for (size_t t = 0; t < triangles.size(); t += 3)
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = triangles[t + k], b = triangles[t + (k + 1) % 3];
+                    if (!locked[a])
+                        candidates.push_back(Collapse{ a, b, collapseCost(a, b) });
+                    if (!locked[b])
+                        candidates.push_back(Collapse{ b, a, collapseCost(b, a) });
+                }
+            std::sort(candidates.begin(), candidates.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+            // greedily take the cheapest collapses that don't touch each other's neighbourhoods
+            std::vector<unsigned int> remap(vertices.size());
+            for (size_t v = 0; v < vertices.size(); v++)
+                remap[v] = (unsigned int)v;
+            std::vector<bool> touched(vertices.size(), false);
+            size_t remaining = triangles.size() / 3, collapses = 0;
+            for (const Collapse &c : candidates)
+            {
+                if (c.cost > maxCost || remaining <= target)
+                    break;
+                if (touched[c.from] || touched[c.to])
+                    continue;
+                std::vector<unsigned int> neighbourhood(around.begin() + offsets[c.from], around.begin() + offsets[c.from + 1]);
+                if (flips(c.from, c.to, neighbourhood))
+                    continue;
+                remap[c.from] = c.to;
+                quadrics[c.to].Add(quadrics[c.from]);
+                error = std::max(error, std::sqrt(c.cost));
+                for (unsigned int t : neighbourhood)
+                {
+                    touched[triangles[t]] = touched[triangles[t + 1]] = touched[triangles[t + 2]] = true;
+                    if (triangles[t] == c.to || triangles[t + 1] == c.to || triangles[t + 2] == c.to)
+                        remaining--;
+                }
+                collapses++;
+            }
+            if (collapses == 0)
+                break;
+
+            // apply and drop the triangles that collapsed to a line
+            size_t write = 0;
+            for (size_t t = 0; t < triangles.size(); t += 3)
+            {
+                unsigned int i0 = remap[triangles[t]], i1 = remap[triangles[t + 1]], i2 = remap[triangles[t + 2]];
+                if (i0 == i1 || i1 == i2 || i0 == i2)
+                    continue;
+                triangles[write++] = i0;
+                triangles[write++] = i1;
+                triangles[write++] = i2;
+            }
+            triangles.resize(write);
+        }
+        return triangles.size() / 3 < startCount;
+    }
+};
+
+// builds the LOD chain of a mesh: the levels are appended to indices and their ranges returned, base mesh first
+inline std::vector<MeshLod> GenerateLods(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, const LodSettings &settings = LodSettings())
+{
+    MeshSimplifier simplifier(vertices, indices, settings);
+    return simplifier.Generate(indices);
+}
+#endif
@@ -0,0 +1,298 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "VertexLayout.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESHLET_CULL_SSE
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define MESHLET_CULL_NEON
+#endif
+
+// Meshlets: small clusters of a mesh's triangles (at most 64 vertices and 124 triangles) with a bounding sphere and
+// a cone bounding their normals, built at import. Every frame the clusters outside the view frustum, or whose
+// triangles all face away from the camera, are culled on the CPU - four at a time with SSE or NEON - and only the
+// survivors are drawn. A meshlet is a contiguous range of the index buffer, so neighbouring survivors merge into one
+// range and the whole visible set goes out in a single glMultiDrawElements.
+
+struct Meshlet {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;   // sin of the cone's half angle widened by 90 degrees; 1 = can't be backface culled
+};
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// Splits the triangles in indices[first, first + count) into meshlets, reordering them in place so that each meshlet
+// is a contiguous range. Meshlets are grown greedily from a seed triangle, always adding the neighbouring triangle
+// that brings the fewest new vertices, which keeps them compact (tight spheres, narrow cones).
+inline std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, size_t first, size_t count)
+{
+    std::vector<Meshlet> meshlets;
+    size_t triangleCount = count / 3;
+    if (triangleCount == 0)
+        return meshlets;
+    const unsigned int *tri = &indices[first];
+
+    // vertex -> triangles
+    std::vector<unsigned int> offsets(vertices.size() + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        offsets[tri[i] + 1]++;
+    for (size_t v = 0; v < vertices.size(); v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> adjacency(triangleCount * 3), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[tri[t * 3 + k]]++] = (unsigned int)t;
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> owner(vertices.size(), ~0u);   // meshlet that last used the vertex
+    std::vector<unsigned int> ordered;
+    ordered.reserve(triangleCount * 3);
+    std::vector<unsigned int> meshletVertices, meshletTriangles;
+    size_t cursor = 0;
+
+    auto finish = [&]() {
+        if (meshletTriangles.empty())
+            return;
+        Meshlet m;
+        m.indexOffset = (unsigned int)(first + ordered.size());
+        m.indexCount = (unsigned int)meshletTriangles.size() * 3;
+
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (unsigned int v : meshletVertices)
+        {
+            lo = glm::min(lo, vertices[v].Position);
+            hi = glm::max(hi, vertices[v].Position);
+        }
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (unsigned int v : meshletVertices)
+            radius = std::max(radius, glm::length(vertices[v].Position - center));
+
+        // normal cone: average direction, then the widest angle any triangle makes with it
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (unsigned int t : meshletTriangles)
+        {
+            const glm::vec3 &p0 = vertices[tri[t * 3]].Position, &p1 = vertices[tri[t * 3 + 1]].Position, &p2 = vertices[tri[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                continue;
+            normals.push_back(n / length);
+            axis += n / length;
+        }
+        float axisLength = glm::length(axis);
+        float minDot = 1.0f;
+        if (axisLength > 0.0f)
+        {
+            axis /= axisLength;
+            for (const glm::vec3 &n : normals)
+                minDot = std::min(minDot, glm::dot(axis, n));
+        }
+        else
+            minDot = -1.0f;
+
+        for (int k = 0; k < 3; k++)
+        {
+            m.center[k] = center[k];
+            m.coneAxis[k] = axis[k];
+        }
+        m.radius = radius;
+        // a cone wider than a hemisphere always has a triangle facing the camera
+        m.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+        meshlets.push_back(m);
+
+        for (unsigned int t : meshletTriangles)
+            ordered.insert(ordered.end(), tri + t * 3, tri + t * 3 + 3);
+        meshletVertices.clear();
+        meshletTriangles.clear();
+    };
+
+    auto newVertices = [&](unsigned int t) {
+        unsigned int id = (unsigned int)meshlets.size(), added = 0;
+        for (int k = 0; k < 3; k++)
+            added += owner[tri[t * 3 + k]] != id;
+        return added;
+    };
+
+    while (true)
+    {
+        // best unemitted neighbour of the current meshlet, or a fresh seed
+        unsigned int next = ~0u, fewest = 4;
+        for (unsigned int v : meshletVertices)
+            for (unsigned int a = offsets[v]; a < offsets[v + 1]; a++)
+            {
+                unsigned int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                unsigned int added = newVertices(t);
+                if (added < fewest)
+                {
+                    fewest = added;
+                    next = t;
+                }
+            }
+        if (next == ~0u)
+        {
+            // nothing connected left: start a new meshlet from the next unused triangle
+            finish();
+            while (cursor < triangleCount && emitted[cursor])
+                cursor++;
+            if (cursor == triangleCount)
+                break;
+            next = (unsigned int)cursor;
+            fewest = 3;
+        }
+        if (meshletVertices.size() + fewest > MESHLET_MAX_VERTICES || meshletTriangles.size() + 1 > MESHLET_MAX_TRIANGLES)
+        {
+            finish();
+            fewest = 3;
+        }
+
+        unsigned int id = (unsigned int)meshlets.size();
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = tri[next * 3 + k];
+            if (owner[v] != id)
+            {
+                owner[v] = id;
+                meshletVertices.push_back(v);
+            }
+        }
+        meshletTriangles.push_back(next);
+        emitted[next] = true;
+    }
+    std::copy(ordered.begin(), ordered.end(), indices.begin() + first);
+    return meshlets;
+}
+
+// planes (xyz normal pointing inside, w distance) of the frustum of a model-view-projection matrix, in the space
+// the matrix transforms from
+struct FrustumPlanes {
+    glm::vec4 planes[6];
+
+    explicit FrustumPlanes(const glm::mat4 &m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (glm::vec4 &p : planes)
+            p /= glm::length(glm::vec3(p));
+    }
+
+    bool ContainsSphere(const glm::vec3 &center, float radius) const
+    {
+        for (const glm::vec4 &p : planes)
+            if (glm::dot(glm::vec3(p), center) + p.w < -radius)
+                return false;
+        return true;
+    }
+};
+
+// meshlet bounds as structure of arrays, padded to a multiple of four, for the SIMD culling loop
+struct MeshletCullData {
+    std::vector<float> cx, cy, cz, radius, ax, ay, az, cutoff;
+    size_t count = 0;
+
+    void Set(const std::vector<Meshlet> &meshlets)
+    {
+        count = meshlets.size();
+        size_t padded = (count + 3) & ~(size_t)3;
+        for (std::vector<float> *v : { &cx, &cy, &cz, &radius, &ax, &ay, &az, &cutoff })
+            v->assign(padded, 0.0f);
+        for (size_t i = 0; i < count; i++)
+        {
+            const Meshlet &m = meshlets[i];
+            cx[i] = m.center[0]; cy[i] = m.center[1]; cz[i] = m.center[2];
+            radius[i] = m.radius;
+            ax[i] = m.coneAxis[0]; ay[i] = m.coneAxis[1]; az[i] = m.coneAxis[2];
+            cutoff[i] = m.coneCutoff;
+        }
+    }
+};
+
+// writes 1 to visible[i] for every meshlet that may be seen from camera (both in the planes' space)
+inline void CullMeshlets(const MeshletCullData &data, const FrustumPlanes &frustum, const glm::vec3 &camera, std::vector<uint8_t> &visible)
+{
+    size_t padded = data.cx.size();
+    visible.resize(padded);
+#if defined(MESHLET_CULL_SSE)
+    __m128 camX = _mm_set1_ps(camera.x), camY = _mm_set1_ps(camera.y), camZ = _mm_set1_ps(camera.z);
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&data.cx[i]), y = _mm_loadu_ps(&data.cy[i]), z = _mm_loadu_ps(&data.cz[i]);
+        __m128 r = _mm_loadu_ps(&data.radius[i]);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4 &p : frustum.planes)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_mul_ps(y, _mm_set1_ps(p.y))),
+                                  _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+        }
+        // backfacing: dot(center - camera, axis) >= cutoff * |center - camera| + radius
+        __m128 dx = _mm_sub_ps(x, camX), dy = _mm_sub_ps(y, camY), dz = _mm_sub_ps(z, camZ);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&data.ax[i])), _mm_mul_ps(dy, _mm_loadu_ps(&data.ay[i]))),
+                                   _mm_mul_ps(dz, _mm_loadu_ps(&data.az[i])));
+        __m128 away = _mm_cmpge_ps(facing, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&data.cutoff[i]), distance), r));
+        int mask = _mm_movemask_ps(_mm_andnot_ps(away, inside));
+        for (int k = 0; k < 4; k++)
+            visible[i + k] = (mask >> k) & 1;
+    }
+#elif defined(MESHLET_CULL_NEON)
+    float32x4_t camX = vdupq_n_f32(camera.x), camY = vdupq_n_f32(camera.y), camZ = vdupq_n_f32(camera.z);
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        float32x4_t x = vld1q_f32(&data.cx[i]), y = vld1q_f32(&data.cy[i]), z = vld1q_f32(&data.cz[i]);
+        float32x4_t r = vld1q_f32(&data.radius[i]);
+        float32x4_t negR = vnegq_f32(r);
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for (const glm::vec4 &p : frustum.planes)
+        {
+            float32x4_t d = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(p.w), x, p.x), y, p.y), z, p.z);
+            inside = vandq_u32(inside, vcgeq_f32(d, negR));
+        }
+        float32x4_t dx = vsubq_f32(x, camX), dy = vsubq_f32(y, camY), dz = vsubq_f32(z, camZ);
+        float32x4_t distance = vsqrtq_f32(vmlaq_f32(vmlaq_f32(vmulq_f32(dx, dx), dy, dy), dz, dz));
+        float32x4_t facing = vmlaq_f32(vmlaq_f32(vmulq_f32(dx, vld1q_f32(&data.ax[i])), dy, vld1q_f32(&data.ay[i])), dz, vld1q_f32(&data.az[i]));
+        uint32x4_t away = vcgeq_f32(facing, vmlaq_f32(r, vld1q_f32(&data.cutoff[i]), distance));
+        uint32x4_t result = vbicq_u32(inside, away);
+        visible[i] = vgetq_lane_u32(result, 0) & 1;
+        visible[i + 1] = vgetq_lane_u32(result, 1) & 1;
+        visible[i + 2] = vgetq_lane_u32(result, 2) & 1;
+        visible[i + 3] = vgetq_lane_u32(result, 3) & 1;
+    }
+#else
+    for (size_t i = 0; i < padded; i++)
+    {
+        glm::vec3 center(data.cx[i], data.cy[i], data.cz[i]);
+        bool inside = frustum.ContainsSphere(center, data.radius[i]);
+        glm::vec3 d = center - camera;
+        bool away = glm::dot(d, glm::vec3(data.ax[i], data.ay[i], data.az[i])) >= data.cutoff[i] * glm::length(d) + data.radius[i];
+        visible[i] = inside && !away;
+    }
+#endif
+    visible.resize(data.count);
+}
+#endif
@@ -1,7 +1,6 @@
 #ifndef MODEL_H
 #define MODEL_H
-#define STB_IMAGE_IMPLEMENTATION
-#include <assimp/stb_image.h>
+#include "Image.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -13,7 +12,20 @@
 #include <iostream>
 #include "Shader.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include "VertexBuffer.h"
+#include "ThreadPool.h"
+#include "TextureStreamer.h"
+#include "CompressedTexture.h"
+#include "TextureRegistry.h"
+#include "AssetIOSystem.h"
+#include "ObjLoader.h"
+#include "GltfLoader.h"
+#include "TangentSpace.h"
+#include "ScratchArena.h"
+#include "MemoryStats.h"
 
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -25,54 +37,577 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int UploadTexture(const DecodedImage &image, const char *path);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, bool normalMap = false);
+bool LoadTextureInto(unsigned int textureID, const char *path, const string &directory);
 
-class Model 
+// timings of the last load, in milliseconds
+struct ModelLoadStats {
+    double importMs = 0.0;
+    double decodeMs = 0.0;
+    double uploadMs = 0.0;
+    bool fromCache = false;
+    bool fromObjLoader = false;   // imported by ObjLoader rather than ASSIMP
+    bool fromGltf = false;        // imported by GltfLoader rather than ASSIMP
+    size_t directMeshes = 0;      // meshes uploaded straight from the file (see DirectGeometry)
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    size_t gpuBytes = 0;          // vertex and index buffers as uploaded
+    size_t uncompressedBytes = 0; // the same data as full Vertex and 32-bit indices
+    size_t cpuBytes = 0;          // vertices and indices still held on the CPU after Upload() (see keepCpuData)
+    size_t scratchBytes = 0;      // the upload's ScratchArena, reused from mesh to mesh
+    string layouts;               // vertex layouts the meshes ended up in (MeshSet::Describe)
+};
+
+// per-model import settings; everything in here that changes the imported data is part of the mesh cache key
+struct ModelOptions {
+    bool optimizeMeshes = false; // weld, vertex cache, overdraw and vertex fetch optimization (see MeshOptimizer.h)
+    bool generateLods = false;   // simplified levels of detail, picked per draw by screen-space error (see MeshSimplifier.h)
+    LodSettings lodSettings;
+    bool buildMeshlets = false;  // per-cluster frustum and backface culling of large meshes (see Meshlets.h)
+    bool fastObj = false;        // .obj files through ObjLoader instead of ASSIMP, falling back to ASSIMP if it can't (see ObjLoader.h)
+    bool keepCpuData = true;     // keep each mesh's vertices and indices after upload; off frees them (not part of the key)
+};
+
+inline double MillisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// A model whose meshes are uploaded in the vertex layout Layout (see VertexLayout.h). With a SmallestLayout, every
+// mesh gets the smallest of its layouts that covers what the mesh actually has; Model does that with the built-in
+// layouts.
+template <typename Layout = DefaultLayouts>
+class ModelT 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-    vector<Mesh> meshes;
+    vector<Texture> textures_loaded;	// textures this model holds a reference on in the TextureRegistry, released by the destructor.
+    MeshSet<Layout> meshes;
     string directory;
     bool gammaCorrection;
+    ModelOptions options;
+    ModelLoadStats stats;
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);  // model space, known once Import() succeeded
+    vector<AssetBlob> blobs;      // files ASSIMP reads from memory instead of the pack or disk (not owned)
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    ModelT(string const &path, bool gamma = false, const ModelOptions &options = ModelOptions()) : gammaCorrection(gamma), options(options)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // empty model, filled in two steps by Import() and Upload() (see ModelStreamer)
+    ModelT() : gammaCorrection(false) {}
+
+    ~ModelT()
+    {
+        for (const Texture &texture : textures_loaded)
+            TextureRegistry::Instance().Release(texture.id);
+    }
+
+    // a copy would release the shared textures twice
+    ModelT(const ModelT&) = delete;
+    ModelT& operator=(const ModelT&) = delete;
+
+    // CPU side of loading: reads the mesh cache or runs ASSIMP, converts the meshes and decodes the textures
+    // (unless they are going to be streamed). Makes no GL calls, so it can run on any thread; with a pool the
+    // meshes and textures are processed in parallel.
+    bool Import(string const &path, ThreadPool *pool = nullptr, bool decodeTextures = true)
+    {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        auto start = chrono::steady_clock::now();
+        uint64_t importHash = HashBytes(&importFlags, sizeof(importFlags));
+        importHash = HashBytes(&options.optimizeMeshes, sizeof(options.optimizeMeshes), importHash);
+        importHash = HashBytes(&options.generateLods, sizeof(options.generateLods), importHash);
+        if (options.generateLods)
+            importHash = HashBytes(&options.lodSettings, sizeof(options.lodSettings), importHash);
+        importHash = HashBytes(&options.buildMeshlets, sizeof(options.buildMeshlets), importHash);
+        importHash = HashBytes(&options.fastObj, sizeof(options.fastObj), importHash);
+        // the attributes the layouts need decide which normals and tangents finishMeshes() generates
+        unsigned int provides = MeshSet<Layout>::provides;
+        importHash = HashBytes(&provides, sizeof(provides), importHash);
+        // glTF files are read about as fast as the cache, and may upload straight from their own buffers
+        bool gltf = isGltf(path);
+        stats.fromCache = !gltf && MeshCache::Load(path, importHash, pendingMeshes);
+        if (!stats.fromCache)
+        {
+            vector<string> sideFiles;
+            if (!importModel(path, pendingMeshes, pool, sideFiles))
+                return false;
+            if (!gltf)
+                MeshCache::Store(path, importHash, pendingMeshes, sideFiles);
+        }
+        stats.importMs = MillisecondsSince(start);
+
+        bool first = true;
+        for (const MeshData &mesh : pendingMeshes)
+        {
+            for (const Vertex &v : mesh.vertices)
+            {
+                boundsMin = first ? v.Position : glm::min(boundsMin, v.Position);
+                boundsMax = first ? v.Position : glm::max(boundsMax, v.Position);
+                first = false;
+            }
+            if (mesh.direct.Valid())
+            {
+                boundsMin = first ? mesh.direct.boundsMin : glm::min(boundsMin, mesh.direct.boundsMin);
+                boundsMax = first ? mesh.direct.boundsMax : glm::max(boundsMax, mesh.direct.boundsMax);
+                first = false;
+            }
+        }
+
+        // decode every distinct texture once
+        start = chrono::steady_clock::now();
+        // (images inside a glTF file always: the streamer only knows files)
+        vector<string> paths;
+        vector<bool> normalMaps;    // per path: some material uses it as its normal map
+        for (const MeshData &mesh : pendingMeshes)
+            for (const TextureRef &ref : mesh.textures)
+            {
+                if (!decodeTextures && !pendingGltfImages.count(ref.path))
+                    continue;
+                size_t i = find(paths.begin(), paths.end(), ref.path) - paths.begin();
+                if (i == paths.size())
+                {
+                    paths.push_back(ref.path);
+                    normalMaps.push_back(false);
+                }
+                if (ref.type == "texture_normal")
+                    normalMaps[i] = true;
+            }
+        vector<DecodedImage> images(paths.size());
+        vector<CompressedImage> compressed(paths.size());
+        auto decode = [&](size_t i) {
+            // another model already has it on the GPU, Upload() will share that texture
+            if (TextureRegistry::Instance().Contains(paths[i], directory))
+                return;
+            auto embedded = pendingGltfImages.find(paths[i]);
+            if (embedded != pendingGltfImages.end())
+            {
+                LoadGltfImage(embedded->second, images[i], compressed[i]);
+                return;
+            }
+            // a current baked .ktx2 needs no decoding at all, just a mapping
+            if (OpenCompressedTexture(paths[i].c_str(), directory, compressed[i]))
+                return;
+            images[i] = DecodeTexture(paths[i].c_str(), directory);
+            BakeCompressedTextureIfStale(paths[i].c_str(), directory, images[i], normalMaps[i], pool);
+        };
+        if (pool)
+            pool->ParallelFor(paths.size(), decode);
+        else
+            for (size_t i = 0; i < paths.size(); i++)
+                decode(i);
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            if (compressed[i].Valid())
+                pendingCompressed[paths[i]] = move(compressed[i]);
+            else
+                pendingImages[paths[i]] = move(images[i]);
+        }
+        stats.decodeMs = MillisecondsSince(start);
+        return true;
+    }
+
+    // GL side of loading: creates the buffers and textures for everything Import() prepared.
+    // Must be called on the thread that owns the GL context. Textures Import() did not decode are handed to the
+    // streamer when there is one, and loaded synchronously otherwise.
+    void Upload(TextureStreamer *streamer = nullptr)
+    {
+        auto start = chrono::steady_clock::now();
+        // one arena for the packed vertices and 16-bit indices of all meshes: it grows to the largest and stays
+        ScratchArena scratch;
+        for (unsigned int i = 0; i < pendingMeshes.size(); i++)
+        {
+            const MeshData &data = pendingMeshes[i];
+            size_t vertexCount = data.direct.Valid() ? data.direct.vertexCount : data.vertices.size();
+            size_t indexCount = data.direct.Valid() ? data.direct.indexCount : data.lods.empty() ? data.indices.size() : data.lods[0].indexCount;
+            stats.vertexCount += vertexCount;
+            stats.triangleCount += indexCount / 3;
+            stats.uncompressedBytes += vertexCount * sizeof(Vertex) + (data.direct.Valid() ? indexCount : data.indices.size()) * sizeof(unsigned int);
+            stats.directMeshes += data.direct.Valid();
+            addMesh(move(pendingMeshes[i]), streamer, scratch);
+        }
+        stats.gpuBytes = 0;
+        stats.cpuBytes = 0;
+        stats.scratchBytes = scratch.CapacityBytes();
+        meshes.ForEach([this](auto &mesh) {
+            if (!options.keepCpuData)
+                mesh.ReleaseCpuData();
+            stats.gpuBytes += mesh.GpuBytes();
+            stats.cpuBytes += mesh.CpuBytes();
+        });
+        stats.layouts = meshes.Describe();
+        vector<MeshData>().swap(pendingMeshes);
+        pendingImages.clear();
+        pendingCompressed.clear();
+        pendingGltfImages.clear();
+        pendingSources.clear();
+        stats.uploadMs = MillisecondsSince(start);
+    }
+
+    // GPU memory of the meshes and textures right now (see Residency.h); a texture shared with other models is
+    // counted in each of them
+    ResidencyUsage GpuUsage()
+    {
+        ResidencyUsage usage;
+        meshes.ForEach([&usage](const auto &mesh) { mesh.AddGpuUsage(usage); });
+        vector<unsigned int> counted;
+        for (const Texture &texture : textures_loaded)
+            if (find(counted.begin(), counted.end(), texture.id) == counted.end())
+            {
+                counted.push_back(texture.id);
+                ResidencyManager::Instance().AddTextureUsage(texture.id, usage);
+            }
+        return usage;
+    }
+
+    // draws the model, and thus all its meshes, at full detail
     void Draw(Shader &shader)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        meshes.Draw(shader);
+    }
+
+    // sets the model matrix and draws every mesh as seen from CurrentView(): meshes and meshlets out of sight are
+    // culled, the rest drawn at the level of detail their size on screen calls for
+    void Draw(Shader &shader, const glm::mat4 &model)
+    {
+        if (uniforms.program != shader.ID)
+            resolveUniforms(shader);
+        shader.setMat4(uniforms.model, model);
+        meshes.Draw(shader, model);
+    }
+
+    // draws every copy of the model in one instanced draw per mesh: copies whose bounds are out of sight are
+    // dropped, the rest uploaded to the InstanceBuffer, and each mesh drawn at the level of detail its closest copy
+    // needs. The shader reads the instance matrices instead of the model uniform while "instanced" is set.
+    void DrawInstanced(Shader &shader, const InstanceData *instances, size_t count)
+    {
+        const ViewState &view = CurrentView();
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+        visibleInstances.clear();
+        size_t closest = 0;
+        float closestDetail = -1.0f;   // scale over distance: what LOD selection and mip feedback grow with
+        for (size_t i = 0; i < count; i++)
+        {
+            const glm::mat4 &model = instances[i].model;
+            if (view.culling && !FrustumPlanes(view.viewProjection * model).ContainsSphere(center, radius))
+            {
+                FrameDrawStats().meshesCulled += meshes.Size();
+                continue;
+            }
+            float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+            float distance = std::max(glm::length(glm::vec3(model * glm::vec4(center, 1.0f)) - view.cameraPosition) - radius * scale, 1e-3f);
+            if (scale / distance > closestDetail)
+            {
+                closestDetail = scale / distance;
+                closest = visibleInstances.size();
+            }
+            visibleInstances.push_back(instances[i]);
+        }
+        if (visibleInstances.empty())
+            return;
+
+        size_t offset = InstanceBuffer::Instance().Upload(visibleInstances.data(), visibleInstances.size());
+        if (uniforms.program != shader.ID)
+            resolveUniforms(shader);
+        shader.setBool(uniforms.instanced, true);
+        meshes.DrawInstanced(shader, offset, visibleInstances.size(), visibleInstances[closest].model);
+        shader.setBool(uniforms.instanced, false);
+    }
+
+    void DrawInstanced(Shader &shader, const vector<InstanceData> &instances)
+    {
+        DrawInstanced(shader, instances.data(), instances.size());
+    }
+
+    // compares ASSIMP's stdio file access with AssetIOSystem on every model below root, with the import flags used here
+    static void BenchmarkImportIO(const string &root)
+    {
+        BenchmarkAssimpIO(root, importFlags);
+    }
+
+    // Times ASSIMP's GenSmoothNormals and CalcTangentSpace steps on every model below root against TangentSpace.h
+    // doing the same work (normals where missing, tangents for every mesh with texture coordinates) on one thread and
+    // on the pool, and against what an import here actually generates.
+    static void BenchmarkTangentSpace(const string &root, ThreadPool *pool)
+    {
+        vector<string> paths;
+        for (const auto &entry : filesystem::recursive_directory_iterator(root))
+            if (entry.is_regular_file() && AssetFormatFor(entry.path().string()) == ASSET_MODEL)
+                paths.push_back(entry.path().string());
+        sort(paths.begin(), paths.end());
+
+        cout << "TANGENT SPACE BENCHMARK (" << (pool ? pool->Size() : 0) << " workers)" << endl;
+        char line[256];
+        snprintf(line, sizeof(line), "  %-36s %9s %10s %10s %10s %10s", "model", "vertices", "assimp", "1 thread", "pool", "as needed");
+        cout << line << endl;
+        for (const string &path : paths)
+        {
+            Assimp::Importer importer;
+            importer.SetIOHandler(new AssetIOSystem());
+            const aiScene *scene = importer.ReadFile(path, importFlags);
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+            {
+                snprintf(line, sizeof(line), "  %-36s could not be imported", path.c_str());
+                cout << line << endl;
+                continue;
+            }
+            ModelT converter;
+            vector<aiMesh*> sceneMeshes;
+            converter.processNode(scene->mRootNode, scene, sceneMeshes);
+            vector<MeshData> meshData;
+            size_t vertexCount = 0;
+            for (aiMesh *mesh : sceneMeshes)
+            {
+                meshData.push_back(converter.processMesh(mesh, scene));
+                vertexCount += meshData.back().vertices.size();
+            }
+
+            auto start = chrono::steady_clock::now();
+            importer.ApplyPostProcessing(aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+            double assimpMs = MillisecondsSince(start);
+
+            auto everything = [&](ThreadPool *threads) {
+                vector<MeshData> meshes = meshData;
+                auto generate = [&](size_t i) {
+                    if (!(meshes[i].attributes & VERTEX_NORMALS))
+                        GenerateSmoothNormals(meshes[i].vertices, meshes[i].indices, threads);
+                    if (meshes[i].attributes & VERTEX_TEXCOORDS)
+                        GenerateTangents(meshes[i].vertices, meshes[i].indices, threads);
+                };
+                auto start = chrono::steady_clock::now();
+                if (threads)
+                    threads->ParallelFor(meshes.size(), generate);
+                else
+                    for (size_t i = 0; i < meshes.size(); i++)
+                        generate(i);
+                return MillisecondsSince(start);
+            };
+            double serialMs = everything(nullptr);
+            double pooledMs = everything(pool);
+
+            vector<MeshData> meshes = meshData;
+            start = chrono::steady_clock::now();
+            auto needed = [&](size_t i) { generateTangentSpace(meshes[i], pool); };
+            if (pool)
+                pool->ParallelFor(meshes.size(), needed);
+            else
+                for (size_t i = 0; i < meshes.size(); i++)
+                    needed(i);
+            double neededMs = MillisecondsSince(start);
+
+            snprintf(line, sizeof(line), "  %-36s %9zu %8.1fms %8.1fms %8.1fms %8.1fms", path.c_str(), vertexCount,
+                     assimpMs, serialMs, pooledMs, neededMs);
+            cout << line << endl;
+        }
     }
     
 private:
+    // post-processing applied by ASSIMP; part of the mesh cache key, so changing it invalidates cached meshes
+    // (normals and tangents are not ASSIMP's job, see finishMeshes())
+    static constexpr unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+
+    // data produced by Import() and waiting for Upload()
+    vector<MeshData> pendingMeshes;
+    map<string, DecodedImage> pendingImages;
+    map<string, CompressedImage> pendingCompressed;
+    map<string, GltfImage> pendingGltfImages;   // images GltfLoader found inside its files, by TextureRef path
+    vector<AssetFile> pendingSources;           // files DirectGeometry and GltfImages point into
+
+    vector<InstanceData> visibleInstances;      // DrawInstanced() scratch, kept to avoid reallocating every frame
+    struct {
+        unsigned int program = 0;
+        UniformHandle model, instanced;
+    } uniforms;                                 // of the shader last drawn with
+
+    void resolveUniforms(Shader &shader)
+    {
+        uniforms.program = shader.ID;
+        uniforms.model = shader.Uniform("model");
+        uniforms.instanced = shader.Uniform("instanced");
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // the converted meshes are cached next to the file, so later runs skip ASSIMP entirely.
     void loadModel(string const &path)
     {
+        if (Import(path))
+            Upload();
+    }
+
+    static bool isGltf(string const &path)
+    {
+        string extension = filesystem::path(path).extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+        return extension == ".glb" || extension == ".gltf";
+    }
+
+    // runs GltfLoader, ObjLoader or ASSIMP on the file and converts every mesh into MeshData
+    // sideFiles gets the other files the importer read or looked for (an .obj's material libraries), for the cache
+    bool importModel(string const &path, vector<MeshData> &meshData, ThreadPool *pool, vector<string> &sideFiles)
+    {
+        stats.fromObjLoader = false;
+        stats.fromGltf = false;
+        if (isGltf(path))
+        {
+            // meshes the options rework need their vertices; the others can keep the file's buffers
+            bool allowDirect = !options.optimizeMeshes && !options.generateLods && !options.buildMeshlets;
+            GltfLoader loader(&blobs);
+            if (loader.Load(path, meshData, pool, allowDirect, (MeshSet<Layout>::provides & VERTEX_TANGENTS) != 0))
+            {
+                stats.fromGltf = true;
+                pendingGltfImages = loader.Images();
+                pendingSources = loader.TakeSources();
+                finishMeshes(path, meshData, pool);
+                return true;
+            }
+            cout << "GLTF LOADER:: " << path << ": " << loader.Error() << ", importing with ASSIMP" << endl;
+            meshData.clear();
+        }
+        if (options.fastObj && path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0)
+        {
+            ObjLoader loader(&blobs);
+            if (loader.Load(path, meshData, pool))
+            {
+                sideFiles = loader.SideFiles();
+                stats.fromObjLoader = true;
+                finishMeshes(path, meshData, pool);
+                return true;
+            }
+            cout << "OBJ LOADER:: " << path << ": " << loader.Error() << ", importing with ASSIMP" << endl;
+            meshData.clear();
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        vector<string> opened;
+        importer.SetIOHandler(new AssetIOSystem(&blobs, nullptr, &opened));
+        const aiScene* scene = importer.ReadFile(path, importFlags);
+        for (const string &file : opened)
+            if (NormalizeAssetPath(file) != NormalizeAssetPath(path))
+                sideFiles.push_back(file);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // process ASSIMP's root node recursively to find the meshes, then convert them (in parallel if we can)
+        vector<aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+        meshData.resize(sceneMeshes.size());
+        auto convert = [&](size_t i) { meshData[i] = processMesh(sceneMeshes[i], scene); };
+        if (pool)
+            pool->ParallelFor(sceneMeshes.size(), convert);
+        else
+            for (size_t i = 0; i < sceneMeshes.size(); i++)
+                convert(i);
+        finishMeshes(path, meshData, pool);
+        return true;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // The mesh processing after the import, the same whichever importer made the meshes: normals for meshes
+    // without, tangents for normal mapped meshes if the layouts can carry them (see TangentSpace.h), then the
+    // optional optimization, LODs and meshlets.
+    void finishMeshes(string const &path, vector<MeshData> &meshData, ThreadPool *pool)
+    {
+        vector<MeshOptimizationStats> optimization(meshData.size());
+        auto finish = [&](size_t i) {
+            MeshData &data = meshData[i];
+            if (data.direct.Valid())
+                return;   // uploaded as the file has it
+            generateTangentSpace(data, pool);
+            if (options.optimizeMeshes)
+                optimization[i] = OptimizeMesh(data.vertices, data.indices);
+            if (options.generateLods)
+            {
+                // the simplifier needs shared vertices to walk the surface
+                if (!options.optimizeMeshes)
+                    WeldVertices(data.vertices, data.indices);
+                data.lods = GenerateLods(data.vertices, data.indices, options.lodSettings);
+                if (options.optimizeMeshes)
+                    for (size_t level = 1; level < data.lods.size(); level++)
+                    {
+                        auto first = data.indices.begin() + data.lods[level].indexOffset;
+                        vector<unsigned int> levelIndices(first, first + data.lods[level].indexCount);
+                        OptimizeVertexCache(levelIndices, data.vertices.size());
+                        copy(levelIndices.begin(), levelIndices.end(), first);
+                    }
+            }
+            // only worth it for meshes big enough to be partly visible; small ones are culled whole
+            size_t fullIndices = data.lods.empty() ? data.indices.size() : data.lods[0].indexCount;
+            if (options.buildMeshlets && fullIndices / 3 >= 4 * MESHLET_MAX_TRIANGLES)
+                data.meshlets = BuildMeshlets(data.vertices, data.indices, 0, fullIndices);
+        };
+        if (pool)
+            pool->ParallelFor(meshData.size(), finish);
+        else
+            for (size_t i = 0; i < meshData.size(); i++)
+                finish(i);
+        if (options.optimizeMeshes || options.generateLods || options.buildMeshlets)
+            reportImport(path, meshData, optimization);
+    }
+
+    // what the layouts need and the mesh doesn't have yet
+    static void generateTangentSpace(MeshData &data, ThreadPool *pool)
+    {
+        if (!(data.attributes & VERTEX_NORMALS) && (MeshSet<Layout>::provides & VERTEX_NORMALS))
+        {
+            GenerateSmoothNormals(data.vertices, data.indices, pool);
+            data.attributes |= VERTEX_NORMALS;
+        }
+        bool normalMapped = any_of(data.textures.begin(), data.textures.end(), [](const TextureRef &t) { return t.type == "texture_normal"; });
+        if (normalMapped && !(data.attributes & VERTEX_TANGENTS) && (data.attributes & VERTEX_TEXCOORDS) &&
+            (data.attributes & VERTEX_NORMALS) && (MeshSet<Layout>::provides & VERTEX_TANGENTS))
+        {
+            GenerateTangents(data.vertices, data.indices, pool);
+            data.attributes |= VERTEX_TANGENTS;
+        }
+    }
+
+    // one line per mesh, printed in one go so models importing in parallel don't interleave
+    void reportImport(string const &path, const vector<MeshData> &meshData, const vector<MeshOptimizationStats> &optimization) const
+    {
+        string report = "MESH IMPORT:: " + path + "\n";
+        for (size_t i = 0; i < meshData.size(); i++)
+        {
+            char line[256];
+            int length = snprintf(line, sizeof(line), "  mesh %-3zu", i);
+            if (options.optimizeMeshes)
+            {
+                const MeshOptimizationStats &s = optimization[i];
+                length += snprintf(line + length, sizeof(line) - length, " verts %7zu -> %-7zu ACMR %.2f -> %.2f  ATVR %.2f -> %.2f  overdraw %.2f -> %.2f",
+                                   s.verticesBefore, s.verticesAfter, s.before.acmr, s.after.acmr, s.before.atvr, s.after.atvr,
+                                   s.before.overdraw, s.after.overdraw);
+            }
+            report += line;
+            if (options.generateLods)
+            {
+                report += "  LOD triangles";
+                for (const MeshLod &lod : meshData[i].lods)
+                    report += " " + to_string(lod.indexCount / 3);
+            }
+            if (!meshData[i].meshlets.empty())
+                report += "  meshlets " + to_string(meshData[i].meshlets.size());
+            report += "\n";
+        }
+        cout << report << flush;
+    }
+
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -80,27 +615,30 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(mesh);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<TextureRef> &textures = data.textures;
+        unsigned int &attributes = data.attributes;
 
-        // walk through each of the mesh's vertices
+        // walk through each of the mesh's vertices (sized up front, filled in place)
+        vertices.resize(mesh->mNumVertices);
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex{};
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -124,29 +662,24 @@ private:
                 vec.x = mesh->mTextureCoords[0][i].x; 
                 vec.y = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
-            vertices.push_back(vertex);
+            vertices[i] = vertex;
         }
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        size_t indexCount = 0;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        indices.resize(indexCount);
+        unsigned int *index = indices.data();
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            // by reference: copying an aiFace allocates a copy of its indices
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);        
+            index = copy(face.mIndices, face.mIndices + face.mNumIndices, index);
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
@@ -157,95 +690,140 @@ private:
         // specular: texture_specularN
         // normal: texture_normalN
 
+        textures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR) +
+                         material->GetTextureCount(aiTextureType_HEIGHT) + material->GetTextureCount(aiTextureType_AMBIENT));
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        materialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        materialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        materialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
+
+        // what the mesh has; missing normals and the tangents are generated by finishMeshes()
+        if (mesh->HasNormals())
+            attributes |= VERTEX_NORMALS;
+        if (mesh->mTextureCoords[0])
+            attributes |= VERTEX_TEXCOORDS;
+        if (mesh->HasBones())
+            attributes |= VERTEX_BONES;
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // appends the paths of all material textures of a given type to textures
+    void materialTextures(aiMaterial *mat, aiTextureType type, const char *typeName, vector<TextureRef> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            textures.push_back(TextureRef{ typeName, str.C_Str() });
         }
-        return textures;
+    }
+
+    // creates the OpenGL mesh for the imported data, loading its textures if they're not loaded yet; the
+    // geometry is moved into the mesh
+    void addMesh(MeshData &&data, TextureStreamer *streamer, ScratchArena &scratch)
+    {
+        vector<Texture> textures;
+        textures.reserve(data.textures.size());
+        for(unsigned int i = 0; i < data.textures.size(); i++)
+            textures.push_back(loadTexture(data.textures[i], streamer));
+
+        // the mesh set picks the vertex layout
+        meshes.Add(move(data), move(textures), &scratch);
+    }
+
+    Texture loadTexture(const TextureRef &ref, TextureStreamer *streamer)
+    {
+        // the registry shares textures across all models; only load it if nobody has it yet
+        // (using the data Import() prepared, if any)
+        Texture texture;
+        texture.id = TextureRegistry::Instance().Acquire(ref.path, this->directory, [&]() -> unsigned int {
+            auto baked = pendingCompressed.find(ref.path);
+            if (baked != pendingCompressed.end())
+                return UploadCompressedTexture(baked->second);
+            auto decoded = pendingImages.find(ref.path);
+            if (decoded != pendingImages.end())
+                return UploadTexture(decoded->second, ref.path.c_str());
+            if (streamer)
+                return streamer->Request(ref.path.c_str(), this->directory, ref.type == "texture_normal");
+            return TextureFromFile(ref.path.c_str(), this->directory, false, ref.type == "texture_normal");
+        });
+        // a file can be reloaded if the residency manager drops its mip levels; an image inside a glTF can't
+        if (!pendingGltfImages.count(ref.path))
+        {
+            string path = ref.path, directory = this->directory;
+            ResidencyManager::Instance().SetTextureSource(texture.id, [path, directory](GLuint id) {
+                return LoadTextureInto(id, path.c_str(), directory);
+            });
+        }
+        texture.type = ref.type;
+        texture.path = ref.path;
+        textures_loaded.push_back(texture);  // one entry per reference taken, released by the destructor
+        return texture;
     }
 };
 
+typedef ModelT<> Model;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+
+// specifies textureID from decoded pixels, with generated mips; false if the image has none
+bool UploadTextureInto(unsigned int textureID, const DecodedImage &image)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    if (!image.pixels)
+        return false;
+    GLenum format = TextureFormat(image.components);
+
+    GLState::Instance().BindTexture(textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
 
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return true;
+}
+
+unsigned int UploadTexture(const DecodedImage &image, const char *path)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (!UploadTextureInto(textureID, image))
     {
-        GLenum format;
-        if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        else
-            format = GL_RED;
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    return textureID;
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, bool normalMap)
+{
+    // prefer the baked block-compressed version, uploaded straight from its memory map
+    CompressedImage compressed;
+    if (OpenCompressedTexture(path, directory, compressed))
+        return UploadCompressedTexture(compressed);
 
-        stbi_image_free(data);
-    }
-    else
+    DecodedImage image = DecodeTexture(path, directory);
+    BakeCompressedTextureIfStale(path, directory, image, normalMap, nullptr);
+    return UploadTexture(image, path);
+}
+// puts the full image of directory/path back into an existing texture (the residency manager's reload)
+bool LoadTextureInto(unsigned int textureID, const char *path, const string &directory)
+{
+    CompressedImage compressed;
+    if (OpenCompressedTexture(path, directory, compressed))
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        UploadCompressedLevels(textureID, compressed);
+        GLState::Instance().BindTexture(0);
+        return true;
     }
-
-    return textureID;
+    bool uploaded = UploadTextureInto(textureID, DecodeTexture(path, directory));
+    GLState::Instance().BindTexture(0);
+    return uploaded;
 }
-#endif
\ No newline at end of file
+#endif
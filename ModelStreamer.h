@@ -0,0 +1,341 @@
+#ifndef MODELSTREAMER_H
+#define MODELSTREAMER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "GLState.h"
+#include "MemoryStats.h"
+#include "Model.h"
+#include "Shader.h"
+#include "ThreadPool.h"
+#include "TextureStreamer.h"
+
+// a model requested from a ModelStreamer, shared between the streamer and its handles
+struct StreamedModel {
+    enum State { QUEUED, IMPORTING, IMPORTED, READY, FAILED };
+
+    Model model;
+    std::string path;
+    std::atomic<int> state{QUEUED};
+    size_t order = 0;                   // request order, breaks priority ties
+    float distance = std::numeric_limits<float>::max(); // to the camera when last drawn; guarded by the streamer's mutex
+    glm::vec3 position = glm::vec3(0.0f); // where it was last drawn; GL thread only
+    bool drawn = false;
+};
+
+class ModelStreamer;
+
+// Returned by ModelStreamer::Request() straight away. Draw() draws the model once it is loaded, its bounding box
+// while it is being uploaded, and nothing before that or if it failed to load; DrawInstanced() does the same for
+// many copies at once (see Model::DrawInstanced).
+class ModelHandle
+{
+public:
+    ModelHandle() {}
+
+    bool Ready() const { return entry && entry->state == StreamedModel::READY; }
+    bool Failed() const { return entry && entry->state == StreamedModel::FAILED; }
+
+    // the model, or nullptr until it is ready
+    Model* Get() const { return Ready() ? &entry->model : nullptr; }
+
+    inline void Draw(Shader &shader, const glm::mat4 &model);
+    inline void DrawInstanced(Shader &shader, const std::vector<InstanceData> &instances);
+
+private:
+    friend class ModelStreamer;
+    std::shared_ptr<StreamedModel> entry;
+    ModelStreamer *streamer = nullptr;
+};
+
+// Loads models in the background so the render loop can start right away. Imports (mesh cache or ASSIMP, mesh
+// processing) run on a worker pool, nearest to the camera first: every queued import is a task that, when a worker
+// gets to it, takes whichever queued model is currently closest. Update() (once per frame, on the GL thread) uploads
+// finished imports, at most maxUploadsPerFrame per frame, again nearest first. Textures go through the
+// TextureStreamer if one is set.
+class ModelStreamer
+{
+public:
+    explicit ModelStreamer(unsigned int threadCount = 0, unsigned int maxUploadsPerFrame = 1)
+        : maxUploadsPerFrame(maxUploadsPerFrame), pool(threadCount)
+    {
+    }
+
+    ~ModelStreamer()
+    {
+        // queued imports are dropped, the ones running finish before the pool joins; like the meshes, the proxy
+        // buffers go with the GL context
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.clear();
+    }
+
+    ModelStreamer(const ModelStreamer&) = delete;
+    ModelStreamer& operator=(const ModelStreamer&) = delete;
+
+    // textures of streamed models are handed to textureStreamer instead of being decoded during the import
+    void StreamTextures(TextureStreamer &textureStreamer)
+    {
+        textures = &textureStreamer;
+    }
+
+    // starts loading path in the background and returns its handle
+    ModelHandle Request(const std::string &path, const ModelOptions &options = ModelOptions())
+    {
+        if (all.empty())
+        {
+            start = std::chrono::steady_clock::now();
+            ResetPeakResident();
+            memoryAtStart = CurrentMemory();
+        }
+        std::shared_ptr<StreamedModel> entry = std::make_shared<StreamedModel>();
+        entry->path = path;
+        entry->model.options = options;
+        entry->order = all.size();
+        all.push_back(entry);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back(entry);
+        }
+        bool decode = textures == nullptr;
+        pool.Submit([this, decode] { importNearest(decode); });
+
+        ModelHandle handle;
+        handle.entry = entry;
+        handle.streamer = this;
+        return handle;
+    }
+
+    // uploads finished imports and refreshes the priorities; call once per frame on the GL thread
+    void Update(const glm::vec3 &cameraPosition)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const std::shared_ptr<StreamedModel> &entry : queued)
+                if (entry->drawn)
+                    entry->distance = glm::length(entry->position - cameraPosition);
+        }
+
+        for (unsigned int uploads = 0; uploads < maxUploadsPerFrame; uploads++)
+        {
+            StreamedModel *nearest = nullptr;
+            for (const std::shared_ptr<StreamedModel> &entry : all)
+                if (entry->state == StreamedModel::IMPORTED &&
+                    (!nearest || distanceTo(*entry, cameraPosition) < distanceTo(*nearest, cameraPosition)))
+                    nearest = entry.get();
+            if (!nearest)
+                break;
+            nearest->model.Upload(textures);
+            nearest->state = StreamedModel::READY;
+        }
+
+        if (!reported && !all.empty())
+        {
+            size_t ready = 0, failed = 0;
+            for (const std::shared_ptr<StreamedModel> &entry : all)
+            {
+                ready += entry->state == StreamedModel::READY;
+                failed += entry->state == StreamedModel::FAILED;
+            }
+            if (ready + failed == all.size())
+            {
+                char line[320], memory[192];
+                FormatMemoryDelta(memory, sizeof(memory), memoryAtStart, CurrentMemory());
+                size_t cpuBytes = 0;
+                for (const std::shared_ptr<StreamedModel> &entry : all)
+                    cpuBytes += entry->model.stats.cpuBytes;
+                std::snprintf(line, sizeof(line), "MODEL STREAMING:: %zu models ready in %.1fms (%zu failed); %s, %.1f MB kept on the CPU",
+                              ready, MillisecondsSince(start), failed, memory, cpuBytes / (1024.0 * 1024.0));
+                std::cout << line << std::endl;
+                reportModels();
+                reported = true;
+            }
+        }
+    }
+
+    // GPU memory of every ready model (see Model::GpuUsage()), one line each
+    void ReportResidency()
+    {
+        std::string report = "RESIDENCY:: per model\n";
+        for (const std::shared_ptr<StreamedModel> &entry : all)
+        {
+            if (entry->state != StreamedModel::READY)
+                continue;
+            ResidencyUsage usage = entry->model.GpuUsage();
+            char line[256];
+            std::snprintf(line, sizeof(line), "  %-36s buffers %7.1f MB  textures %7.1f MB  evicted %7.1f MB\n", entry->path.c_str(),
+                          usage.bufferBytes / (1024.0 * 1024.0), usage.textureBytes / (1024.0 * 1024.0), usage.evictedBytes / (1024.0 * 1024.0));
+            report += line;
+        }
+        std::cout << report << std::flush;
+    }
+
+    // number of requested models not ready (or failed) yet
+    size_t Pending() const
+    {
+        size_t pending = 0;
+        for (const std::shared_ptr<StreamedModel> &entry : all)
+            pending += entry->state != StreamedModel::READY && entry->state != StreamedModel::FAILED;
+        return pending;
+    }
+
+private:
+    friend class ModelHandle;
+
+    // where each model came from and what its import, texture decoding and upload took, then the geometry totals
+    void reportModels() const
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-36s %6s %9s %9s %9s %9s %9s  %s", "model", "source", "verts", "import", "decode", "upload", "total", "layouts");
+        std::cout << line << std::endl;
+        size_t gpuBytes = 0, uncompressedBytes = 0, scratchBytes = 0;
+        for (const std::shared_ptr<StreamedModel> &entry : all)
+        {
+            const ModelLoadStats &s = entry->model.stats;
+            if (entry->state == StreamedModel::FAILED)
+            {
+                std::snprintf(line, sizeof(line), "  %-36s %6s", entry->path.c_str(), "FAILED");
+                std::cout << line << std::endl;
+                continue;
+            }
+            std::snprintf(line, sizeof(line), "  %-36s %6s %9zu %7.1fms %7.1fms %7.1fms %7.1fms  %s", entry->path.c_str(),
+                          s.fromCache ? "cache" : s.fromObjLoader ? "obj" : s.fromGltf ? "gltf" : "assimp", s.vertexCount, s.importMs, s.decodeMs, s.uploadMs,
+                          s.importMs + s.decodeMs + s.uploadMs, s.layouts.c_str());
+            std::cout << line << std::endl;
+            gpuBytes += s.gpuBytes;
+            uncompressedBytes += s.uncompressedBytes;
+            scratchBytes = std::max(scratchBytes, s.scratchBytes);
+        }
+        // signed: a layout may take more than the uncompressed vertices
+        double savedMB = ((double)uncompressedBytes - (double)gpuBytes) / (1024.0 * 1024.0);
+        std::snprintf(line, sizeof(line), "  geometry %.1f MB on the GPU, %.1f MB saved by vertex compression; largest upload scratch %.1f MB",
+                      gpuBytes / (1024.0 * 1024.0), savedMB, scratchBytes / (1024.0 * 1024.0));
+        std::cout << line << std::endl;
+    }
+
+    unsigned int maxUploadsPerFrame;
+    TextureStreamer *textures = nullptr;
+    std::vector<std::shared_ptr<StreamedModel>> all;    // GL thread only
+    std::mutex mutex;
+    std::vector<std::shared_ptr<StreamedModel>> queued; // waiting for a worker
+    std::chrono::steady_clock::time_point start;
+    MemorySnapshot memoryAtStart;
+    bool reported = false;
+    GLuint proxyVAO = 0, proxyVBO = 0, proxyEBO = 0;
+    struct {
+        unsigned int program = 0;
+        UniformHandle model, compactVertex, positionOffset, positionScale;
+    } uniforms;                                         // of the shader the last proxy was drawn with
+
+    // declared last so the workers are joined before anything they touch is destroyed
+    ThreadPool pool;
+
+    static float distanceTo(const StreamedModel &entry, const glm::vec3 &cameraPosition)
+    {
+        return entry.drawn ? glm::length(entry.position - cameraPosition) : std::numeric_limits<float>::max();
+    }
+
+    // worker side: imports the queued model closest to the camera
+    void importNearest(bool decodeTextures)
+    {
+        std::shared_ptr<StreamedModel> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queued.empty())
+                return;
+            auto nearest = std::min_element(queued.begin(), queued.end(), [](const std::shared_ptr<StreamedModel> &a, const std::shared_ptr<StreamedModel> &b) {
+                return a->distance != b->distance ? a->distance < b->distance : a->order < b->order;
+            });
+            entry = *nearest;
+            queued.erase(nearest);
+        }
+        entry->state = StreamedModel::IMPORTING;
+        bool imported = entry->model.Import(entry->path, &pool, decodeTextures);
+        if (!imported)
+            std::cout << "ERROR::MODEL STREAMER:: could not load " << entry->path << ", it will not be drawn" << std::endl;
+        entry->state = imported ? StreamedModel::IMPORTED : StreamedModel::FAILED;
+    }
+
+    // wireframe box over the model's bounds, drawn with the object shader: a unit cube scaled by the shader's
+    // position dequantization
+    void drawProxy(Shader &shader, const StreamedModel &entry, const glm::mat4 &model)
+    {
+        if (!proxyVAO)
+        {
+            const float corners[] = { 0,0,0, 1,0,0, 1,1,0, 0,1,0, 0,0,1, 1,0,1, 1,1,1, 0,1,1 };
+            const unsigned short edges[] = { 0,1, 1,2, 2,3, 3,0, 4,5, 5,6, 6,7, 7,4, 0,4, 1,5, 2,6, 3,7 };
+            glGenVertexArrays(1, &proxyVAO);
+            glGenBuffers(1, &proxyVBO);
+            glGenBuffers(1, &proxyEBO);
+            GLState::Instance().BindVertexArray(proxyVAO);
+            GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, proxyVBO);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+            GLState::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, proxyEBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(edges), edges, GL_STATIC_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+            GLState::Instance().BindVertexArray(0);
+        }
+        if (uniforms.program != shader.ID)
+            resolveUniforms(shader);
+        shader.setMat4(uniforms.model, model);
+        shader.setBool(uniforms.compactVertex, false);
+        shader.setVec3(uniforms.positionOffset, entry.model.boundsMin);
+        shader.setVec3(uniforms.positionScale, entry.model.boundsMax - entry.model.boundsMin);
+        GLState::Instance().BindVertexArray(proxyVAO);
+        ClearSampledTextures();
+        glVertexAttrib3f(1, 0.0f, 1.0f, 0.0f); // no normal array: a constant one keeps the lighting defined
+        glDrawElements(GL_LINES, 24, GL_UNSIGNED_SHORT, 0);
+        GLState::Instance().BindVertexArray(0);
+    }
+
+    void resolveUniforms(Shader &shader)
+    {
+        uniforms.program = shader.ID;
+        uniforms.model = shader.Uniform("model");
+        uniforms.compactVertex = shader.Uniform("compactVertex");
+        uniforms.positionOffset = shader.Uniform("positionOffset");
+        uniforms.positionScale = shader.Uniform("positionScale");
+    }
+};
+
+void ModelHandle::Draw(Shader &shader, const glm::mat4 &model)
+{
+    if (!entry)
+        return;
+    entry->position = glm::vec3(model[3]);
+    entry->drawn = true;
+    int state = entry->state;
+    if (state == StreamedModel::READY)
+        entry->model.Draw(shader, model);
+    else if (state == StreamedModel::IMPORTED)
+        streamer->drawProxy(shader, *entry, model);
+}
+
+void ModelHandle::DrawInstanced(Shader &shader, const std::vector<InstanceData> &instances)
+{
+    if (!entry || instances.empty())
+        return;
+    entry->position = glm::vec3(instances[0].model[3]);
+    entry->drawn = true;
+    int state = entry->state;
+    if (state == StreamedModel::READY)
+        entry->model.DrawInstanced(shader, instances);
+    else if (state == StreamedModel::IMPORTED)
+    {
+        // proxies are few and short-lived: one draw per copy is fine
+        for (const InstanceData &instance : instances)
+            streamer->drawProxy(shader, *entry, instance.model);
+    }
+}
+#endif
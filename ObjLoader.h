@@ -0,0 +1,806 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <assimp/fast_atof.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "AssetIOSystem.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// Wavefront OBJ/MTL importer for the scene's assets, a fast path around ASSIMP's general-purpose importer.
+// The file is memory mapped and cut into line-aligned chunks that are parsed on the thread pool: line ends are found
+// with memchr (vectorized by the C library) and numbers are read with ASSIMP's own fast_atof, so they come out
+// bit-identical. The statements are then replayed in file order to split the faces into meshes, and the meshes are
+// built in parallel, straight into Vertex/index arrays.
+// The result is what ModelT::processMesh makes of ASSIMP's output with ModelT's import flags (Triangulate, FlipUVs):
+// a mesh per object/group and material, one vertex per face corner, quads split at their concave corner (with
+// ASSIMP's arithmetic, so the same corner wins), UVs flipped. Normals the file lacks and tangents are left to
+// ModelT::finishMeshes, as for ASSIMP's meshes.
+// Anything this loader would not reproduce exactly (lines and points, polygons with more than four corners,
+// homogeneous vertices, texture options, line continuations, malformed numbers or indices ...) makes Load() fail
+// with a reason, and ModelT falls back to ASSIMP.
+
+// one newmtl block. ASSIMP knows the same texture keys, except map_metallic/map_roughness (written by Apple ModelI/O),
+// which it drops; they are kept here, though not turned into TextureRefs as nothing samples them yet
+struct ObjMaterial {
+    std::string diffuse;    // map_Kd
+    std::string specular;   // map_Ks
+    std::string ambient;    // map_Ka
+    std::string bump;       // map_bump, bump
+    std::string normal;     // map_Kn, norm
+    std::string metallic;   // map_metallic, map_Pm
+    std::string roughness;  // map_roughness, map_Pr
+};
+
+class ObjLoader
+{
+public:
+    // blobs (see AssetIOSystem.h) are served instead of files, like the ASSIMP path does
+    explicit ObjLoader(const std::vector<AssetBlob> *blobs = nullptr) : blobs(blobs) {}
+
+    // parses path into one MeshData per mesh, in ASSIMP's order; on false Error() says why
+    bool Load(const std::string &path, std::vector<MeshData> &meshes, ThreadPool *pool = nullptr)
+    {
+        error.clear();
+        materials.clear();
+        sideFiles.clear();
+        Source file;
+        if (!open(path, file))
+            return fail("cannot open " + path);
+
+        // 1. parse line-aligned chunks in parallel
+        size_t workers = pool ? pool->Size() + 1 : 1;
+        size_t chunkBytes = std::max<size_t>(file.size / (workers * 4) + 1, 256 * 1024);
+        std::vector<Chunk> chunks;
+        for (size_t begin = 0; begin < file.size;)
+        {
+            size_t end = std::min(file.size, begin + chunkBytes);
+            const void *newline = end < file.size ? std::memchr(file.data + end, '\n', file.size - end) : nullptr;
+            end = newline ? (const char*)newline - file.data + 1 : file.size;
+            Chunk chunk;
+            chunk.begin = file.data + begin;
+            chunk.end = file.data + end;
+            chunks.push_back(std::move(chunk));
+            begin = end;
+        }
+        auto parse = [&](size_t i) { parseChunk(chunks[i], i + 1 == chunks.size()); };
+        if (pool)
+            pool->ParallelFor(chunks.size(), parse);
+        else
+            for (size_t i = 0; i < chunks.size(); i++)
+                parse(i);
+        for (const Chunk &chunk : chunks)
+            if (!chunk.error.empty())
+                return fail(chunk.error);
+
+        // 2. concatenate the vertex data and replay the statements in order to assign faces to meshes
+        for (Chunk &chunk : chunks)
+        {
+            chunk.firstPosition = (uint32_t)positions.size();
+            chunk.firstTexCoord = (uint32_t)texCoords.size();
+            chunk.firstNormal = (uint32_t)normals.size();
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        }
+        std::vector<ObjMesh> objMeshes;
+        if (!assemble(path, chunks, objMeshes))
+            return false;
+
+        // 3. build the meshes in parallel
+        std::vector<MeshData> built(objMeshes.size());
+        std::vector<std::string> errors(objMeshes.size());
+        auto build = [&](size_t i) { buildMesh(objMeshes[i], chunks, built[i], errors[i]); };
+        if (pool)
+            pool->ParallelFor(objMeshes.size(), build);
+        else
+            for (size_t i = 0; i < objMeshes.size(); i++)
+                build(i);
+        for (const std::string &e : errors)
+            if (!e.empty())
+                return fail(e);
+        meshes = std::move(built);
+        return true;
+    }
+
+    const std::string& Error() const { return error; }
+    const std::map<std::string, ObjMaterial>& Materials() const { return materials; }
+    // the material libraries the last Load() read, or looked for if there was none
+    const std::vector<std::string>& SideFiles() const { return sideFiles; }
+
+private:
+    // bytes of a file or blob, valid while the Source lives
+    struct Source {
+        AssetFile file;
+        const char *data = nullptr;
+        size_t size = 0;
+    };
+
+    struct Face {
+        uint32_t firstCorner;
+        uint32_t cornerCount;
+        uint32_t positions, texCoords, normals;   // chunk-local counts when the face was read, for negative indices
+    };
+
+    // everything but vertex data and faces, in file order
+    struct Statement {
+        enum Type { OBJECT, GROUP, USEMTL, MTLLIB } type;
+        size_t faces;        // faces of the chunk before this statement
+        std::string name;
+    };
+
+    struct Chunk {
+        const char *begin = nullptr, *end = nullptr;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texCoords;
+        std::vector<glm::vec3> normals;
+        std::vector<int32_t> corners;  // v, vt, vn per corner as written, 0 if absent
+        std::vector<Face> faces;
+        std::vector<Statement> statements;
+        uint32_t firstPosition = 0, firstTexCoord = 0, firstNormal = 0;
+        std::string error;
+    };
+
+    struct FaceRef {
+        uint32_t chunk, face;
+    };
+
+    // ObjFile::Mesh: the faces of an object between material changes
+    struct ObjMesh {
+        std::vector<FaceRef> faces;
+        std::string material;
+        bool hasMaterial = false;
+        bool hasNormals = false;
+        bool hasTexCoords = false;
+    };
+
+    const std::vector<AssetBlob> *blobs;
+    std::string error;
+    std::map<std::string, ObjMaterial> materials;
+    std::vector<std::string> sideFiles;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+
+    bool fail(const std::string &reason)
+    {
+        error = reason;
+        return false;
+    }
+
+    bool open(const std::string &path, Source &source) const
+    {
+        if (blobs)
+        {
+            std::string normalized = NormalizeAssetPath(path);
+            for (const AssetBlob &blob : *blobs)
+                if (NormalizeAssetPath(blob.path) == normalized)
+                {
+                    source.data = static_cast<const char*>(blob.data);
+                    source.size = blob.size;
+                    return true;
+                }
+        }
+        if (!source.file.Open(path))
+            return false;
+        source.data = reinterpret_cast<const char*>(source.file.Data());
+        source.size = source.file.Size();
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    // parsing
+
+    static bool isLineEnd(char c) { return c == '\n' || c == '\r' || c == '\0' || c == '\f'; }
+    static bool isSpace(char c) { return c == ' ' || c == '\t'; }
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    // the part of a number fast_atof reads; anything it would throw on (or read as nan/inf) is rejected
+    static bool isReal(const char *c)
+    {
+        if (*c == '-' || *c == '+')
+            c++;
+        if (!isDigit(c[0]) && !((c[0] == '.' || c[0] == ',') && isDigit(c[1])))
+            return false;
+        while (isDigit(*c))
+            c++;
+        if ((*c == '.' || *c == ',') && isDigit(c[1]))
+            for (c++; isDigit(*c); c++) {}
+        else if (*c == '.')
+            c++;
+        if (*c == 'e' || *c == 'E')
+        {
+            c++;
+            if (*c == '-' || *c == '+')
+                c++;
+            if (!isDigit(*c))
+                return false;
+        }
+        return true;
+    }
+
+    // splits [p, end) at spaces and tabs
+    static size_t tokens(const char *p, const char *end, const char **out, size_t capacity)
+    {
+        size_t count = 0;
+        while (p < end)
+        {
+            while (p < end && isSpace(*p))
+                p++;
+            if (p == end)
+                break;
+            if (count == capacity)
+                return capacity + 1;
+            out[count++] = p;
+            while (p < end && !isSpace(*p))
+                p++;
+        }
+        return count;
+    }
+
+    // reads n numbers from a v/vt/vn line; every token on the line must be one
+    static bool readReals(const char *p, const char *end, size_t minimum, size_t maximum, float *values, size_t &count)
+    {
+        const char *words[8];
+        count = tokens(p, end, words, 8);
+        if (count < minimum || count > maximum)
+            return false;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!isReal(words[i]))
+                return false;
+            values[i] = Assimp::fast_atof(words[i]);
+        }
+        return true;
+    }
+
+    // an OBJ index as ASSIMP's atoi stepping reads it: no sign but '-', no leading zeros
+    static bool readIndex(const char *&p, const char *end, int32_t &value)
+    {
+        bool negative = p < end && *p == '-';
+        const char *digits = negative ? p + 1 : p;
+        if (digits >= end || !isDigit(*digits) || *digits == '0')
+            return false;
+        int64_t v = 0;
+        const char *c = digits;
+        for (; c < end && isDigit(*c); c++)
+        {
+            v = v * 10 + (*c - '0');
+            if (v > INT32_MAX)
+                return false;
+        }
+        value = (int32_t)(negative ? -v : v);
+        p = c;
+        return true;
+    }
+
+    bool parseFace(const char *p, const char *end, Chunk &chunk)
+    {
+        Face face;
+        face.firstCorner = (uint32_t)(chunk.corners.size() / 3);
+        face.cornerCount = 0;
+        face.positions = (uint32_t)chunk.positions.size();
+        face.texCoords = (uint32_t)chunk.texCoords.size();
+        face.normals = (uint32_t)chunk.normals.size();
+        bool hasTexCoords = false, hasNormals = false;
+        while (true)
+        {
+            while (p < end && isSpace(*p))
+                p++;
+            if (p == end)
+                break;
+            int32_t corner[3] = { 0, 0, 0 };
+            if (!readIndex(p, end, corner[0]))
+                return false;
+            for (int slot = 1; slot < 3 && p < end && *p == '/'; slot++)
+            {
+                p++;
+                if (p < end && !isSpace(*p) && *p != '/' && !readIndex(p, end, corner[slot]))
+                    return false;
+            }
+            if (p < end && !isSpace(*p))
+                return false;
+            // every corner must agree on what it has, ASSIMP pairs them up by position in the face
+            if (face.cornerCount == 0)
+            {
+                hasTexCoords = corner[1] != 0;
+                hasNormals = corner[2] != 0;
+            }
+            else if (hasTexCoords != (corner[1] != 0) || hasNormals != (corner[2] != 0))
+                return false;
+            chunk.corners.insert(chunk.corners.end(), corner, corner + 3);
+            face.cornerCount++;
+        }
+        if (face.cornerCount == 0)
+            return true;  // ASSIMP ignores empty faces
+        if (face.cornerCount < 3 || face.cornerCount > 4)
+            return false;
+        chunk.faces.push_back(face);
+        return true;
+    }
+
+    // rest of the line after the keyword, as ASSIMP's getName reads it
+    static std::string restOfLine(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return std::string(p, end);
+    }
+
+    static std::string trim(const std::string &s)
+    {
+        size_t first = s.find_first_not_of(" \t");
+        if (first == std::string::npos)
+            return std::string();
+        return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+    }
+
+    static bool keyword(const char *p, const char *end, const char *word)
+    {
+        size_t length = std::strlen(word);
+        return (size_t)(end - p) >= length && std::memcmp(p, word, length) == 0 && (p + length == end || isSpace(p[length]));
+    }
+
+    void parseChunk(Chunk &chunk, bool last)
+    {
+        std::string tail;
+        const char *p = chunk.begin;
+        while (p < chunk.end)
+        {
+            const char *newline = (const char*)std::memchr(p, '\n', chunk.end - p);
+            const char *lineEnd = newline ? newline : chunk.end;
+            const char *next = newline ? newline + 1 : chunk.end;
+            // the file's last line without a newline: copy it so number parsing stops at a terminator
+            if (!newline && last)
+            {
+                tail.assign(p, chunk.end);
+                tail.push_back('\n');
+                p = tail.data();
+                lineEnd = p + tail.size() - 1;
+            }
+            const char *end = p;
+            while (end < lineEnd && !isLineEnd(*end))
+                end++;
+            if (end > p && end[-1] == '\\')
+            {
+                chunk.error = "line continuations are not supported";
+                return;
+            }
+            if (!parseLine(p, end, chunk))
+            {
+                if (chunk.error.empty())
+                    chunk.error = "unsupported statement \"" + std::string(p, std::min<size_t>(end - p, 40)) + "\"";
+                return;
+            }
+            p = next;
+            if (!tail.empty())
+                break;
+        }
+    }
+
+    bool parseLine(const char *p, const char *end, Chunk &chunk)
+    {
+        if (p == end)
+            return true;
+        float values[8];
+        size_t count;
+        switch (*p)
+        {
+        case 'v':
+            if (p + 1 < end && isSpace(p[1]))
+            {
+                // 6 components carry a vertex color, which processMesh does not use
+                if (!readReals(p + 1, end, 3, 6, values, count) || (count != 3 && count != 6))
+                    return false;
+                chunk.positions.emplace_back(values[0], values[1], values[2]);
+                return true;
+            }
+            if (p + 1 < end && p[1] == 't')
+            {
+                if (!readReals(p + 2, end, 2, 3, values, count))
+                    return false;
+                chunk.texCoords.emplace_back(values[0], values[1]);
+                return true;
+            }
+            if (p + 1 < end && p[1] == 'n')
+            {
+                if (!readReals(p + 2, end, 3, 3, values, count))
+                    return false;
+                chunk.normals.emplace_back(values[0], values[1], values[2]);
+                return true;
+            }
+            return true;  // vp and friends
+        case 'f':
+            return parseFace(p + 1, end, chunk);
+        case 'l':
+        case 'p':
+            chunk.error = "lines and points are not supported";
+            return false;
+        case 'o':
+        {
+            const char *name[1];
+            if (tokens(p + 1, end, name, 1) == 0)
+                return true;
+            const char *nameEnd = name[0];
+            while (nameEnd < end && !isSpace(*nameEnd))
+                nameEnd++;
+            chunk.statements.push_back(Statement{ Statement::OBJECT, chunk.faces.size(), std::string(name[0], nameEnd) });
+            return true;
+        }
+        case 'g':
+        {
+            std::string name = restOfLine(p + 1, end);
+            if (!name.empty())
+                chunk.statements.push_back(Statement{ Statement::GROUP, chunk.faces.size(), name });
+            return true;
+        }
+        case 'u':
+            if (keyword(p, end, "usemtl"))
+                chunk.statements.push_back(Statement{ Statement::USEMTL, chunk.faces.size(), trim(restOfLine(p + 6, end)) });
+            return true;
+        case 'm':
+            if (keyword(p, end, "mtllib"))
+            {
+                std::string name = restOfLine(p + 6, end);
+                if (!name.empty())
+                    chunk.statements.push_back(Statement{ Statement::MTLLIB, chunk.faces.size(), name });
+            }
+            return true;
+        default:
+            return true;  // comments, smoothing groups, anything ASSIMP skips
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // materials
+
+    void loadMaterialLibrary(const std::string &objPath, const std::string &name)
+    {
+        std::string directory = objPath.substr(0, objPath.find_last_of('/') + 1);
+        Source file;
+        std::string libraryPath = directory + name, fallbackPath = objPath.substr(0, objPath.size() - 3) + "mtl";
+        bool found = open(libraryPath, file);
+        if (!found && open(fallbackPath, file))
+        {
+            libraryPath = fallbackPath;
+            found = true;
+        }
+        if (std::find(sideFiles.begin(), sideFiles.end(), libraryPath) == sideFiles.end())
+            sideFiles.push_back(libraryPath);
+        if (!found)
+            return;  // like ASSIMP: the materials stay untextured
+
+        ObjMaterial *current = nullptr;
+        const char *p = file.data, *fileEnd = file.data + file.size;
+        while (p < fileEnd)
+        {
+            const char *end = p;
+            while (end < fileEnd && !isLineEnd(*end))
+                end++;
+            const char *next = end;
+            while (next < fileEnd && isLineEnd(*next))
+                next++;
+            if (p < end && (*p == 'n' || *p == 'N') && end - p > 1 && p[1] == 'e')
+            {
+                const char *words[2];
+                std::string materialName = tokens(p, end, words, 2) == 1 ? "DefaultMaterial" : trim(restOfLine(words[1], end));
+                current = &materials[materialName];
+            }
+            else if (current && p < end && (*p == 'm' || *p == 'b' || *p == 'r' || *p == 'd' || ((*p == 'n' || *p == 'N') && end - p > 1 && p[1] == 'o')))
+            {
+                if (!readTexture(p, end, *current))
+                    return;
+            }
+            p = next;
+        }
+    }
+
+    static bool startsWith(const char *p, const char *end, const char *key)
+    {
+        size_t length = std::strlen(key);
+        if ((size_t)(end - p) < length)
+            return false;
+        for (size_t i = 0; i < length; i++)
+            if (std::tolower((unsigned char)p[i]) != std::tolower((unsigned char)key[i]))
+                return false;
+        return true;
+    }
+
+    // ASSIMP's getTexture: the key is matched by prefix, in this order
+    bool readTexture(const char *p, const char *end, ObjMaterial &material)
+    {
+        std::string *out = nullptr;
+        if (startsWith(p, end, "map_Kd"))
+            out = &material.diffuse;
+        else if (startsWith(p, end, "map_Ka"))
+            out = &material.ambient;
+        else if (startsWith(p, end, "map_Ks"))
+            out = &material.specular;
+        else if (startsWith(p, end, "map_disp") || startsWith(p, end, "disp") || startsWith(p, end, "map_d") ||
+                 startsWith(p, end, "map_emissive") || startsWith(p, end, "map_Ke") || startsWith(p, end, "refl") ||
+                 startsWith(p, end, "map_ns"))
+            return true;  // maps processMesh does not use
+        else if (startsWith(p, end, "map_bump") || startsWith(p, end, "bump"))
+            out = &material.bump;
+        else if (startsWith(p, end, "map_Kn") || startsWith(p, end, "norm"))
+            out = &material.normal;
+        else if (startsWith(p, end, "map_Pr") || startsWith(p, end, "map_roughness"))
+            out = &material.roughness;
+        else if (startsWith(p, end, "map_Pm") || startsWith(p, end, "map_metallic"))
+            out = &material.metallic;
+        else
+            return true;
+
+        const char *name = p;
+        while (name < end && !isSpace(*name))
+            name++;
+        while (name < end && isSpace(*name))
+            name++;
+        if (name < end && *name == '-')
+        {
+            error = "texture options are not supported";
+            return false;
+        }
+        *out = std::string(name, end);
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    // mesh assembly, following ObjFileParser's object/group/material bookkeeping
+
+    bool assemble(const std::string &path, const std::vector<Chunk> &chunks, std::vector<ObjMesh> &out)
+    {
+        // objects in order, each a list of its meshes; -1 while there is no current object/mesh
+        std::vector<std::vector<size_t>> objects;
+        std::vector<std::string> objectNames;
+        std::vector<ObjMesh> meshes;
+        int currentObject = -1, currentMesh = -1;
+        std::string activeGroup, currentMaterial;
+        bool hasCurrentMaterial = false;
+
+        auto createMesh = [&]() {
+            meshes.emplace_back();
+            currentMesh = (int)meshes.size() - 1;
+            if (currentObject >= 0)
+                objects[currentObject].push_back(currentMesh);
+        };
+        auto createObject = [&](const std::string &name) {
+            objects.emplace_back();
+            objectNames.push_back(name);
+            currentObject = (int)objects.size() - 1;
+            createMesh();
+            if (hasCurrentMaterial)
+            {
+                meshes[currentMesh].material = currentMaterial;
+                meshes[currentMesh].hasMaterial = true;
+            }
+        };
+
+        for (uint32_t c = 0; c < chunks.size(); c++)
+        {
+            const Chunk &chunk = chunks[c];
+            size_t statement = 0;
+            for (uint32_t f = 0; f <= chunk.faces.size(); f++)
+            {
+                for (; statement < chunk.statements.size() && chunk.statements[statement].faces == f; statement++)
+                {
+                    const Statement &s = chunk.statements[statement];
+                    switch (s.type)
+                    {
+                    case Statement::OBJECT:
+                        if (std::find(objectNames.begin(), objectNames.end(), s.name) != objectNames.end())
+                            return fail("reopened object " + s.name);
+                        createObject(s.name);
+                        break;
+                    case Statement::GROUP:
+                        if (activeGroup != s.name)
+                        {
+                            createObject(s.name);
+                            activeGroup = s.name;
+                        }
+                        break;
+                    case Statement::USEMTL:
+                        if (s.name.empty() || (hasCurrentMaterial && currentMaterial == s.name))
+                            break;
+                        currentMaterial = s.name;
+                        hasCurrentMaterial = true;
+                        // a new mesh if the current one already has faces in another material
+                        if (currentMesh < 0 || (meshes[currentMesh].hasMaterial && meshes[currentMesh].material != s.name &&
+                                                !meshes[currentMesh].faces.empty()))
+                            createMesh();
+                        meshes[currentMesh].material = s.name;
+                        meshes[currentMesh].hasMaterial = true;
+                        break;
+                    case Statement::MTLLIB:
+                        loadMaterialLibrary(path, s.name);
+                        if (!error.empty())
+                            return false;
+                        break;
+                    }
+                }
+                if (f == chunk.faces.size())
+                    break;
+                if (currentObject < 0)
+                    createObject("defaultobject");
+                if (currentMesh < 0)
+                    createMesh();
+                ObjMesh &mesh = meshes[currentMesh];
+                const Face &face = chunk.faces[f];
+                const int32_t *corner = &chunk.corners[face.firstCorner * 3];
+                mesh.hasTexCoords |= corner[1] != 0;
+                mesh.hasNormals |= corner[2] != 0 || (corner[1] != 0 && chunk.firstTexCoord + face.texCoords == 0 &&
+                                                      chunk.firstNormal + face.normals > 0);
+                mesh.faces.push_back(FaceRef{ c, f });
+            }
+        }
+
+        // ASSIMP's node order: objects as created, their meshes in order, empty ones dropped
+        for (const std::vector<size_t> &object : objects)
+            for (size_t m : object)
+                if (!meshes[m].faces.empty())
+                    out.push_back(std::move(meshes[m]));
+        if (out.empty())
+            return fail("no faces");
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    // per-mesh processing, mirroring ASSIMP's aiVector3D arithmetic where the result depends on it
+
+    // aiVector3D::operator/= multiplies by the reciprocal
+    static glm::vec3 divide(glm::vec3 v, float f)
+    {
+        if (f == 1.0f)
+            return v;
+        float inverse = 1.0f / f;
+        return glm::vec3(v.x * inverse, v.y * inverse, v.z * inverse);
+    }
+    static float dot(const glm::vec3 &a, const glm::vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    static float length(const glm::vec3 &v) { return std::sqrt(dot(v, v)); }
+    static glm::vec3 normalize(const glm::vec3 &v) { return divide(v, length(v)); }
+
+    // TriangulateProcess: quads are fanned from their concave corner, if they have one
+    static void triangulate(const std::vector<Vertex> &vertices, unsigned int first, unsigned int count, std::vector<unsigned int> &indices)
+    {
+        if (count == 3)
+        {
+            indices.insert(indices.end(), { first, first + 1, first + 2 });
+            return;
+        }
+        unsigned int start = 0;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            const glm::vec3 &v = vertices[first + i].Position;
+            glm::vec3 left = normalize(vertices[first + (i + 3) % 4].Position - v);
+            glm::vec3 diagonal = normalize(vertices[first + (i + 2) % 4].Position - v);
+            glm::vec3 right = normalize(vertices[first + (i + 1) % 4].Position - v);
+            float angle = std::acos(dot(left, diagonal)) + std::acos(dot(right, diagonal));
+            if (angle > 3.1415926538f)
+            {
+                start = i;
+                break;
+            }
+        }
+        indices.insert(indices.end(), { first + start, first + (start + 1) % 4, first + (start + 2) % 4,
+                                        first + start, first + (start + 2) % 4, first + (start + 3) % 4 });
+    }
+
+    void buildMesh(const ObjMesh &mesh, const std::vector<Chunk> &chunks, MeshData &data, std::string &failure) const
+    {
+        bool hasNormals = mesh.hasNormals && !normals.empty();
+        bool hasTexCoords = mesh.hasTexCoords && !texCoords.empty();
+        size_t corners = 0;
+        for (const FaceRef &ref : mesh.faces)
+            corners += chunks[ref.chunk].faces[ref.face].cornerCount;
+
+        std::vector<Vertex> &vertices = data.vertices;
+        std::vector<unsigned int> &indices = data.indices;
+        vertices.assign(corners, Vertex{});
+        indices.reserve(corners * 3 / 2);
+        bool normalsValid = true, texCoordsValid = true;
+        unsigned int next = 0;
+        for (const FaceRef &ref : mesh.faces)
+        {
+            const Chunk &chunk = chunks[ref.chunk];
+            const Face &face = chunk.faces[ref.face];
+            // indices are relative to what was read up to the face
+            int64_t positionCount = chunk.firstPosition + face.positions;
+            int64_t texCoordCount = chunk.firstTexCoord + face.texCoords;
+            int64_t normalCount = chunk.firstNormal + face.normals;
+            for (unsigned int k = 0; k < face.cornerCount; k++)
+            {
+                const int32_t *corner = &chunk.corners[(face.firstCorner + k) * 3];
+                int32_t v = corner[0], vt = corner[1], vn = corner[2];
+                // with no texture coordinates read yet, "f v/n" means a normal (ASSIMP's reading)
+                if (vt != 0 && texCoordCount == 0 && normalCount > 0)
+                {
+                    if (vn != 0)
+                    {
+                        failure = "ambiguous face corner";
+                        return;
+                    }
+                    vn = vt;
+                    vt = 0;
+                }
+                int64_t position = v > 0 ? v - 1 : positionCount + v;
+                if (position < 0 || position >= (int64_t)positions.size())
+                {
+                    failure = "vertex index out of range";
+                    return;
+                }
+                Vertex &vertex = vertices[next + k];
+                vertex.Position = positions[(size_t)position];
+                if (hasNormals && normalsValid && vn != 0)
+                {
+                    int64_t n = vn > 0 ? vn - 1 : normalCount + vn;
+                    if (n < 0 || n >= (int64_t)normals.size())
+                        normalsValid = false;
+                    else
+                        vertex.Normal = normals[(size_t)n];
+                }
+                if (hasTexCoords && texCoordsValid && vt != 0)
+                {
+                    int64_t t = vt > 0 ? vt - 1 : texCoordCount + vt;
+                    if (t < 0 || t >= (int64_t)texCoords.size())
+                        texCoordsValid = false;
+                    else
+                        vertex.TexCoords = texCoords[(size_t)t];
+                }
+            }
+            triangulate(vertices, next, face.cornerCount, indices);
+            next += face.cornerCount;
+        }
+        if (!normalsValid)
+        {
+            hasNormals = false;
+            for (Vertex &v : vertices)
+                v.Normal = glm::vec3(0.0f);
+        }
+        if (!texCoordsValid)
+        {
+            hasTexCoords = false;
+            for (Vertex &v : vertices)
+                v.TexCoords = glm::vec2(0.0f);
+        }
+
+        // FlipUVs
+        if (hasTexCoords)
+            for (Vertex &v : vertices)
+                v.TexCoords.y = 1.0f - v.TexCoords.y;
+
+        // textures and attributes as processMesh sets them
+        const ObjMaterial *material = nullptr;
+        if (mesh.hasMaterial)
+        {
+            auto found = materials.find(mesh.material);
+            if (found != materials.end())
+                material = &found->second;
+        }
+        if (material)
+        {
+            const std::pair<const std::string*, const char*> maps[] = {
+                { &material->diffuse, "texture_diffuse" },
+                { &material->specular, "texture_specular" },
+                { &material->bump, "texture_normal" },
+                { &material->ambient, "texture_height" },
+            };
+            for (const auto &map : maps)
+                if (!map.first->empty())
+                    data.textures.push_back(TextureRef{ map.second, *map.first });
+        }
+        if (hasNormals)
+            data.attributes |= VERTEX_NORMALS;
+        if (hasTexCoords)
+            data.attributes |= VERTEX_TEXCOORDS;
+    }
+};
+#endif
@@ -0,0 +1,143 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Linked programs saved as driver binaries (glGetProgramBinary), so a program built once is loaded instead of compiled
+// on the next start. One file per program and set of defines, "<vertex shader>.<hash of the fragment shader path and
+// the defines>.program", holding the key it was built for: a hash of both sources (defines included) and a hash of
+// the driver's vendor, renderer and version strings, as a binary only loads on the driver that made it. A key
+// mismatch, or a binary the driver rejects after an update, means the program is compiled and the file rewritten.
+// Without GL 4.1 or ARB_get_program_binary nothing is cached. GL thread only.
+class ProgramCache
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t format;        // the binary format glGetProgramBinary reported
+        uint64_t sourceHash;    // FNV-1a of the vertex and the fragment source, defines included
+        uint64_t driverHash;    // FNV-1a of GL_VENDOR, GL_RENDERER and GL_VERSION
+        uint64_t binarySize;
+    };
+
+    static std::string PathFor(const std::string &vertexPath, const std::string &fragmentPath, const std::string &defines)
+    {
+        uint64_t hash = HashBytes(fragmentPath.data(), fragmentPath.size());
+        hash = HashBytes(defines.data(), defines.size(), hash);
+        char name[32];
+        std::snprintf(name, sizeof(name), ".%016llx.program", (unsigned long long)hash);
+        return vertexPath + name;
+    }
+
+    // whether the driver can hand out program binaries at all
+    static bool Supported()
+    {
+        static int supported = -1;
+        if (supported < 0)
+        {
+            GLint formats = 0;
+            if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            supported = formats > 0;
+        }
+        return supported == 1;
+    }
+
+    // links program from the binary cached at path; false if there is none for this key or the driver rejects it,
+    // and the program is then left for the caller to compile and link as usual
+    static bool Load(const std::string &path, uint64_t sourceHash, GLuint program)
+    {
+        if (!Supported())
+            return false;
+        MappedFile file(path);
+        if (!file.IsOpen() || file.Size() < sizeof(Header))
+            return false;
+        const Header *header = reinterpret_cast<const Header*>(file.Data());
+        if (std::memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION ||
+            header->sourceHash != sourceHash || header->driverHash != driverHash())
+            return false;
+        if (header->binarySize > file.Size() - sizeof(Header))
+            return false;
+
+        glProgramBinary(program, header->format, file.Data() + sizeof(Header), (GLsizei)header->binarySize);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+            std::cout << "SHADER:: the driver rejected the cached binary " << path << ", compiling" << std::endl;
+        return linked == GL_TRUE;
+    }
+
+    // saves the binary of program, linked from sources of sourceHash; written under a temporary name and renamed
+    // into place. The program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+    static bool Store(const std::string &path, uint64_t sourceHash, GLuint program)
+    {
+        if (!Supported())
+            return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        std::vector<unsigned char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.format = format;
+        header.sourceHash = sourceHash;
+        header.driverHash = driverHash();
+        header.binarySize = (uint64_t)length;
+
+        std::string tempPath = path + ".tmp";
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cout << "ERROR::PROGRAMCACHE:: could not write " << tempPath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(binary.data()), length);
+        out.close();
+        if (!out || std::rename(tempPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tempPath.c_str());
+            std::cout << "ERROR::PROGRAMCACHE:: could not write " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char MAGIC[9] = "PROGRAM1";
+
+    static uint64_t driverHash()
+    {
+        static uint64_t hash = 0;
+        if (!hash)
+        {
+            hash = HashBytes(nullptr, 0);
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+            {
+                const char *value = reinterpret_cast<const char*>(glGetString(name));
+                if (value)
+                    hash = HashBytes(value, std::strlen(value) + 1, hash);
+            }
+        }
+        return hash;
+    }
+};
+#endif
@@ -0,0 +1,482 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "GLState.h"
+
+// GPU size of a texture including its mip chain, read back from GL. Counts from the base level: the levels above
+// it are empty or, while mips are streaming in (see TextureStreamer.h), not specified yet.
+inline size_t GLTextureBytes(GLuint id)
+{
+    GLint width = 0, height = 0, compressed = 0, baseLevel = 0, maxLevel = 0;
+    GLState::Instance().BindTexture(id);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_COMPRESSED, &compressed);
+    size_t bytes;
+    if (compressed)
+    {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        bytes = (size_t)size;
+    }
+    else
+    {
+        GLint red = 0, green = 0, blue = 0, alpha = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_RED_SIZE, &red);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_GREEN_SIZE, &green);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_BLUE_SIZE, &blue);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_ALPHA_SIZE, &alpha);
+        bytes = (size_t)width * height * ((red + green + blue + alpha + 7) / 8);
+    }
+    GLState::Instance().BindTexture(0);
+    // a full mip chain adds a third
+    return maxLevel > baseLevel ? bytes * 4 / 3 : bytes;
+}
+
+// GPU memory of a set of resources (a model, or everything)
+struct ResidencyUsage {
+    size_t bufferBytes = 0;   // vertex and index buffers on the GPU
+    size_t textureBytes = 0;  // textures on the GPU, at the mip levels they currently have
+    size_t evictedBytes = 0;  // buffers paged out to host memory and mip levels dropped, to come back on use
+
+    size_t ResidentBytes() const { return bufferBytes + textureBytes; }
+};
+
+// Accounts the GPU memory of every mesh buffer and texture against a budget. Resources are tracked by their GL name
+// when created (Mesh, VertexBuffer, TextureRegistry) and marked used when drawn; geometry in a shared pool is tracked
+// per mesh range instead (TrackRange(), see GeometryPool.h), the pool's buffers themselves not at all. BeginFrame()
+// enforces the budget: while over it, the least recently used resources that were not drawn in the last frame are
+// evicted - a buffer is copied to host memory and its GPU storage freed, a range is handed to its owner's evict
+// callback (which copies it out and frees its space in the pool for other meshes; the pool buffers never shrink, so
+// that space is reused rather than given back to the driver), a texture drops its TEXTURE_DROP_LEVELS largest mip
+// levels (if it has a source to reload from). An evicted buffer or range is restored as soon as it is used again; a
+// reduced texture keeps drawing at the lower resolution and is reloaded when it is used and fits the budget again, at
+// most maxTextureReloadsPerFrame per frame. Textures whose mips are streamed (StreamTexture()) are only accounted: the
+// streamer decides their levels. A budget of 0 disables eviction; everything is still accounted.
+// GL thread only.
+class ResidencyManager
+{
+public:
+    static constexpr int TEXTURE_DROP_LEVELS = 2;  // per eviction: a quarter of the size in each dimension
+    static constexpr int TEXTURE_MIN_SIZE = 64;    // textures are not reduced below this
+
+    static ResidencyManager& Instance()
+    {
+        static ResidencyManager manager;
+        return manager;
+    }
+
+    void SetBudget(size_t bytes) { budget = bytes; }
+    size_t Budget() const { return budget; }
+
+    // reloading is a synchronous file read: keep it to a few per frame
+    unsigned int maxTextureReloadsPerFrame = 1;
+
+    // a buffer whose storage was just specified with glBufferData
+    void TrackBuffer(GLuint buffer, size_t bytes, GLenum usage = GL_STATIC_DRAW)
+    {
+        if (!buffer)
+            return;
+        Buffer &entry = buffers[buffer];
+        resident.bufferBytes += bytes - entry.bytes;
+        entry.bytes = bytes;
+        entry.usage = usage;
+        entry.lastUsed = frame;
+    }
+
+    void ForgetBuffer(GLuint buffer)
+    {
+        auto it = buffers.find(buffer);
+        if (it == buffers.end())
+            return;
+        if (it->second.host.empty())
+            resident.bufferBytes -= it->second.bytes;
+        else
+            resident.evictedBytes -= it->second.bytes;
+        buffers.erase(it);
+    }
+
+    // a texture that was just created or re-specified; its size is read back from GL. reload, if given, puts the
+    // full image back into the texture (same name) and makes it evictable.
+    void TrackTexture(GLuint texture, std::function<bool(GLuint)> reload = nullptr)
+    {
+        if (!texture)
+            return;
+        Texture &entry = textures[texture];
+        size_t bytes = GLTextureBytes(texture);
+        resident.textureBytes += bytes - entry.bytes;
+        resident.evictedBytes -= entry.droppedBytes;
+        entry.bytes = bytes;
+        entry.droppedBytes = 0;
+        entry.lastUsed = frame;
+        entry.reducible = true;
+        if (reload)
+            entry.reload = std::move(reload);
+    }
+
+    // gives a tracked texture a source to reload from, which makes it evictable
+    void SetTextureSource(GLuint texture, std::function<bool(GLuint)> reload)
+    {
+        auto it = textures.find(texture);
+        if (it != textures.end() && !it->second.reload)
+            it->second.reload = std::move(reload);
+    }
+
+    // the texture changed size outside the manager (a streamed image landed); ignored if it is not tracked
+    void UpdateTexture(GLuint texture)
+    {
+        if (textures.count(texture))
+            TrackTexture(texture);
+    }
+
+    // hands the texture's mip levels to a streamer (TextureStreamer.h): it is accounted but never reduced or reloaded
+    // here. Tracks it if it was not yet. Holds until the texture is forgotten.
+    void StreamTexture(GLuint texture)
+    {
+        if (!textures.count(texture))
+            TrackTexture(texture);
+        textures[texture].streamed = true;
+    }
+
+    bool IsStreamedTexture(GLuint texture) const
+    {
+        auto it = textures.find(texture);
+        return it != textures.end() && it->second.streamed;
+    }
+
+    void ForgetTexture(GLuint texture)
+    {
+        auto it = textures.find(texture);
+        if (it == textures.end())
+            return;
+        resident.textureBytes -= it->second.bytes;
+        resident.evictedBytes -= it->second.droppedBytes;
+        textures.erase(it);
+    }
+
+    // marks a buffer as drawn this frame, bringing it back first if it was evicted
+    void UseBuffer(GLuint buffer)
+    {
+        auto it = buffers.find(buffer);
+        if (it == buffers.end())
+            return;
+        it->second.lastUsed = frame;
+        if (!it->second.host.empty())
+            restoreBuffer(it->first, it->second);
+    }
+
+    // part of a shared buffer owned by a pool; evict moves its data out of the buffer. Returns the key for the calls
+    // below.
+    size_t TrackRange(size_t bytes, std::function<void()> evict)
+    {
+        size_t key = ++lastRangeKey;
+        Range &entry = ranges[key];
+        entry.bytes = bytes;
+        entry.lastUsed = frame;
+        entry.evict = std::move(evict);
+        resident.bufferBytes += bytes;
+        return key;
+    }
+
+    void ForgetRange(size_t key)
+    {
+        auto it = ranges.find(key);
+        if (it == ranges.end())
+            return;
+        if (it->second.evicted)
+            resident.evictedBytes -= it->second.bytes;
+        else
+            resident.bufferBytes -= it->second.bytes;
+        ranges.erase(it);
+    }
+
+    // marks a range as drawn this frame; true if it was evicted, and the owner has to bring its data back now
+    bool UseRange(size_t key)
+    {
+        auto it = ranges.find(key);
+        if (it == ranges.end())
+            return false;
+        Range &entry = it->second;
+        entry.lastUsed = frame;
+        if (!entry.evicted)
+            return false;
+        entry.evicted = false;
+        resident.bufferBytes += entry.bytes;
+        resident.evictedBytes -= entry.bytes;
+        restores++;
+        return true;
+    }
+
+    // marks a texture as drawn this frame; a reduced one is reloaded if the budget has room for it
+    void UseTexture(GLuint texture)
+    {
+        auto it = textures.find(texture);
+        if (it == textures.end())
+            return;
+        Texture &entry = it->second;
+        entry.lastUsed = frame;
+        if (entry.droppedBytes && !entry.streamed && reloadsThisFrame < maxTextureReloadsPerFrame &&
+            (!budget || resident.ResidentBytes() + entry.droppedBytes <= budget))
+        {
+            reloadsThisFrame++;
+            reloadTexture(it->first, entry);
+        }
+    }
+
+    // starts a frame: evicts least recently used resources until the budget is met
+    void BeginFrame()
+    {
+        frame++;
+        reloadsThisFrame = 0;
+        if (!budget || resident.ResidentBytes() <= budget)
+            return;
+
+        // candidates: not drawn in the frame that just ended, oldest first
+        enum Kind { BUFFER, RANGE, TEXTURE };
+        struct Candidate {
+            unsigned long long lastUsed;
+            size_t name;   // GL name, or range key
+            Kind kind;
+        };
+        std::vector<Candidate> candidates;
+        for (auto &it : buffers)
+            if (it.second.host.empty() && it.second.lastUsed + 1 < frame)
+                candidates.push_back(Candidate{ it.second.lastUsed, it.first, BUFFER });
+        for (auto &it : ranges)
+            if (!it.second.evicted && it.second.lastUsed + 1 < frame)
+                candidates.push_back(Candidate{ it.second.lastUsed, it.first, RANGE });
+        for (auto &it : textures)
+            if (it.second.reload && it.second.reducible && !it.second.streamed && it.second.lastUsed + 1 < frame)
+                candidates.push_back(Candidate{ it.second.lastUsed, it.first, TEXTURE });
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.lastUsed < b.lastUsed; });
+        for (const Candidate &c : candidates)
+        {
+            if (resident.ResidentBytes() <= budget)
+                break;
+            if (c.kind == TEXTURE)
+                dropMipLevels((GLuint)c.name, textures[(GLuint)c.name]);
+            else if (c.kind == RANGE)
+                evictRange(ranges[c.name]);
+            else
+                evictBuffer((GLuint)c.name, buffers[(GLuint)c.name]);
+        }
+    }
+
+    // adds one resource to a usage sum (Model::GpuUsage() sums its meshes and textures this way)
+    void AddBufferUsage(GLuint buffer, ResidencyUsage &usage) const
+    {
+        auto it = buffers.find(buffer);
+        if (it == buffers.end())
+            return;
+        if (it->second.host.empty())
+            usage.bufferBytes += it->second.bytes;
+        else
+            usage.evictedBytes += it->second.bytes;
+    }
+
+    void AddRangeUsage(size_t key, ResidencyUsage &usage) const
+    {
+        auto it = ranges.find(key);
+        if (it == ranges.end())
+            return;
+        if (it->second.evicted)
+            usage.evictedBytes += it->second.bytes;
+        else
+            usage.bufferBytes += it->second.bytes;
+    }
+
+    void AddTextureUsage(GLuint texture, ResidencyUsage &usage) const
+    {
+        auto it = textures.find(texture);
+        if (it == textures.end())
+            return;
+        usage.textureBytes += it->second.bytes;
+        usage.evictedBytes += it->second.droppedBytes;
+    }
+
+    // everything tracked
+    const ResidencyUsage& Total() const { return resident; }
+
+    void Report() const
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "RESIDENCY:: %.1f MB resident (buffers %.1f MB, textures %.1f MB) of a %s budget, %.1f MB evicted; %u evictions, %u restores so far",
+                      resident.ResidentBytes() / (1024.0 * 1024.0), resident.bufferBytes / (1024.0 * 1024.0),
+                      resident.textureBytes / (1024.0 * 1024.0), budget ? (std::to_string(budget >> 20) + " MB").c_str() : "unlimited",
+                      resident.evictedBytes / (1024.0 * 1024.0), evictions, restores);
+        std::cout << line << std::endl;
+    }
+
+private:
+    struct Buffer {
+        size_t bytes = 0;
+        GLenum usage = GL_STATIC_DRAW;
+        unsigned long long lastUsed = 0;
+        std::vector<unsigned char> host;   // the contents while evicted
+    };
+
+    struct Range {
+        size_t bytes = 0;
+        unsigned long long lastUsed = 0;
+        bool evicted = false;
+        std::function<void()> evict;
+    };
+
+    struct Texture {
+        size_t bytes = 0;
+        size_t droppedBytes = 0;           // what the dropped levels took
+        unsigned long long lastUsed = 0;
+        bool reducible = true;             // false once it is as small as it gets, until it is re-specified
+        bool streamed = false;             // its levels belong to a mip streamer
+        std::function<bool(GLuint)> reload;
+    };
+
+    size_t budget = 0;
+    unsigned long long frame = 0;
+    unsigned int reloadsThisFrame = 0;
+    unsigned int evictions = 0, restores = 0;
+    ResidencyUsage resident;
+    std::unordered_map<GLuint, Buffer> buffers;
+    std::unordered_map<size_t, Range> ranges;
+    size_t lastRangeKey = 0;
+    std::unordered_map<GLuint, Texture> textures;
+
+    ResidencyManager() {}
+
+    // GL_COPY_READ_BUFFER, so neither the bound VAO's element buffer nor GL_ARRAY_BUFFER changes
+    void evictBuffer(GLuint name, Buffer &entry)
+    {
+        if (!entry.bytes)
+            return;
+        entry.host.resize(entry.bytes);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, name);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)entry.bytes, entry.host.data());
+        glBufferData(GL_COPY_READ_BUFFER, 0, NULL, entry.usage);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, 0);
+        resident.bufferBytes -= entry.bytes;
+        resident.evictedBytes += entry.bytes;
+        evictions++;
+    }
+
+    void evictRange(Range &entry)
+    {
+        entry.evict();
+        entry.evicted = true;
+        resident.bufferBytes -= entry.bytes;
+        resident.evictedBytes += entry.bytes;
+        evictions++;
+    }
+
+    void restoreBuffer(GLuint name, Buffer &entry)
+    {
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, name);
+        glBufferData(GL_COPY_READ_BUFFER, (GLsizeiptr)entry.bytes, entry.host.data(), entry.usage);
+        GLState::Instance().BindBuffer(GL_COPY_READ_BUFFER, 0);
+        std::vector<unsigned char>().swap(entry.host);
+        resident.bufferBytes += entry.bytes;
+        resident.evictedBytes -= entry.bytes;
+        restores++;
+    }
+
+    // Re-specifies the texture without its largest levels: the remaining levels are read back and uploaded one
+    // level up, and the old smallest levels are emptied so the driver frees them.
+    void dropMipLevels(GLuint name, Texture &entry)
+    {
+        GLState::Instance().BindTexture(name);
+        GLint width = 0, height = 0, compressed = 0, internalFormat = 0, maxLevel = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        int levels = 1;
+        while (levels <= maxLevel && std::max(width, height) >> levels > 0)
+            levels++;
+        int drop = std::min(TEXTURE_DROP_LEVELS, levels - 1);
+        while (drop > 0 && std::max(width >> drop, height >> drop) < TEXTURE_MIN_SIZE)
+            drop--;
+        if (drop == 0)
+        {
+            GLState::Instance().BindTexture(0);
+            entry.reducible = false;
+            return;
+        }
+
+        std::vector<std::vector<unsigned char>> kept(levels - drop);
+        std::vector<GLint> sizes(levels - drop);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int level = drop; level < levels; level++)
+        {
+            std::vector<unsigned char> &data = kept[level - drop];
+            GLint w = std::max(width >> level, 1), h = std::max(height >> level, 1);
+            if (compressed)
+            {
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &sizes[level - drop]);
+                data.resize(sizes[level - drop]);
+                glGetCompressedTexImage(GL_TEXTURE_2D, level, data.data());
+            }
+            else
+            {
+                data.resize((size_t)w * h * 4);
+                glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+            }
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = 0; level < levels; level++)
+        {
+            GLint w = std::max(width >> (level + drop), 1), h = std::max(height >> (level + drop), 1);
+            bool keep = level < levels - drop;
+            if (compressed && keep)
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, sizes[level], kept[level].data());
+            else if (keep)
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, kept[level].data());
+            else
+                glTexImage2D(GL_TEXTURE_2D, level, compressed ? GL_RGBA : internalFormat, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - drop - 1);
+        GLState::Instance().BindTexture(0);
+
+        size_t bytes = GLTextureBytes(name);
+        resident.textureBytes -= entry.bytes - bytes;
+        resident.evictedBytes += entry.bytes - bytes;
+        entry.droppedBytes += entry.bytes - bytes;
+        entry.bytes = bytes;
+        evictions++;
+    }
+
+    void reloadTexture(GLuint name, Texture &entry)
+    {
+        // uploads that generate their mips expect the default range
+        GLint maxLevel = 0;
+        GLState::Instance().BindTexture(name);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+        GLState::Instance().BindTexture(0);
+        if (!entry.reload(name))
+        {
+            std::cout << "ERROR::RESIDENCY:: could not reload texture " << name << ", it stays reduced" << std::endl;
+            GLState::Instance().BindTexture(name);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+            GLState::Instance().BindTexture(0);
+            entry.reload = nullptr;
+            return;
+        }
+        std::function<bool(GLuint)> reload = std::move(entry.reload);
+        TrackTexture(name, std::move(reload));
+        restores++;
+    }
+};
+#endif
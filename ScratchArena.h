@@ -0,0 +1,94 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// A bump allocator for the temporary arrays of a load (packed vertices, 16-bit indices, ...). Allocate() hands out
+// uninitialized arrays from the current block; Reset() frees them all at once and, if the last round needed more
+// than one block, replaces them with a single block of the total, so a load that resets between meshes allocates
+// only until its largest mesh has been seen. Not thread-safe: one arena per thread.
+class ScratchArena
+{
+public:
+    explicit ScratchArena(size_t initialBytes = 0)
+    {
+        if (initialBytes)
+            addBlock(initialBytes);
+    }
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // count uninitialized Ts, valid until the next Reset()
+    template <typename T>
+    T* Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                      "ScratchArena never runs constructors or destructors");
+        size_t bytes = std::max<size_t>(count * sizeof(T), 1);
+        size_t offset = blocks.empty() ? 0 : (blocks.back().used + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (blocks.empty() || offset + bytes > blocks.back().size)
+        {
+            addBlock(std::max(bytes, blocks.empty() ? MIN_BLOCK : blocks.back().size * 2));
+            offset = 0;
+        }
+        blocks.back().used = offset + bytes;
+        peak = std::max(peak, inUse());
+        return reinterpret_cast<T*>(blocks.back().data.get() + offset);
+    }
+
+    void Reset()
+    {
+        if (blocks.size() > 1)
+        {
+            size_t total = inUse();
+            blocks.clear();
+            addBlock(total);
+        }
+        else if (!blocks.empty())
+            blocks.back().used = 0;
+    }
+
+    // bytes reserved from the system, and the most handed out between two resets
+    size_t CapacityBytes() const
+    {
+        size_t total = 0;
+        for (const Block &block : blocks)
+            total += block.size;
+        return total;
+    }
+    size_t PeakBytes() const { return peak; }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+        size_t used;
+    };
+
+    static const size_t MIN_BLOCK = 64 * 1024;
+
+    std::vector<Block> blocks;
+    size_t peak = 0;
+
+    // handed out since the last Reset(), alignment padding included
+    size_t inUse() const
+    {
+        size_t total = 0;
+        for (const Block &block : blocks)
+            total += block.used;
+        return total;
+    }
+
+    void addBlock(size_t bytes)
+    {
+        // new[] of unsigned char is aligned for any fundamental type (and every block starts a fresh offset)
+        blocks.push_back(Block{ std::unique_ptr<unsigned char[]>(new unsigned char[bytes]), bytes, 0 });
+    }
+};
+#endif
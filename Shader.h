@@ -4,19 +4,55 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
+#include <vector>
+#include "GLState.h"
+#include "MappedFile.h"
+#include "ProgramCache.h"
+
+// a uniform's location, resolved once with Shader::Uniform() so that setting it needs no lookup at all
+struct UniformHandle {
+    GLint location = -1;   // -1: not an active uniform of the program, setting it does nothing
+
+    bool Valid() const { return location >= 0; }
+};
+
+// uniforms looked up by name since the start (each one a hash table probe), to check the hot paths use handles
+inline size_t& UniformLookups()
+{
+    static size_t lookups = 0;
+    return lookups;
+}
+
+// The binding point of a uniform block, by block name: assigned the first time a name is seen and the same for every
+// program, so a buffer bound there once serves all of them (see UniformBlock.h)
+inline GLuint UniformBlockBinding(const std::string &name)
+{
+    static std::vector<std::string> names;
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == name)
+            return (GLuint)i;
+    names.push_back(name);
+    return (GLuint)names.size() - 1;
+}
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, or loads the program the driver built last time (see
+    // ProgramCache.h); defines are "#define" lines put right after the #version line of both stages
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string &defines = "")
     {
+        auto start = std::chrono::steady_clock::now();
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -45,98 +81,300 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
+        vertexCode = withDefines(vertexCode, defines);
+        fragmentCode = withDefines(fragmentCode, defines);
+        // 2. load the program binary cached for exactly these sources on this driver, or compile and link them
+        uint64_t sourceHash = HashBytes(vertexCode.data(), vertexCode.size());
+        sourceHash = HashBytes(fragmentCode.data(), fragmentCode.size(), sourceHash);
+        std::string cachePath = ProgramCache::PathFor(vertexPath, fragmentPath, defines);
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        bool cached = ProgramCache::Load(cachePath, sourceHash, ID);
+        if (!cached && compileAndLink(vertexCode.c_str(), fragmentCode.c_str()))
+            ProgramCache::Store(cachePath, sourceHash, ID);
+        // 3. find every active uniform once, so setting one by name never asks the driver, and point the uniform
+        // blocks at their shared bindings
+        reflectUniforms();
+        bindUniformBlocks();
 
+        char line[256];
+        std::snprintf(line, sizeof(line), "SHADER:: %s + %s %s in %.1fms", vertexPath, fragmentPath,
+                      cached ? "loaded from the program cache" : "compiled and linked",
+                      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::cout << line << std::endl;
     }
     
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        GLState::Instance().UseProgram(ID); 
+    }
+    // resolves a uniform for the handle setters below; "lights[2].color" style names address array elements
+    // ------------------------------------------------------------------------
+    UniformHandle Uniform(const std::string &name) const
+    {
+        UniformHandle handle;
+        handle.location = location(name);
+        return handle;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
+    // the same through handles: no string, no lookup
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
+    }
+    void setInt(UniformHandle uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
+    }
+    void setFloat(UniformHandle uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
+    }
+    void setVec2(UniformHandle uniform, const glm::vec2 &value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
+    }
+    void setVec2(UniformHandle uniform, float x, float y) const
+    {
+        glUniform2f(uniform.location, x, y);
+    }
+    void setVec3(UniformHandle uniform, const glm::vec3 &value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
+    }
+    void setVec3(UniformHandle uniform, float x, float y, float z) const
+    {
+        glUniform3f(uniform.location, x, y, z);
+    }
+    void setVec4(UniformHandle uniform, const glm::vec4 &value) const
+    {
+        glUniform4fv(uniform.location, 1, &value[0]);
+    }
+    void setVec4(UniformHandle uniform, float x, float y, float z, float w) const
+    {
+        glUniform4f(uniform.location, x, y, z, w);
+    }
+    void setMat2(UniformHandle uniform, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformHandle uniform, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformHandle uniform, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // the active uniforms by name: open addressing with linear probing, in a power of two table at most half full
+    struct UniformSlot {
+        uint64_t hash = 0;
+        std::string name;   // empty: free slot
+        GLint location = -1;
+    };
+    std::vector<UniformSlot> uniforms;
+
+    static uint64_t hashName(const std::string &name)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name)
+            hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+        return hash;
+    }
+
+    // -1 for names that are not active uniforms, which GL ignores when set
+    GLint location(const std::string &name) const
+    {
+        UniformLookups()++;
+        if (uniforms.empty())
+            return -1;
+        uint64_t hash = hashName(name);
+        size_t mask = uniforms.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+            const UniformSlot &slot = uniforms[i];
+            if (slot.name.empty())
+                return -1;
+            if (slot.hash == hash && slot.name == name)
+                return slot.location;
+        }
+    }
+
+    void addUniform(const std::string &name, GLint location)
+    {
+        uint64_t hash = hashName(name);
+        size_t mask = uniforms.size() - 1;
+        size_t i = hash & mask;
+        while (!uniforms[i].name.empty() && uniforms[i].name != name)
+            i = (i + 1) & mask;
+        uniforms[i].hash = hash;
+        uniforms[i].name = name;
+        uniforms[i].location = location;
+    }
+
+    void bindUniformBlocks()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID, (GLuint)i, (GLsizei)buffer.size(), &length, buffer.data());
+            glUniformBlockBinding(ID, (GLuint)i, UniformBlockBinding(std::string(buffer.data(), length)));
+        }
+    }
+
+    // fills the table from glGetActiveUniform; arrays of plain types are listed once as "name[0]", so the bare name
+    // and each element are added for them
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<std::pair<std::string, GLint>> found;
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue;   // in a uniform block
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                found.push_back(std::make_pair(base, location));
+                for (GLint element = 0; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    found.push_back(std::make_pair(elementName, glGetUniformLocation(ID, elementName.c_str())));
+                }
+            }
+            else
+                found.push_back(std::make_pair(name, location));
+        }
+        size_t capacity = 16;
+        while (capacity < found.size() * 2)
+            capacity *= 2;
+        uniforms.assign(capacity, UniformSlot());
+        for (const auto &uniform : found)
+            addUniform(uniform.first, uniform.second);
+    }
+
+    // compiles both stages and links them into ID, keeping the binary retrievable for the program cache
+    // ------------------------------------------------------------------------
+    bool compileAndLink(const char *vShaderCode, const char *fShaderCode)
+    {
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        if (ProgramCache::Supported())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // code with the defines inserted after its #version line, which has to stay the first
+    static std::string withDefines(const std::string &code, const std::string &defines)
+    {
+        if (defines.empty())
+            return code;
+        std::string block = defines.back() == '\n' ? defines : defines + "\n";
+        size_t version = code.find("#version");
+        if (version == std::string::npos)
+            return block + code;
+        size_t lineEnd = code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return code + "\n" + block;
+        return code.substr(0, lineEnd + 1) + block + code.substr(lineEnd + 1);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,285 @@
+#ifndef TANGENTSPACE_H
+#define TANGENTSPACE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ThreadPool.h"
+#include "VertexLayout.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TANGENT_SPACE_SSE
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define TANGENT_SPACE_NEON
+#endif
+
+// Smooth normals and tangents of imported meshes, in place of ASSIMP's GenSmoothNormals and CalcTangentSpace steps
+// (which run single threaded inside ReadFile, on every mesh, whether or not anything uses the result). Both work in
+// three data-parallel passes over the thread pool: per-triangle vectors, then one sum per group of vertices that
+// should share the result (same position for normals; same position, normal and texture coordinate for tangents),
+// accumulated four floats at a time with SSE or NEON, then the result written back to every vertex of the group.
+//
+// Tangents follow MikkTSpace's construction: the face tangent and bitangent are projected onto each corner's normal,
+// normalized and weighted by the corner's angle before they are summed, and the bitangent is rebuilt as
+// cross(normal, tangent) with the handedness of the sum, so mirrored UV islands keep their sign.
+
+const size_t TANGENT_SPACE_BLOCK = 4096;    // triangles or groups per task
+
+// runs body(begin, end) over [0, count) in blocks, on the pool if there is one
+inline void tangentSpaceBlocks(size_t count, ThreadPool *pool, const std::function<void(size_t, size_t)> &body)
+{
+    size_t blocks = (count + TANGENT_SPACE_BLOCK - 1) / TANGENT_SPACE_BLOCK;
+    auto run = [&](size_t block) { body(block * TANGENT_SPACE_BLOCK, std::min(count, (block + 1) * TANGENT_SPACE_BLOCK)); };
+    if (pool && blocks > 1)
+        pool->ParallelFor(blocks, run);
+    else
+        for (size_t block = 0; block < blocks; block++)
+            run(block);
+}
+
+// sum of the vectors (x, y, z, unused) at the given items of values
+inline glm::vec3 tangentSpaceSum(const glm::vec4 *values, const unsigned int *items, size_t count)
+{
+#if defined(TANGENT_SPACE_SSE)
+    __m128 sum = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i++)
+        sum = _mm_add_ps(sum, _mm_loadu_ps(&values[items[i]].x));
+    float out[4];
+    _mm_storeu_ps(out, sum);
+    return glm::vec3(out[0], out[1], out[2]);
+#elif defined(TANGENT_SPACE_NEON)
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < count; i++)
+        sum = vaddq_f32(sum, vld1q_f32(&values[items[i]].x));
+    return glm::vec3(vgetq_lane_f32(sum, 0), vgetq_lane_f32(sum, 1), vgetq_lane_f32(sum, 2));
+#else
+    glm::vec4 sum(0.0f);
+    for (size_t i = 0; i < count; i++)
+        sum += values[items[i]];
+    return glm::vec3(sum);
+#endif
+}
+
+// Groups the vertices whose keys (N floats taken by key(vertex, out)) are identical, -0 and 0 alike, and lists the
+// triangle corners of each group: corners[offsets[g], offsets[g + 1]) are the corners (3 * triangle + k) on vertices
+// of group g. Returns the group of every vertex. The keys are hashed in parallel and split by hash into shards, each
+// deduplicated by its own task with open addressing; groups are numbered shard by shard, in vertex order within one.
+template <size_t N, typename Key>
+inline std::vector<unsigned int> groupCorners(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, Key key,
+                                              ThreadPool *pool, std::vector<unsigned int> &offsets, std::vector<unsigned int> &corners)
+{
+    const unsigned int shardBits = 6, shardCount = 1u << shardBits;
+    size_t vertexCount = vertices.size();
+    std::vector<std::array<float, N>> keys(vertexCount);
+    std::vector<uint64_t> hashes(vertexCount);
+    tangentSpaceBlocks(vertexCount, pool, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            key(vertices[i], keys[i].data());
+            uint64_t hash = 0;
+            for (float &value : keys[i])
+            {
+                value += 0.0f;
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                hash = (hash ^ bits) * 0x9E3779B97F4A7C15ULL;
+                hash ^= hash >> 29;
+            }
+            hashes[i] = hash;
+        }
+    });
+
+    // vertices by shard, in vertex order
+    std::vector<unsigned int> shardOffsets(shardCount + 1, 0), byShard(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        shardOffsets[(hashes[i] >> (64 - shardBits)) + 1]++;
+    for (unsigned int s = 0; s < shardCount; s++)
+        shardOffsets[s + 1] += shardOffsets[s];
+    std::vector<unsigned int> fill(shardOffsets.begin(), shardOffsets.end() - 1);
+    for (size_t i = 0; i < vertexCount; i++)
+        byShard[fill[hashes[i] >> (64 - shardBits)]++] = (unsigned int)i;
+
+    std::vector<unsigned int> group(vertexCount), shardGroups(shardCount + 1, 0);
+    auto deduplicate = [&](size_t s) {
+        size_t count = shardOffsets[s + 1] - shardOffsets[s];
+        size_t capacity = 16;
+        while (capacity < count * 2)
+            capacity *= 2;
+        std::vector<unsigned int> table(capacity, ~0u);   // first vertex of each group
+        unsigned int groups = 0;
+        for (size_t k = shardOffsets[s]; k < shardOffsets[s + 1]; k++)
+        {
+            unsigned int i = byShard[k];
+            for (size_t slot = hashes[i] & (capacity - 1);; slot = (slot + 1) & (capacity - 1))
+            {
+                unsigned int other = table[slot];
+                if (other == ~0u)
+                {
+                    table[slot] = i;
+                    group[i] = groups++;
+                    break;
+                }
+                if (hashes[other] == hashes[i] && keys[other] == keys[i])
+                {
+                    group[i] = group[other];
+                    break;
+                }
+            }
+        }
+        shardGroups[s + 1] = groups;
+    };
+    if (pool)
+        pool->ParallelFor(shardCount, deduplicate);
+    else
+        for (size_t s = 0; s < shardCount; s++)
+            deduplicate(s);
+    for (unsigned int s = 0; s < shardCount; s++)
+        shardGroups[s + 1] += shardGroups[s];
+    tangentSpaceBlocks(vertexCount, pool, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            group[i] += shardGroups[hashes[i] >> (64 - shardBits)];
+    });
+
+    size_t groupCount = shardGroups[shardCount];
+    offsets.assign(groupCount + 1, 0);
+    for (unsigned int index : indices)
+        offsets[group[index] + 1]++;
+    for (size_t g = 0; g < groupCount; g++)
+        offsets[g + 1] += offsets[g];
+    corners.resize(indices.size());
+    std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+    for (size_t c = 0; c < indices.size(); c++)
+        corners[next[group[indices[c]]]++] = (unsigned int)c;
+    return group;
+}
+
+// Gives every vertex the normalized sum of the normals of the triangles around its position, like GenSmoothNormals
+// (without its angle limit, which defaults to 175 degrees anyway).
+inline void GenerateSmoothNormals(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, ThreadPool *pool = nullptr)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // one normal per corner (the face normal), so the sums below index them by corner
+    std::vector<glm::vec4> cornerNormals(triangleCount * 3);
+    tangentSpaceBlocks(triangleCount, pool, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position, &p1 = vertices[indices[t * 3 + 1]].Position,
+                            &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            glm::vec4 normal = length > 0.0f ? glm::vec4(n / length, 0.0f) : glm::vec4(0.0f);
+            cornerNormals[t * 3] = cornerNormals[t * 3 + 1] = cornerNormals[t * 3 + 2] = normal;
+        }
+    });
+
+    std::vector<unsigned int> offsets, corners;
+    std::vector<unsigned int> group = groupCorners<3>(vertices, indices, [](const Vertex &v, float *key) {
+        key[0] = v.Position.x; key[1] = v.Position.y; key[2] = v.Position.z;
+    }, pool, offsets, corners);
+
+    size_t groupCount = offsets.size() - 1;
+    std::vector<glm::vec3> normals(groupCount);
+    tangentSpaceBlocks(groupCount, pool, [&](size_t begin, size_t end) {
+        for (size_t g = begin; g < end; g++)
+        {
+            glm::vec3 sum = tangentSpaceSum(cornerNormals.data(), &corners[offsets[g]], offsets[g + 1] - offsets[g]);
+            float length = glm::length(sum);
+            normals[g] = length > 0.0f ? sum / length : sum;
+        }
+    });
+    tangentSpaceBlocks(vertices.size(), pool, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+            vertices[v].Normal = normals[group[v]];
+    });
+}
+
+// Tangents and bitangents from the normals and texture coordinates, see the top of the file. Vertices no triangle
+// gives a usable direction (degenerate UVs) get an arbitrary frame around their normal.
+inline void GenerateTangents(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, ThreadPool *pool = nullptr)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<glm::vec4> cornerTangents(triangleCount * 3), cornerBitangents(triangleCount * 3);
+    tangentSpaceBlocks(triangleCount, pool, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+        {
+            const Vertex *v[3] = { &vertices[indices[t * 3]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]] };
+            glm::vec3 e1 = v[1]->Position - v[0]->Position, e2 = v[2]->Position - v[0]->Position;
+            glm::vec2 d1 = v[1]->TexCoords - v[0]->TexCoords, d2 = v[2]->TexCoords - v[0]->TexCoords;
+            float area = d1.x * d2.y - d2.x * d1.y;
+            glm::vec3 tangent(0.0f), bitangent(0.0f);
+            if (area != 0.0f)
+            {
+                // the orientation of the UVs flips with the sign of area, so the bitangent does too
+                tangent = (e1 * d2.y - e2 * d1.y) / area;
+                bitangent = (e2 * d1.x - e1 * d2.x) / area;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                const glm::vec3 &n = v[k]->Normal;
+                glm::vec3 a = v[(k + 1) % 3]->Position - v[k]->Position, b = v[(k + 2) % 3]->Position - v[k]->Position;
+                float lengths = glm::length(a) * glm::length(b);
+                float angle = lengths > 0.0f ? std::acos(std::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f)) : 0.0f;
+                glm::vec3 projectedTangent = tangent - n * glm::dot(n, tangent);
+                glm::vec3 projectedBitangent = bitangent - n * glm::dot(n, bitangent);
+                float tangentLength = glm::length(projectedTangent), bitangentLength = glm::length(projectedBitangent);
+                cornerTangents[t * 3 + k] = tangentLength > 0.0f ? glm::vec4(projectedTangent * (angle / tangentLength), 0.0f) : glm::vec4(0.0f);
+                cornerBitangents[t * 3 + k] = bitangentLength > 0.0f ? glm::vec4(projectedBitangent * (angle / bitangentLength), 0.0f) : glm::vec4(0.0f);
+            }
+        }
+    });
+
+    std::vector<unsigned int> offsets, corners;
+    std::vector<unsigned int> group = groupCorners<8>(vertices, indices, [](const Vertex &v, float *key) {
+        key[0] = v.Position.x; key[1] = v.Position.y; key[2] = v.Position.z;
+        key[3] = v.Normal.x; key[4] = v.Normal.y; key[5] = v.Normal.z;
+        key[6] = v.TexCoords.x; key[7] = v.TexCoords.y;
+    }, pool, offsets, corners);
+
+    size_t groupCount = offsets.size() - 1;
+    std::vector<glm::vec3> tangents(groupCount, glm::vec3(0.0f)), bitangents(groupCount, glm::vec3(0.0f));
+    tangentSpaceBlocks(groupCount, pool, [&](size_t begin, size_t end) {
+        for (size_t g = begin; g < end; g++)
+        {
+            const unsigned int *items = &corners[offsets[g]];
+            size_t count = offsets[g + 1] - offsets[g];
+            if (count == 0)
+                continue;
+            glm::vec3 n = vertices[indices[items[0]]].Normal;
+            glm::vec3 tangent = tangentSpaceSum(cornerTangents.data(), items, count);
+            glm::vec3 bitangent = tangentSpaceSum(cornerBitangents.data(), items, count);
+            tangent -= n * glm::dot(n, tangent);
+            float length = glm::length(tangent);
+            if (length <= 1e-20f)
+            {
+                // any direction perpendicular to the normal
+                glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                tangent = axis - n * glm::dot(n, axis);
+                length = glm::length(tangent);
+            }
+            tangents[g] = length > 0.0f ? tangent / length : tangent;
+            glm::vec3 rebuilt = glm::cross(n, tangents[g]);
+            bitangents[g] = glm::dot(rebuilt, bitangent) < 0.0f ? -rebuilt : rebuilt;
+        }
+    });
+    tangentSpaceBlocks(vertices.size(), pool, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+        {
+            vertices[v].Tangent = tangents[group[v]];
+            vertices[v].Bitangent = bitangents[group[v]];
+        }
+    });
+}
+#endif
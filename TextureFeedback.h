@@ -0,0 +1,42 @@
+#ifndef TEXTURE_FEEDBACK_H
+#define TEXTURE_FEEDBACK_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+// The texture detail a frame's draws needed, for mip streaming (see TextureStreamer.h): every draw reports, for each
+// of its textures, how many texels per UV unit it would take to have one texel per pixel, and the largest request
+// per texture wins. Collected only while a streamer listens. GL thread only.
+class TextureFeedback
+{
+public:
+    // the draw could not tell (no view, or no UV density): full resolution
+    static constexpr float FULL_DETAIL = 1e30f;
+
+    bool listening = false;
+
+    void Want(GLuint texture, float texelsPerUv)
+    {
+        float &wanted = requests[texture];
+        wanted = std::max(wanted, texelsPerUv);
+    }
+
+    // hands over the requests made since the last call
+    void Take(std::unordered_map<GLuint, float> &out)
+    {
+        out.clear();
+        out.swap(requests);
+    }
+
+private:
+    std::unordered_map<GLuint, float> requests;
+};
+
+inline TextureFeedback& MipFeedback()
+{
+    static TextureFeedback feedback;
+    return feedback;
+}
+#endif
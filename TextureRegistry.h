@@ -0,0 +1,154 @@
+#ifndef TEXTUREREGISTRY_H
+#define TEXTUREREGISTRY_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "GLState.h"
+#include "Residency.h"
+
+// Process-wide registry of loaded textures, shared by every Model. A texture is found by its canonical path first
+// and, failing that, by a hash of its file contents, so the same image referenced by different models or through
+// different relative paths is only loaded once. Entries are reference counted and the GL texture is deleted when
+// the last holder releases it.
+class TextureRegistry
+{
+public:
+    static TextureRegistry& Instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // returns the texture for directory/path, calling load() to create it if no holder has it yet.
+    // GL thread only.
+    unsigned int Acquire(const std::string &path, const std::string &directory, const std::function<unsigned int()> &load)
+    {
+        std::string key = canonical(directory + '/' + path);
+        std::unique_lock<std::mutex> lock(mutex);
+        lookups++;
+        auto byPath = paths.find(key);
+        if (byPath != paths.end())
+        {
+            pathHits++;
+            return addReference(byPath->second);
+        }
+        lock.unlock();
+
+        // same image under another name? hashing is only paid the first time a path is seen
+        uint64_t hash = contentHash(key);
+        lock.lock();
+        auto byContent = hash ? contents.find(hash) : contents.end();
+        if (byContent != contents.end())
+        {
+            contentHits++;
+            paths[key] = byContent->second;
+            return addReference(byContent->second);
+        }
+        lock.unlock();
+
+        unsigned int id = load();
+        ResidencyManager::Instance().TrackTexture(id);
+        lock.lock();
+        Entry &entry = entries[id];
+        entry.key = key;
+        entry.hash = hash;
+        entry.references = 1;
+        paths[key] = id;
+        if (hash)
+            contents[hash] = id;
+        return id;
+    }
+
+    // drops one reference; the texture is deleted when none are left
+    void Release(unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(id);
+        if (it == entries.end() || --it->second.references > 0)
+            return;
+        for (auto p = paths.begin(); p != paths.end(); )
+            p = p->second == id ? paths.erase(p) : std::next(p);
+        if (it->second.hash)
+            contents.erase(it->second.hash);
+        entries.erase(it);
+        ResidencyManager::Instance().ForgetTexture(id);
+        // at shutdown the context may already be gone, and the driver frees everything anyway
+        if (glfwGetCurrentContext())
+            GLState::Instance().DeleteTextures(1, &id);
+    }
+
+    // whether directory/path is already loaded (safe to call from worker threads)
+    bool Contains(const std::string &path, const std::string &directory)
+    {
+        std::string key = canonical(directory + '/' + path);
+        std::lock_guard<std::mutex> lock(mutex);
+        return paths.count(key) != 0;
+    }
+
+    // hit rate and the GPU memory the hits avoided; GL thread only
+    void Report()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t resident = 0, saved = 0;
+        for (auto &it : entries)
+        {
+            size_t bytes = GLTextureBytes(it.first);
+            resident += bytes;
+            saved += bytes * (it.second.acquisitions - 1);
+        }
+        unsigned int hits = pathHits + contentHits;
+        char line[200];
+        std::snprintf(line, sizeof(line), "TEXTURE REGISTRY:: %zu textures, %u lookups, %u hits (%u by path, %u by content, %.0f%%), %.1f MB resident, %.1f MB saved",
+                      entries.size(), lookups, hits, pathHits, contentHits, lookups ? 100.0 * hits / lookups : 0.0,
+                      resident / (1024.0 * 1024.0), saved / (1024.0 * 1024.0));
+        std::cout << line << std::endl;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t hash = 0;
+        int references = 0;
+        unsigned int acquisitions = 1;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<unsigned int, Entry> entries;     // by texture name
+    std::unordered_map<std::string, unsigned int> paths; // canonical path -> texture name
+    std::unordered_map<uint64_t, unsigned int> contents; // content hash -> texture name
+    unsigned int lookups = 0, pathHits = 0, contentHits = 0;
+
+    TextureRegistry() {}
+
+    unsigned int addReference(unsigned int id)
+    {
+        Entry &entry = entries[id];
+        entry.references++;
+        entry.acquisitions++;
+        return id;
+    }
+
+    static std::string canonical(const std::string &path)
+    {
+        std::error_code error;
+        std::filesystem::path resolved = std::filesystem::weakly_canonical(path, error);
+        return error ? path : resolved.string();
+    }
+
+    static uint64_t contentHash(const std::string &path)
+    {
+        MappedFile file(path);
+        return file.IsOpen() ? HashBytes(file.Data(), file.Size()) : 0;
+    }
+};
+#endif
@@ -0,0 +1,446 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CompressedTexture.h"
+#include "GLState.h"
+#include "Image.h"
+#include "Residency.h"
+#include "TextureFeedback.h"
+#include "ThreadPool.h"
+
+// GL pixel format for an image with the given number of channels
+inline GLenum TextureFormat(int components)
+{
+    if (components == 3)
+        return GL_RGB;
+    else if (components == 4)
+        return GL_RGBA;
+    return GL_RED;
+}
+
+// Streams textures in the background: Request() hands out a texture that holds a 1x1 placeholder, the image is
+// mapped from its baked .ktx2 or decoded (and baked) on worker threads, and Update() (once per frame, on the GL
+// thread) copies the data into pixel buffer objects and re-specifies the texture from them. The texture name never changes, so meshes pick up the real image
+// as soon as it lands. Each Update() copies at most uploadBudget bytes and finishes at most maxCompletions textures,
+// so a big image is spread over several frames instead of causing a hitch.
+//
+// Baked textures also stream their mip levels: only the levels up to mipStartSize are uploaded at first, and the
+// draws of each frame report how much detail they need (TextureFeedback.h, from the meshes' texel density and
+// distance). Update() then brings in the next finer level, one at a time through the same upload budget and only
+// while the residency budget has room, and drops the finest level of a texture that has not needed it for
+// MIP_EVICT_FRAMES frames. The resident range is selected with GL_TEXTURE_BASE_LEVEL (GL 3.3 has no sparse textures,
+// and immutable storage would allocate every level up front); the file stays mapped while the texture streams.
+class TextureStreamer
+{
+public:
+    static const unsigned int MIP_EVICT_FRAMES = 120;
+
+    // largest level uploaded when a baked texture first lands; 0 uploads every level. Set before the first Request().
+    int mipStartSize = 128;
+
+    explicit TextureStreamer(size_t uploadBudget = 4 << 20, unsigned int maxCompletions = 2, unsigned int threadCount = 2)
+        : uploadBudget(uploadBudget), maxCompletions(maxCompletions), pool(threadCount)
+    {
+    }
+
+    ~TextureStreamer()
+    {
+        MipFeedback().listening = false;
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // returns a texture showing a placeholder until directory/path has been decoded and uploaded; normalMap picks
+    // BC5 should it be baked
+    unsigned int Request(const char *path, const std::string &directory, bool normalMap = false)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLState::Instance().BindTexture(textureID);
+        const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLState::Instance().BindTexture(0);
+
+        if (pending == 0)
+        {
+            streamStart = std::chrono::steady_clock::now();
+            streamedCount = 0;
+            streamedBytes = 0;
+            worstUpdateMs = 0.0;
+        }
+        pending++;
+
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->texture = textureID;
+        job->path = path;
+        job->normalMap = normalMap;
+        ThreadPool *workers = &pool;
+        int startSize = mipStartSize;
+        pool.Submit([this, job, directory, workers, startSize] {
+            if (OpenCompressedTexture(job->path.c_str(), directory, job->compressed))
+            {
+                // the finest level to start with: the first one that fits the start size
+                const std::vector<CompressedImage::Level> &levels = job->compressed.levels;
+                job->lastLevel = (int)levels.size() - 1;
+                while (startSize > 0 && job->firstLevel < job->lastLevel &&
+                       std::max(levels[job->firstLevel].width, levels[job->firstLevel].height) > startSize)
+                    job->firstLevel++;
+            }
+            else
+            {
+                job->image = DecodeTexture(job->path.c_str(), directory);
+                BakeCompressedTextureIfStale(job->path.c_str(), directory, job->image, job->normalMap, workers);
+            }
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.push_back(job);
+        });
+        return textureID;
+    }
+
+    // moves decoded images, and the mip levels the last frame's draws wanted, towards the GPU; call once per frame
+    // on the GL thread
+    void Update()
+    {
+        if (pending == 0 && mipTextures.empty())
+            return;
+        bool wasPending = pending > 0;
+        auto start = std::chrono::steady_clock::now();
+        updateMips();
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            while (!ready.empty())
+            {
+                uploading.push_back(ready.front());
+                ready.pop_front();
+            }
+        }
+
+        size_t budget = uploadBudget;
+        unsigned int completions = 0;
+        for (auto it = uploading.begin(); it != uploading.end(); )
+        {
+            Job &job = **it;
+            if (!job.Payload())
+            {
+                std::cout << "Texture failed to load at path: " << job.path << std::endl;
+                pending--;
+                it = uploading.erase(it);
+                continue;
+            }
+            size_t bytes = job.PayloadBytes();
+            if (job.copied < bytes && budget > 0)
+            {
+                if (!job.pbo)
+                    job.pbo = acquirePbo(bytes);
+                size_t chunk = std::min(bytes - job.copied, budget);
+                GLState::Instance().BindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+                void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, job.copied, chunk, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                if (dst)
+                {
+                    std::memcpy(dst, job.Payload() + job.copied, chunk);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                    job.copied += chunk;
+                    budget -= chunk;
+                }
+                else
+                    budget = 0; // mapping failed, try again next frame
+            }
+            if (job.copied == bytes && completions < maxCompletions)
+            {
+                finish(job);
+                completions++;
+                if (job.source)
+                {
+                    mipLevelsStreamed++;
+                    mipBytesStreamed += bytes;
+                }
+                else
+                {
+                    pending--;
+                    streamedCount++;
+                    streamedBytes += bytes;
+                }
+                it = uploading.erase(it);
+                continue;
+            }
+            if (budget == 0 && completions == maxCompletions)
+                break;
+            ++it;
+        }
+        GLState::Instance().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (!wasPending)
+            return;
+        worstUpdateMs = std::max(worstUpdateMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (pending == 0)
+        {
+            double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streamStart).count();
+            char line[160];
+            std::snprintf(line, sizeof(line), "TEXTURE STREAMING:: %u textures (%.1f MB) streamed in %.1fms, worst frame %.2fms",
+                          streamedCount, streamedBytes / (1024.0 * 1024.0), totalMs, worstUpdateMs);
+            std::cout << line << std::endl;
+        }
+    }
+
+    // number of requested textures that still show their placeholder
+    unsigned int Pending() const { return pending; }
+
+    // what the streamed mips hold now against all of their levels
+    void ReportMips() const
+    {
+        size_t resident = 0, full = 0;
+        for (auto &it : mipTextures)
+        {
+            const CompressedImage &image = it.second.image;
+            for (size_t level = 0; level < image.levels.size(); level++)
+            {
+                full += image.levels[level].size;
+                if ((int)level >= it.second.residentLevel)
+                    resident += image.levels[level].size;
+            }
+        }
+        char line[256];
+        std::snprintf(line, sizeof(line), "MIP STREAMING:: %zu textures, %.1f MB resident of %.1f MB at full residency (%.0f%%); %u levels streamed in (%.1f MB), %u dropped",
+                      mipTextures.size(), resident / (1024.0 * 1024.0), full / (1024.0 * 1024.0), full ? 100.0 * resident / full : 100.0,
+                      mipLevelsStreamed, mipBytesStreamed / (1024.0 * 1024.0), mipLevelsDropped);
+        std::cout << line << std::endl;
+    }
+
+private:
+    struct Job {
+        unsigned int texture = 0;
+        std::string path;
+        bool normalMap = false;
+        DecodedImage image;         // either decoded pixels...
+        CompressedImage compressed; // ...or a mapped .ktx2, whose levels firstLevel..lastLevel are copied as one contiguous block
+        const CompressedImage *source = nullptr; // a streamed texture's image, for a job that adds a finer level
+        int firstLevel = 0;
+        int lastLevel = 0;
+        size_t copied = 0;
+        GLuint pbo = 0;
+
+        const CompressedImage& Compressed() const { return source ? *source : compressed; }
+
+        const unsigned char* Payload() const
+        {
+            if (Compressed().Valid())
+                return Compressed().LevelData(lastLevel);
+            return image.pixels.get();
+        }
+        size_t PayloadBytes() const
+        {
+            const CompressedImage &levels = Compressed();
+            if (levels.Valid())
+                return levels.levels[firstLevel].offset + levels.levels[firstLevel].size - levels.levels[lastLevel].offset;
+            return image.Bytes();
+        }
+    };
+
+    // a baked texture whose finer levels stream in and out
+    struct MipTexture {
+        CompressedImage image;
+        std::string path;
+        int startLevel = 0;            // never dropped below
+        int residentLevel = 0;         // the finest level uploaded (the texture's base level)
+        unsigned int idleFrames = 0;   // frames in a row that did not need the finest level
+        bool loading = false;          // a finer level is on its way
+    };
+
+    size_t uploadBudget;
+    unsigned int maxCompletions;
+
+    std::mutex readyMutex;
+    std::deque<std::shared_ptr<Job>> ready;      // decoded by a worker, not yet seen by Update()
+    std::deque<std::shared_ptr<Job>> uploading;  // GL thread only
+    std::vector<GLuint> freePbos;
+    unsigned int pending = 0;
+    std::unordered_map<GLuint, MipTexture> mipTextures;  // by texture name; nodes stay put, jobs point at the images
+    std::unordered_map<GLuint, float> wanted;            // this frame's feedback
+    unsigned int mipLevelsStreamed = 0, mipLevelsDropped = 0;
+    size_t mipBytesStreamed = 0;
+
+    std::chrono::steady_clock::time_point streamStart;
+    unsigned int streamedCount = 0;
+    size_t streamedBytes = 0;
+    double worstUpdateMs = 0.0;
+
+    // declared last so the workers are joined before anything they touch is destroyed
+    ThreadPool pool;
+
+    // returns a pixel buffer with fresh storage of the given size (orphaning whatever it held before)
+    GLuint acquirePbo(size_t bytes)
+    {
+        GLuint pbo;
+        if (freePbos.empty())
+            glGenBuffers(1, &pbo);
+        else
+        {
+            pbo = freePbos.back();
+            freePbos.pop_back();
+        }
+        GLState::Instance().BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        return pbo;
+    }
+
+    // replaces the placeholder with the image now sitting in the job's pixel buffer
+    void finish(Job &job)
+    {
+        GLState::Instance().BindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+        GLState::Instance().BindTexture(job.texture);
+        if (job.Compressed().Valid())
+        {
+            // baked mip chain: the levels come from the buffer, no mip generation needed
+            const CompressedImage &image = job.Compressed();
+            size_t base = image.levels[job.lastLevel].offset;
+            for (int i = job.firstLevel; i <= job.lastLevel; i++)
+            {
+                const CompressedImage::Level &level = image.levels[i];
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, GLFormatFor(image.format), level.width, level.height, 0, (GLsizei)level.size, (void*)(level.offset - base));
+            }
+            if (!job.source)
+                SetCompressedTextureParameters(image);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.firstLevel);
+        }
+        else
+        {
+            GLenum format = TextureFormat(job.image.components);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, job.image.width, job.image.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        GLState::Instance().BindTexture(0);
+        freePbos.push_back(job.pbo);
+        job.pbo = 0;
+        job.image.pixels.reset();
+
+        if (job.source)
+        {
+            MipTexture &mip = mipTextures[job.texture];
+            mip.residentLevel = job.firstLevel;
+            mip.loading = false;
+        }
+        else if (job.firstLevel > 0)
+        {
+            // the finer levels come later: keep the image mapped
+            MipTexture &mip = mipTextures[job.texture];
+            cancelJobs(&mip.image); // the name's previous texture, if it was streaming too
+            mip.image = std::move(job.compressed);
+            mip.path = job.path;
+            mip.startLevel = mip.residentLevel = job.firstLevel;
+            mip.idleFrames = 0;
+            mip.loading = false;
+            ResidencyManager::Instance().StreamTexture(job.texture);
+        }
+        job.compressed.file.Close();
+        ResidencyManager::Instance().UpdateTexture(job.texture);
+    }
+
+    // the level whose texel density first reaches what the draws asked for
+    static int wantedLevel(const CompressedImage &image, float texelsPerUv)
+    {
+        int coarsest = (int)image.levels.size() - 1;
+        if (texelsPerUv <= 0.0f)
+            return coarsest;
+        float texels = (float)std::max(image.width, image.height);
+        int level = (int)std::floor(std::log2(texels / texelsPerUv));
+        return std::max(0, std::min(level, coarsest));
+    }
+
+    // compares the resident levels with last frame's feedback: queues the next finer level of textures that need
+    // more detail, drops the finest level of those that have not needed it for a while
+    void updateMips()
+    {
+        MipFeedback().Take(wanted);
+        ResidencyManager &residency = ResidencyManager::Instance();
+        for (auto it = mipTextures.begin(); it != mipTextures.end(); )
+        {
+            GLuint name = it->first;
+            MipTexture &mip = it->second;
+            // deleted (and maybe its name reused) since: forget it and anything still in flight for it
+            if (!residency.IsStreamedTexture(name))
+            {
+                cancelJobs(&mip.image);
+                it = mipTextures.erase(it);
+                continue;
+            }
+            auto request = wanted.find(name);
+            int level = request != wanted.end() ? wantedLevel(mip.image, request->second) : mip.startLevel;
+            if (level < mip.residentLevel)
+            {
+                mip.idleFrames = 0;
+                size_t bytes = mip.image.levels[mip.residentLevel - 1].size;
+                if (!mip.loading && (!residency.Budget() || residency.Total().ResidentBytes() + bytes <= residency.Budget()))
+                {
+                    std::shared_ptr<Job> job = std::make_shared<Job>();
+                    job->texture = name;
+                    job->path = mip.path;
+                    job->source = &mip.image;
+                    job->firstLevel = job->lastLevel = mip.residentLevel - 1;
+                    mip.loading = true;
+                    uploading.push_back(job);
+                }
+            }
+            else if (level > mip.residentLevel && mip.residentLevel < mip.startLevel && !mip.loading)
+            {
+                if (++mip.idleFrames >= MIP_EVICT_FRAMES)
+                {
+                    dropLevel(name, mip);
+                    mip.idleFrames = 0;
+                }
+            }
+            else
+                mip.idleFrames = 0;
+            ++it;
+        }
+        MipFeedback().listening = !mipTextures.empty();
+    }
+
+    // moves the base level one step coarser and empties the old one so the driver frees it
+    void dropLevel(GLuint name, MipTexture &mip)
+    {
+        GLState::Instance().BindTexture(name);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, mip.residentLevel + 1);
+        glTexImage2D(GL_TEXTURE_2D, mip.residentLevel, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        GLState::Instance().BindTexture(0);
+        mip.residentLevel++;
+        mipLevelsDropped++;
+        ResidencyManager::Instance().UpdateTexture(name);
+    }
+
+    void cancelJobs(const CompressedImage *source)
+    {
+        for (auto it = uploading.begin(); it != uploading.end(); )
+        {
+            if ((*it)->source != source)
+            {
+                ++it;
+                continue;
+            }
+            if ((*it)->pbo)
+                freePbos.push_back((*it)->pbo);
+            it = uploading.erase(it);
+        }
+    }
+};
+#endif
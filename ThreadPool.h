@@ -0,0 +1,130 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads consuming a FIFO task queue. Nothing in here touches OpenGL, so tasks must only do
+// CPU work; GL calls stay on the thread that owns the context.
+class ThreadPool
+{
+public:
+    // threadCount 0 means one worker per hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int Size() const { return (unsigned int)workers.size(); }
+
+    // queues a task and returns a future for its result
+    template<typename F>
+    auto Submit(F task) -> std::future<decltype(task())>
+    {
+        typedef decltype(task()) Result;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packaged] { (*packaged)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    // runs body(i) for i in [0, count). The calling thread takes part, so it is safe to call from inside a task
+    // (nested parallelism cannot deadlock even when every worker is busy).
+    void ParallelFor(size_t count, const std::function<void(size_t)> &body)
+    {
+        if (count == 0)
+            return;
+        if (count == 1)
+        {
+            body(0);
+            return;
+        }
+        struct Shared {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto shared = std::make_shared<Shared>();
+        size_t total = count;
+        auto run = [shared, total, &body] {
+            size_t completed = 0;
+            for (size_t i = shared->next++; i < total; i = shared->next++)
+            {
+                body(i);
+                completed++;
+            }
+            if (completed && shared->done.fetch_add(completed) + completed == total)
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->finished.notify_all();
+            }
+        };
+        size_t helpers = std::min<size_t>(workers.size(), count - 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < helpers; i++)
+                tasks.emplace_back(run);
+        }
+        wake.notify_all();
+        run();
+        // helpers that start after all indices are taken return immediately, so only wait for work in flight
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->finished.wait(lock, [&] { return shared->done.load() == total; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+#endif
@@ -0,0 +1,119 @@
+#ifndef UNIFORMBLOCK_H
+#define UNIFORMBLOCK_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include "GLState.h"
+#include "Shader.h"
+
+// A std140 uniform block held in one buffer and bound to the block's binding point (see UniformBlockBinding() in
+// Shader.h), so every program that declares the block reads the same data. Update() uploads with a single
+// glBufferSubData, and only if the data changed since the last upload. T must match the block's std140 layout
+// byte for byte, padding spelled out as members, so the comparison sees no uninitialized bytes. GL thread only.
+template <typename T>
+class UniformBlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "uniform block data is copied as bytes");
+
+public:
+    explicit UniformBlock(const std::string &name) : binding(UniformBlockBinding(name)) {}
+
+    UniformBlock(const UniformBlock&) = delete;
+    UniformBlock& operator=(const UniformBlock&) = delete;
+
+    ~UniformBlock()
+    {
+        // at shutdown the context may already be gone, and the driver frees everything anyway
+        if (buffer && glfwGetCurrentContext())
+            GLState::Instance().DeleteBuffers(1, &buffer);
+    }
+
+    // returns whether anything was uploaded
+    bool Update(const T &data)
+    {
+        if (!buffer)
+        {
+            glGenBuffers(1, &buffer);
+            GLState::Instance().BindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &data, GL_DYNAMIC_DRAW);
+            GLState::Instance().BindBuffer(GL_UNIFORM_BUFFER, 0);
+            GLState::Instance().BindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+        }
+        else if (std::memcmp(&current, &data, sizeof(T)) == 0)
+            return false;
+        else
+        {
+            GLState::Instance().BindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+            GLState::Instance().BindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        current = data;
+        uploads++;
+        return true;
+    }
+
+    unsigned int Uploads() const { return uploads; }
+
+private:
+    GLuint binding;
+    GLuint buffer = 0;
+    T current;
+    unsigned int uploads = 0;
+};
+
+// ------------------------------------------------------------------------
+// the blocks of res/shaders
+
+// uniform Camera: the same in the vertex and the fragment shader
+struct CameraBlock {
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::vec3 viewPos = glm::vec3(0.0f);
+    float pad = 0.0f;
+};
+
+// the fragment shader's DirLight: every vec3 starts a new 16 bytes
+struct DirLightData {
+    glm::vec3 direction = glm::vec3(0.0f);
+    float pad0 = 0.0f;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    float pad1 = 0.0f;
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    float pad2 = 0.0f;
+    glm::vec3 specular = glm::vec3(0.0f);
+    float pad3 = 0.0f;
+};
+
+// the fragment shader's PointLight: constant fills the vec3's last 4 bytes, ambient starts the next 16
+struct PointLightData {
+    glm::vec3 position = glm::vec3(0.0f);
+    float constant = 1.0f;
+    float linear = 0.0f;
+    float quadratic = 0.0f;
+    float pad0[2] = { 0.0f, 0.0f };
+    glm::vec3 ambient = glm::vec3(0.0f);
+    float pad1 = 0.0f;
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    float pad2 = 0.0f;
+    glm::vec3 specular = glm::vec3(0.0f);
+    float pad3 = 0.0f;
+};
+
+// uniform Lights in fragment.shader; MAX_POINT_LIGHTS is its NR_POINT_LIGHTS
+const int MAX_POINT_LIGHTS = 14;
+struct LightBlock {
+    DirLightData dirLight;
+    PointLightData pointLights[MAX_POINT_LIGHTS];
+};
+
+static_assert(sizeof(CameraBlock) == 144 && offsetof(CameraBlock, viewPos) == 128, "CameraBlock does not match std140");
+static_assert(sizeof(DirLightData) == 64, "DirLightData does not match std140");
+static_assert(sizeof(PointLightData) == 80 && offsetof(PointLightData, constant) == 12 && offsetof(PointLightData, ambient) == 32 &&
+              offsetof(PointLightData, specular) == 64, "PointLightData does not match std140");
+static_assert(offsetof(LightBlock, pointLights) == 64, "LightBlock does not match std140");
+#endif
@@ -1,14 +1,17 @@
 #ifndef VERTEXBUFFER_H
 #define VERTEXBUFFER_H
 
-
+#include "GLState.h"
+#include "Residency.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <utility>
 
+// owns its buffer: it can be moved but not copied, and deletes the buffer when destroyed
 class VertexBuffer
 {
 public:
-    unsigned int buffer_ID;
+    unsigned int buffer_ID = 0;
 
     VertexBuffer(){
         return;
@@ -16,16 +19,38 @@ public:
 
     VertexBuffer(int size, const void* data){
         glGenBuffers(1, &buffer_ID);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer_ID);
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, buffer_ID);
         glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+        ResidencyManager::Instance().TrackBuffer(buffer_ID, size);
     };
 
+    VertexBuffer(VertexBuffer &&other) noexcept : buffer_ID(other.buffer_ID) {
+        other.buffer_ID = 0;
+    }
+
+    VertexBuffer& operator=(VertexBuffer &&other) noexcept {
+        std::swap(buffer_ID, other.buffer_ID);
+        return *this;
+    }
+
+    VertexBuffer(const VertexBuffer&) = delete;
+    VertexBuffer& operator=(const VertexBuffer&) = delete;
+
+    ~VertexBuffer(){
+        if (!buffer_ID)
+            return;
+        ResidencyManager::Instance().ForgetBuffer(buffer_ID);
+        if (glfwGetCurrentContext())
+            GLState::Instance().DeleteBuffers(1, &buffer_ID);
+    }
+
     void Bind(){
-        glBindBuffer(GL_ARRAY_BUFFER, buffer_ID);
+        ResidencyManager::Instance().UseBuffer(buffer_ID);
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, buffer_ID);
     }
 
     void Unbind(){
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,69 @@
+#ifndef VERTEXCOMPRESSION_H
+#define VERTEXCOMPRESSION_H
+
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// encoding helpers for the quantized vertex layouts in VertexLayout.h. Positions are stored as unorm16 within the mesh
+// bounds and dequantized in the vertex shader (aPos = positionOffset + positionScale * xyz), normals and tangents
+// as octahedral snorm16, texture coordinates as half floats (unorm would clip tiling coordinates outside [0, 1]).
+
+struct PositionQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);  // mesh bounds minimum
+    glm::vec3 scale = glm::vec3(1.0f);   // mesh bounds extent
+    glm::vec3 quantize = glm::vec3(0.0f);
+
+    PositionQuantization() {}
+    PositionQuantization(const glm::vec3 &lo, const glm::vec3 &hi) : offset(lo), scale(hi - lo)
+    {
+        for (int i = 0; i < 3; i++)
+            quantize[i] = scale[i] > 0.0f ? 65535.0f / scale[i] : 0.0f;
+    }
+
+    void Encode(const glm::vec3 &position, uint16_t out[3]) const
+    {
+        glm::vec3 q = glm::clamp((position - offset) * quantize + 0.5f, glm::vec3(0.0f), glm::vec3(65535.0f));
+        out[0] = (uint16_t)q.x;
+        out[1] = (uint16_t)q.y;
+        out[2] = (uint16_t)q.z;
+    }
+};
+
+// octahedral mapping of a unit vector to [-1, 1]^2, quantized to snorm16
+inline void EncodeOctahedral(glm::vec3 n, int16_t out[2])
+{
+    float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (length < 1e-12f)
+        n = glm::vec3(0.0f, 0.0f, 1.0f); // missing data (no tangents): any valid direction will do
+    else
+        n /= length;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    out[0] = (int16_t)std::lround(glm::clamp(e.x, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (int16_t)std::lround(glm::clamp(e.y, -1.0f, 1.0f) * 32767.0f);
+}
+
+inline glm::vec3 DecodeOctahedral(const int16_t in[2])
+{
+    glm::vec2 e(std::fmax(in[0] / 32767.0f, -1.0f), std::fmax(in[1] / 32767.0f, -1.0f));
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f)
+    {
+        n.x = (1.0f - std::fabs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::fabs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+inline void EncodeHalf2(const glm::vec2 &v, uint16_t out[2])
+{
+    out[0] = glm::packHalf1x16(v.x);
+    out[1] = glm::packHalf1x16(v.y);
+}
+#endif
@@ -0,0 +1,258 @@
+#ifndef VERTEXLAYOUT_H
+#define VERTEXLAYOUT_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include "VertexCompression.h"
+
+#define MAX_BONE_INFLUENCE 4
+
+// full-precision vertex produced by the importers; every layout below is packed from it
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+	//bone indexes which will influence this vertex
+	int m_BoneIDs[MAX_BONE_INFLUENCE];
+	//weights from each bone
+	float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// what an imported mesh has beyond positions (MeshData::attributes), and what a layout can carry
+enum VertexAttributeFlags {
+    VERTEX_NORMALS   = 1 << 0,
+    VERTEX_TEXCOORDS = 1 << 1,
+    VERTEX_TANGENTS  = 1 << 2,
+    VERTEX_BONES     = 1 << 3,
+};
+
+// one row of a layout's attribute table: a glVertexAttrib(I)Pointer call
+struct VertexAttribute {
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    bool integer;   // read as ivec/uvec in the shader (glVertexAttribIPointer)
+    size_t offset;
+};
+
+constexpr size_t VertexAttributeBytes(const VertexAttribute &attribute)
+{
+    switch (attribute.type)
+    {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: return attribute.components;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2 * attribute.components;
+    default: return 4 * attribute.components;
+    }
+}
+
+// A vertex layout is a struct with
+//   Packed                the GPU vertex
+//   name                  for reports
+//   quantized             positions and normals are encoded as in VertexCompression.h
+//   provides              VertexAttributeFlags it can carry
+//   attributes[]          constexpr attribute table, turned into the VAO setup by SetupVertexAttributes()
+//   Pack(v, out, bounds)  converts an imported vertex
+// The vertex shader locations are fixed: 0 position, 1 normal, 2 texCoords, 3 tangent, 4 bitangent, 5 bone IDs,
+// 6 bone weights.
+
+// positions and texture coordinates: 12 bytes
+struct StaticUnlitLayout {
+    struct Packed {
+        uint16_t Position[4];
+        uint16_t TexCoords[2];
+    };
+    static constexpr const char *name = "unlit";
+    static constexpr bool quantized = true;
+    static constexpr unsigned int provides = VERTEX_TEXCOORDS;
+    static constexpr VertexAttribute attributes[] = {
+        { 0, 4, GL_UNSIGNED_SHORT, GL_TRUE, false, offsetof(Packed, Position) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(Packed, TexCoords) },
+    };
+    static void Pack(const Vertex &v, Packed &out, const PositionQuantization &bounds)
+    {
+        bounds.Encode(v.Position, out.Position);
+        out.Position[3] = 65535;
+        EncodeHalf2(v.TexCoords, out.TexCoords);
+    }
+};
+
+// plus an octahedral normal: 16 bytes
+struct StaticLitLayout {
+    struct Packed {
+        uint16_t Position[4];
+        int16_t  Normal[2];
+        uint16_t TexCoords[2];
+    };
+    static constexpr const char *name = "lit";
+    static constexpr bool quantized = true;
+    static constexpr unsigned int provides = VERTEX_NORMALS | VERTEX_TEXCOORDS;
+    static constexpr VertexAttribute attributes[] = {
+        { 0, 4, GL_UNSIGNED_SHORT, GL_TRUE, false, offsetof(Packed, Position) },
+        { 1, 2, GL_SHORT, GL_TRUE, false, offsetof(Packed, Normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(Packed, TexCoords) },
+    };
+    static void Pack(const Vertex &v, Packed &out, const PositionQuantization &bounds)
+    {
+        bounds.Encode(v.Position, out.Position);
+        out.Position[3] = 65535;
+        EncodeOctahedral(v.Normal, out.Normal);
+        EncodeHalf2(v.TexCoords, out.TexCoords);
+    }
+};
+
+// plus an octahedral tangent, the bitangent is rebuilt from the sign in position.w: 20 bytes
+struct StaticNormalMappedLayout {
+    struct Packed {
+        uint16_t Position[4];
+        int16_t  Normal[2];
+        uint16_t TexCoords[2];
+        int16_t  Tangent[2];
+    };
+    static constexpr const char *name = "normal-mapped";
+    static constexpr bool quantized = true;
+    static constexpr unsigned int provides = VERTEX_NORMALS | VERTEX_TEXCOORDS | VERTEX_TANGENTS;
+    static constexpr VertexAttribute attributes[] = {
+        { 0, 4, GL_UNSIGNED_SHORT, GL_TRUE, false, offsetof(Packed, Position) },
+        { 1, 2, GL_SHORT, GL_TRUE, false, offsetof(Packed, Normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(Packed, TexCoords) },
+        { 3, 2, GL_SHORT, GL_TRUE, false, offsetof(Packed, Tangent) },
+    };
+    static void Pack(const Vertex &v, Packed &out, const PositionQuantization &bounds)
+    {
+        bounds.Encode(v.Position, out.Position);
+        out.Position[3] = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) >= 0.0f ? 65535 : 0;
+        EncodeOctahedral(v.Normal, out.Normal);
+        EncodeHalf2(v.TexCoords, out.TexCoords);
+        EncodeOctahedral(v.Tangent, out.Tangent);
+    }
+};
+
+// plus four 8-bit bone indices (up to 256 bones) and unorm8 weights: 28 bytes
+struct SkinnedLayout {
+    struct Packed {
+        uint16_t Position[4];
+        int16_t  Normal[2];
+        uint16_t TexCoords[2];
+        int16_t  Tangent[2];
+        uint8_t  BoneIDs[MAX_BONE_INFLUENCE];
+        uint8_t  Weights[MAX_BONE_INFLUENCE];
+    };
+    static constexpr const char *name = "skinned";
+    static constexpr bool quantized = true;
+    static constexpr unsigned int provides = VERTEX_NORMALS | VERTEX_TEXCOORDS | VERTEX_TANGENTS | VERTEX_BONES;
+    static constexpr VertexAttribute attributes[] = {
+        { 0, 4, GL_UNSIGNED_SHORT, GL_TRUE, false, offsetof(Packed, Position) },
+        { 1, 2, GL_SHORT, GL_TRUE, false, offsetof(Packed, Normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(Packed, TexCoords) },
+        { 3, 2, GL_SHORT, GL_TRUE, false, offsetof(Packed, Tangent) },
+        { 5, 4, GL_UNSIGNED_BYTE, GL_FALSE, true, offsetof(Packed, BoneIDs) },
+        { 6, 4, GL_UNSIGNED_BYTE, GL_TRUE, false, offsetof(Packed, Weights) },
+    };
+    static void Pack(const Vertex &v, Packed &out, const PositionQuantization &bounds)
+    {
+        StaticNormalMappedLayout::Packed base;
+        StaticNormalMappedLayout::Pack(v, base, bounds);
+        std::copy(base.Position, base.Position + 4, out.Position);
+        std::copy(base.Normal, base.Normal + 2, out.Normal);
+        std::copy(base.TexCoords, base.TexCoords + 2, out.TexCoords);
+        std::copy(base.Tangent, base.Tangent + 2, out.Tangent);
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            out.BoneIDs[i] = (uint8_t)glm::clamp(v.m_BoneIDs[i], 0, 255);
+            out.Weights[i] = (uint8_t)(glm::clamp(v.m_Weights[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+};
+
+// the importer's Vertex as is, all floats: 88 bytes
+struct FullLayout {
+    typedef Vertex Packed;
+    static constexpr const char *name = "full";
+    static constexpr bool quantized = false;
+    static constexpr unsigned int provides = VERTEX_NORMALS | VERTEX_TEXCOORDS | VERTEX_TANGENTS | VERTEX_BONES;
+    static constexpr VertexAttribute attributes[] = {
+        { 0, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Position) },
+        { 1, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Normal) },
+        { 2, 2, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, TexCoords) },
+        { 3, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Tangent) },
+        { 4, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Bitangent) },
+        { 5, 4, GL_INT, GL_FALSE, true, offsetof(Vertex, m_BoneIDs) },
+        { 6, 4, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, m_Weights) },
+    };
+    static void Pack(const Vertex &v, Packed &out, const PositionQuantization &)
+    {
+        out = v;
+    }
+};
+
+// a model whose meshes each use the first (smallest) of these layouts that covers the mesh's attributes,
+// see MeshSet in Mesh.h
+template <typename... Layouts>
+struct SmallestLayout {};
+
+typedef SmallestLayout<StaticUnlitLayout, StaticLitLayout, StaticNormalMappedLayout, SkinnedLayout> DefaultLayouts;
+
+// ------------------------------------------------------------------------
+// compile-time checks of an attribute table: every attribute inside the vertex, no location used twice and no
+// bytes of the vertex left unused
+
+template <typename Layout>
+constexpr bool VertexLayoutIsValid()
+{
+    constexpr size_t count = std::size(Layout::attributes);
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const VertexAttribute &a = Layout::attributes[i];
+        if (a.offset + VertexAttributeBytes(a) > sizeof(typename Layout::Packed))
+            return false;
+        for (size_t j = i + 1; j < count; j++)
+            if (Layout::attributes[j].location == a.location)
+                return false;
+        bytes += VertexAttributeBytes(a);
+    }
+    return bytes == sizeof(typename Layout::Packed);
+}
+
+template <typename Layout>
+constexpr bool VertexLayoutCovers(unsigned int attributes)
+{
+    return (Layout::provides & attributes) == attributes;
+}
+
+template <typename Layout, size_t... I>
+inline void setupVertexAttributes(std::index_sequence<I...>)
+{
+    constexpr GLsizei stride = sizeof(typename Layout::Packed);
+    auto setup = [](const VertexAttribute &a) {
+        glEnableVertexAttribArray(a.location);
+        if (a.integer)
+            glVertexAttribIPointer(a.location, a.components, a.type, stride, (void*)a.offset);
+        else
+            glVertexAttribPointer(a.location, a.components, a.type, a.normalized, stride, (void*)a.offset);
+    };
+    (setup(Layout::attributes[I]), ...);
+}
+
+// points the bound VAO's attributes at a vertex buffer of Layout::Packed; the table is unrolled at compile time
+template <typename Layout>
+inline void SetupVertexAttributes()
+{
+    static_assert(VertexLayoutIsValid<Layout>(), "vertex layout attribute table does not match its Packed vertex");
+    setupVertexAttributes<Layout>(std::make_index_sequence<std::size(Layout::attributes)>());
+}
+#endif
@@ -6,9 +6,12 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <algorithm>
 
+#include "GLState.h"
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
+#include "ModelStreamer.h"
+#include "UniformBlock.h"
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -26,6 +29,7 @@ glm::vec3 particleSizes[maxParticles];
 // settings
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 1200;
+const size_t GPU_BUDGET_MB = 512;   // meshes and textures, see ResidencyManager
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 10.0f));
@@ -37,8 +41,31 @@ bool firstMouse = true;
 float deltaTime = 10.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char *argv[])
 {
+    auto startTime = std::chrono::steady_clock::now();
+
+    // offline texture baking: "app --bake-textures [--bc7]" compresses every PNG under res/ and exits (no window or GPU needed)
+    if (argc > 1 && std::string(argv[1]) == "--bake-textures")
+        return BakeTextures("res", argc > 2 && std::string(argv[2]) == "--bc7");
+    // "app --build-pack" packs res/ (sources, baked textures and mesh caches) into res.pack and exits
+    if (argc > 1 && std::string(argv[1]) == "--build-pack")
+        return AssetPack::Build("res", "res.pack");
+    // "app --benchmark-import" measures ASSIMP import throughput with and without memory-mapped file access first
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-import")
+        Model::BenchmarkImportIO("res");
+    // "app --benchmark-tangents" times ASSIMP's normal and tangent generation against ours (TangentSpace.h) first
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-tangents")
+    {
+        ThreadPool pool;
+        Model::BenchmarkTangentSpace("res", &pool);
+    }
+
+    // with a res.pack next to the binary every asset is read from it; without one (or for files it does not
+    // have) the loose files under res/ are used
+    if (Assets().Open("res.pack"))
+        std::cout << "ASSET PACK:: " << Assets().Count() << " files in res.pack" << std::endl;
+
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -70,24 +97,37 @@ int main()
     glewInit();
 
     // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
+    GLState::Instance().SetEnabled(GL_DEPTH_TEST, true);
 
     // build and compile shaders
     Shader objectShader("res/shaders/vertex.shader", "res/shaders/fragment.shader");
 
-    // load models
-    Model base("res/background/background.obj");
-    Model bus("res/Bus/Bus.obj");
-    Model bus27("res/Bus27/Bus27.obj");
-    Model bus122("res/Bus122/Bus122.obj");
-    Model dragon("res/dragon/dragon.obj");
-    Model spire("res/spire/spire.obj");
-    Model fire("res/fire/fire.obj");
-    Model luas("res/luas/luas.obj");
-    Model truck("res/Truck/Truck.obj");
-    Model sign("res/sign/sign.obj");
-    Model rubble("res/rubble/rubble.obj");
-    Model ball("res/ball/ball.obj");
+    // GPU memory for meshes and textures; least recently drawn ones are evicted above it (see Residency.h)
+    ResidencyManager::Instance().SetBudget(GPU_BUDGET_MB << 20);
+
+    // request the models; they load in the background, nearest first, and are drawn as they become ready.
+    // textures stream in once the render loop runs
+    TextureStreamer textureStreamer;
+    ModelStreamer modelStreamer;
+    modelStreamer.StreamTextures(textureStreamer);
+    ModelOptions options;
+    options.optimizeMeshes = true;
+    options.generateLods = true;
+    options.buildMeshlets = true;
+    options.fastObj = true;
+    options.keepCpuData = false;
+    ModelHandle base = modelStreamer.Request("res/background/background.obj", options);
+    ModelHandle bus = modelStreamer.Request("res/Bus/Bus.obj", options);
+    ModelHandle bus27 = modelStreamer.Request("res/Bus27/Bus27.obj", options);
+    ModelHandle bus122 = modelStreamer.Request("res/Bus122/Bus122.obj", options);
+    ModelHandle dragon = modelStreamer.Request("res/dragon/dragon.obj", options);
+    ModelHandle spire = modelStreamer.Request("res/spire/spire.obj", options);
+    ModelHandle fire = modelStreamer.Request("res/fire/fire.obj", options);
+    ModelHandle luas = modelStreamer.Request("res/luas/luas.obj", options);
+    ModelHandle truck = modelStreamer.Request("res/Truck/Truck.obj", options);
+    ModelHandle sign = modelStreamer.Request("res/sign/sign.obj", options);
+    ModelHandle rubble = modelStreamer.Request("res/rubble/rubble.obj", options);
+    ModelHandle ball = modelStreamer.Request("res/ball/ball.obj", options);
 
 
     // positions of the point lights
@@ -153,6 +193,94 @@ int main()
     objectShader.use();
     objectShader.setInt("material.diffuse", 0);
     objectShader.setInt("material.specular", 1);
+    objectShader.setFloat("material.shininess", 32.0f);
+
+    // the uniforms the render loop sets, resolved once so it neither builds names nor looks them up
+    UniformHandle modelUniform = objectShader.Uniform("model");
+    size_t uniformLookupsAtReport = UniformLookups();
+
+    // camera and lights go to the shaders as uniform blocks; the lights are uploaded only when they change
+    UniformBlock<CameraBlock> cameraBlock("Camera");
+    UniformBlock<LightBlock> lightBlock("Lights");
+    LightBlock lights;
+    // directional light
+    lights.dirLight.direction = glm::vec3(0.0f, 30.0f, -40.0f);
+    lights.dirLight.ambient = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.dirLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+    lights.dirLight.specular = glm::vec3(0.05f, 0.05f, 0.05f);
+    // point light 0 - volcano
+    lights.pointLights[0].position = pointLightPositions[0];
+    lights.pointLights[0].ambient = glm::vec3(10.0f, 15.0f, 10.0f);
+    lights.pointLights[0].diffuse = glm::vec3(2.0f, 5.0f, 2.0f);
+    lights.pointLights[0].specular = glm::vec3(1.0f, 3.0f, 1.0f);
+    lights.pointLights[0].constant = 0.03f;
+    lights.pointLights[0].linear = 0.2f;
+    lights.pointLights[0].quadratic = 0.2f;
+    // point light 1
+    lights.pointLights[1].position = pointLightPositions[1];
+    lights.pointLights[1].ambient = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.pointLights[1].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.pointLights[1].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[1].constant = 1.0f;
+    lights.pointLights[1].linear = 0.09f;
+    lights.pointLights[1].quadratic = 0.032f;
+    // point light 2
+    lights.pointLights[2].position = pointLightPositions[2];
+    lights.pointLights[2].ambient = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[2].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.pointLights[2].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[2].constant = 1.0f;
+    lights.pointLights[2].linear = 0.09f;
+    lights.pointLights[2].quadratic = 0.032f;
+    // point light 3
+    lights.pointLights[3].position = pointLightPositions[3];
+    lights.pointLights[3].ambient = glm::vec3(1.5f, 1.5f, 1.5f);
+    lights.pointLights[3].diffuse = glm::vec3(0.8f, 0.8f, 1.0f);
+    lights.pointLights[3].specular = glm::vec3(1.0f, 1.0f, 1.5f);
+    lights.pointLights[3].constant = 1.0f;
+    lights.pointLights[3].linear = 0.09f;
+    lights.pointLights[3].quadratic = 0.032f;
+    // point light 4
+    lights.pointLights[4].position = pointLightPositions[4];
+    lights.pointLights[4].ambient = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.pointLights[4].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.pointLights[4].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[4].constant = 1.0f;
+    lights.pointLights[4].linear = 0.09f;
+    lights.pointLights[4].quadratic = 0.032f;
+    // point light 5
+    lights.pointLights[5].position = pointLightPositions[5];
+    lights.pointLights[5].ambient = glm::vec3(0.9f, 0.9f, 0.9f);
+    lights.pointLights[5].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.pointLights[5].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[5].constant = 1.0f;
+    lights.pointLights[5].linear = 0.09f;
+    lights.pointLights[5].quadratic = 0.032f;
+    // point light 6
+    lights.pointLights[6].position = pointLightPositions[6];
+    lights.pointLights[6].ambient = glm::vec3(0.7f, 0.8f, 0.8f);
+    lights.pointLights[6].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.pointLights[6].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[6].constant = 1.0f;
+    lights.pointLights[6].linear = 0.09f;
+    lights.pointLights[6].quadratic = 0.032f;
+    // point light 7
+    lights.pointLights[7].position = pointLightPositions[7];
+    lights.pointLights[7].ambient = glm::vec3(0.7f, 0.8f, 0.8f);
+    lights.pointLights[7].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.pointLights[7].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[7].constant = 1.0f;
+    lights.pointLights[7].linear = 0.09f;
+    lights.pointLights[7].quadratic = 0.032f;
+
+
+    bool texturesStreaming = true;
+    bool firstFrame = true;
+    float drawStatsTime = 0.0f;
+    size_t drawStatsFrames = 0;
+    // per-copy matrices of the models drawn instanced, refilled for each of them
+    std::vector<InstanceData> instances;
+    instances.reserve(maxParticles);
 
     // render loop
     while (!glfwWindowShouldClose(window)) {
@@ -188,98 +316,56 @@ int main()
         // input
         processInput(window);
 
+        // evict what hasn't been drawn lately if meshes and textures are over the GPU budget
+        ResidencyManager::Instance().BeginFrame();
+
+        // upload the models that finished importing, nearest first
+        modelStreamer.Update(camera.Position);
+
+        // upload whatever textures finished decoding, within the per-frame budget
+        textureStreamer.Update();
+        if (texturesStreaming && modelStreamer.Pending() == 0 && textureStreamer.Pending() == 0)
+        {
+            TextureRegistry::Instance().Report();
+            ReportGeometryPools();
+            modelStreamer.ReportResidency();
+            texturesStreaming = false;
+        }
+
         // render
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // don't forget to enable shader before setting uniforms
         objectShader.use();
-        objectShader.setVec3("viewPos", camera.Position);
-        objectShader.setFloat("material.shininess", 32.0f);
-
-        // directional light
-        objectShader.setVec3("dirLight.direction", 0.0f, 30.0f, -40.0f);
-        objectShader.setVec3("dirLight.ambient", 0.5f, 0.5f, 0.5f);
-        objectShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        objectShader.setVec3("dirLight.specular", 0.05f, 0.05f, 0.05f);
-        // point light 0 - volcano
-        objectShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-        objectShader.setVec3("pointLights[0].ambient", 10.0f, 15.0f, 10.0f);
-        objectShader.setVec3("pointLights[0].diffuse", 2.0f, 5.0f, 2.0f);
-        objectShader.setVec3("pointLights[0].specular", 1.0f, 3.0f, 1.0f);
-        objectShader.setFloat("pointLights[0].constant", 0.03f);
-        objectShader.setFloat("pointLights[0].linear", 0.2f);
-        objectShader.setFloat("pointLights[0].quadratic", 0.2f);
-        // point light 1
-        objectShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-        objectShader.setVec3("pointLights[1].ambient", 0.5f, 0.5f, 0.5f);
-        objectShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        objectShader.setFloat("pointLights[1].constant", 1.0f);
-        objectShader.setFloat("pointLights[1].linear", 0.09f);
-        objectShader.setFloat("pointLights[1].quadratic", 0.032f);
-        // point light 2
-        objectShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-        objectShader.setVec3("pointLights[2].ambient", 1.0f, 1.0f, 1.0f);
-        objectShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-        objectShader.setFloat("pointLights[2].constant", 1.0f);
-        objectShader.setFloat("pointLights[2].linear", 0.09f);
-        objectShader.setFloat("pointLights[2].quadratic", 0.032f);
-        // point light 3
-        objectShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-        objectShader.setVec3("pointLights[3].ambient", 1.5f, 1.5f, 1.5f);
-        objectShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 1.0f);
-        objectShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.5f);
-        objectShader.setFloat("pointLights[3].constant", 1.0f);
-        objectShader.setFloat("pointLights[3].linear", 0.09f);
-        objectShader.setFloat("pointLights[3].quadratic", 0.032f);
-        // point light 4
-        objectShader.setVec3("pointLights[4].position", pointLightPositions[4]);
-        objectShader.setVec3("pointLights[4].ambient", 0.5f, 0.5f, 0.5f);
-        objectShader.setVec3("pointLights[4].diffuse", 0.8f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[4].specular", 1.0f, 1.0f, 1.0f);
-        objectShader.setFloat("pointLights[4].constant", 1.0f);
-        objectShader.setFloat("pointLights[4].linear", 0.09f);
-        objectShader.setFloat("pointLights[4].quadratic", 0.032f);
-        // point light 5
-        objectShader.setVec3("pointLights[5].position", pointLightPositions[5]);
-        objectShader.setVec3("pointLights[5].ambient", 0.9f, 0.9f, 0.9f);
-        objectShader.setVec3("pointLights[5].diffuse", 0.8f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[5].specular", 1.0f, 1.0f, 1.0f);
-        objectShader.setFloat("pointLights[5].constant", 1.0f);
-        objectShader.setFloat("pointLights[5].linear", 0.09f);
-        objectShader.setFloat("pointLights[5].quadratic", 0.032f);
-        // point light 6
-        objectShader.setVec3("pointLights[6].position", pointLightPositions[6]);
-        objectShader.setVec3("pointLights[6].ambient", 0.7f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[6].diffuse", 0.8f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[6].specular", 1.0f, 1.0f, 1.0f);
-        objectShader.setFloat("pointLights[6].constant", 1.0f);
-        objectShader.setFloat("pointLights[6].linear", 0.09f);
-        objectShader.setFloat("pointLights[6].quadratic", 0.032f);
-        // point light 7
-        objectShader.setVec3("pointLights[7].position", pointLightPositions[7]);
-        objectShader.setVec3("pointLights[7].ambient", 0.7f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[7].diffuse", 0.8f, 0.8f, 0.8f);
-        objectShader.setVec3("pointLights[7].specular", 1.0f, 1.0f, 1.0f);
-        objectShader.setFloat("pointLights[7].constant", 1.0f);
-        objectShader.setFloat("pointLights[7].linear", 0.09f);
-        objectShader.setFloat("pointLights[7].quadratic", 0.032f);
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+        // view/projection transformations, for the framebuffer as it is now (resized, or larger than the window on HiDPI
+        // screens); a minimized window has none
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        if (framebufferWidth <= 0 || framebufferHeight <= 0)
+        {
+            framebufferWidth = SCR_WIDTH;
+            framebufferHeight = SCR_HEIGHT;
+        }
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)framebufferWidth / (float)framebufferHeight, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        objectShader.setMat4("projection", projection);
-        objectShader.setMat4("view", view);  
+        CameraBlock cameraData;
+        cameraData.view = view;
+        cameraData.projection = projection;
+        cameraData.viewPos = camera.Position;
+        cameraBlock.Update(cameraData);
+        // the fireball lights as the last frame left them
+        lightBlock.Update(lights);
+        // LOD pixel error and mip texel density are measured in framebuffer pixels
+        CurrentView().Set(projection, view, camera.Position, (float)framebufferHeight);
 
         // render the base
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, -2.0f, -85.0f));
         model = glm::scale( model, glm::vec3( 3.0f, 3.0f, 3.0f ) );
         model = glm::rotate(model, glm::radians(270.0f), glm::vec3(0.0f, 1.0f ,0.0f));
-        objectShader.setMat4("model", model);
-        base.Draw(objectShader);
+        base.Draw(objectShader, model);
 
         // render the bus1
         model = glm::mat4(1.0f);
@@ -288,8 +374,7 @@ int main()
         model = glm::rotate(model, glm::radians(270.0f), glm::vec3(0.0f, 1.0f ,0.0f));
         model = glm::rotate(model, glm::radians(35.0f), glm::vec3(1.0f, 0.0f ,0.0f));
         model = glm::rotate(model, glm::radians(-40.0f), glm::vec3(1.0f, 0.0f ,1.0f));
-        objectShader.setMat4("model", model);
-        bus.Draw(objectShader);
+        bus.Draw(objectShader, model);
 
         // render the bus2
         model = glm::mat4(1.0f);
@@ -298,8 +383,7 @@ int main()
         model = glm::rotate(model, glm::radians(50.0f), glm::vec3(0.0f, 1.0f ,0.0f));
         model = glm::rotate(model, glm::radians(135.0f), glm::vec3(1.0f, 0.0f ,0.0f));
         model = glm::rotate(model, glm::radians(-70.0f), glm::vec3(1.0f, 0.0f ,1.0f));
-        objectShader.setMat4("model", model);
-        bus27.Draw(objectShader);
+        bus27.Draw(objectShader, model);
 
         // render the bus3
         model = glm::mat4(1.0f);
@@ -308,53 +392,49 @@ int main()
         model = glm::rotate(model, glm::radians(150.0f), glm::vec3(0.0f, 1.0f ,0.0f));
         model = glm::rotate(model, glm::radians(20.0f), glm::vec3(1.0f, 0.0f ,0.0f));
         model = glm::rotate(model, glm::radians(-150.0f), glm::vec3(1.0f, 0.0f ,1.0f));
-        objectShader.setMat4("model", model);
-        bus122.Draw(objectShader);
+        bus122.Draw(objectShader, model);
 
-        // render the luas1
+        // render the luas1 and luas2 in one instanced draw
+        instances.clear();
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(45.0f, -2.5f, -10.0f));
         model = glm::scale( model, glm::vec3( 3.0f, 3.0f, 3.0f ) );
         model = glm::rotate(model, glm::radians(50.0f), glm::vec3(1.0f, 0.0f, 0.0f));
         model = glm::rotate(model, glm::radians(190.0f), glm::vec3(0.0f, 0.1f, 0.0f));
         model = glm::rotate(model, glm::radians(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        objectShader.setMat4("model", model);
-        luas.Draw(objectShader);
+        instances.push_back(InstanceData(model));
 
-        // render the luas2
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-30.0f, -2.5f, -5.0f));
         model = glm::scale( model, glm::vec3( 3.0f, 3.0f, 3.0f ) );
         model = glm::rotate(model, glm::radians(30.0f), glm::vec3(1.0f, 0.0f, 0.0f));
         model = glm::rotate(model, glm::radians(130.0f), glm::vec3(0.0f, 0.1f, 0.0f));
         model = glm::rotate(model, glm::radians(-10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        objectShader.setMat4("model", model);
-        luas.Draw(objectShader);
+        instances.push_back(InstanceData(model));
+        luas.DrawInstanced(objectShader, instances);
 
         // render the spire
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(25.0f, -22.5f, -55.0f));
         model = glm::scale( model, glm::vec3( 20.0f, 20.0f, 20.0f ) );
         model = glm::rotate(model, glm::radians(354.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        objectShader.setMat4("model", model);
-        spire.Draw(objectShader);
+        spire.Draw(objectShader, model);
 
         // render the truck
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-20.0f, -2.0f, -50.0f));
         model = glm::scale( model, glm::vec3( 0.4f, 0.4f, 0.4f ) );
         model = glm::rotate(model, glm::radians(15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        objectShader.setMat4("model", model);
-        truck.Draw(objectShader);
+        truck.Draw(objectShader, model);
 
         // render the sign
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(8.0f, -2.5f, -7.0f));
         model = glm::scale( model, glm::vec3( 0.2f, 0.2f, 0.2f ) );
         model = glm::rotate(model, glm::radians(165.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        objectShader.setMat4("model", model);
-        sign.Draw(objectShader);
+        sign.Draw(objectShader, model);
 
+        instances.clear();
         for(int i = 0; i < sizeof(rubblePositions)/sizeof(rubblePositions[0]); i++) {
             float frequency = 2.0f + i * 0.2f;  // Adjust as needed
             float phase = i * 0.5f;  // Adjust as needed
@@ -372,21 +452,22 @@ int main()
             model = glm::scale( model, glm::vec3(rubbleSizes[i]) );
             model = glm::rotate(model, glm::radians(rotationX), glm::vec3(1.0f, 0.0f, 0.0f));
             model = glm::rotate(model, glm::radians(rotationZ), glm::vec3(0.0f, 0.0f, 1.0f));
-            objectShader.setMat4("model", model);
-            rubble.Draw(objectShader);
+            instances.push_back(InstanceData(model));
         }
+        rubble.DrawInstanced(objectShader, instances);
 
+        // render the volcano particles: one instanced draw per ball mesh
+        instances.clear();
         for(int i = 0; i < maxParticles; i++) {
-            // render the volcano particles
             model = glm::mat4(1.0f);
             model = glm::translate(model, volcanoParticles[i]);
             model = glm::scale( model, particleSizes[i] * glm::vec3( 1.0f, 1.0f, 1.0f ));
-            objectShader.setMat4("model", model);
-            ball.Draw(objectShader);
+            instances.push_back(InstanceData(model));
 
             // update the volcano particles
             volcanoParticles[i] += particleVelocities[i];
         }
+        ball.DrawInstanced(objectShader, instances);
 
         bool allParticlesAtTop = true;
         for (int i = 0; i < maxParticles; ++i) {
@@ -402,14 +483,22 @@ int main()
         
         for(int i = numPointLights, j = 0; j < numFireballs; i++, j++) {
             // draw the fire light
-            objectShader.setVec3("pointLights[" + std::to_string(i) + "].position", fireballPositions[j]);
-            objectShader.setVec3("pointLights[" + std::to_string(i) + "].ambient", fireballSizes[j] * .3f, fireballSizes[j] * .3f, fireballSizes[j] * .3f);
-            objectShader.setVec3("pointLights[" + std::to_string(i) + "].diffuse", 0.8f, 0.8f, 0.8f);
-            objectShader.setVec3("pointLights[" + std::to_string(i) + "].specular", 0.5f, 0.5f, 0.5f);
-            objectShader.setFloat("pointLights[" + std::to_string(i) + "].constant", 0.03f);
-            objectShader.setFloat("pointLights[" + std::to_string(i) + "].linear", 0.2f);
-            objectShader.setFloat("pointLights[" + std::to_string(i) + "].quadratic", 0.2f);
-            objectShader.setMat4("model", model);
+            if (i < MAX_POINT_LIGHTS)
+            {
+                PointLightData &light = lights.pointLights[i];
+                light.position = fireballPositions[j];
+                light.ambient = glm::vec3(fireballSizes[j] * .3f);
+                light.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+                light.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+                light.constant = 0.03f;
+                light.linear = 0.2f;
+                light.quadratic = 0.2f;
+            }
+            objectShader.setMat4(modelUniform, model);
+            // the light cubes have no vertex array or textures of their own: draw them with none bound, not with the
+            // last mesh's
+            GLState::Instance().BindVertexArray(0);
+            ClearSampledTextures();
             glDrawArrays(GL_TRIANGLES, 0, 36);
             
             // render the fire objects
@@ -417,8 +506,7 @@ int main()
             model = glm::translate(model, fireballPositions[j]);
             model = glm::scale( model, fireballSizes[j] * glm::vec3( 1.0f, 1.0f, 1.0f ));
             model = glm::rotate(model, glm::radians(fireballDirections[j]), glm::vec3(1.0f, 0.0f, 0.0f));
-            objectShader.setMat4("model", model);
-            fire.Draw(objectShader);
+            fire.Draw(objectShader, model);
         }
 
         // Draw objects lights
@@ -427,21 +515,56 @@ int main()
             model = glm::mat4(1.0f);
             model = glm::translate(model, pointLightPositions[i]);
             model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-            objectShader.setMat4("model", model);
+            objectShader.setMat4(modelUniform, model);
+            GLState::Instance().BindVertexArray(0);
+            ClearSampledTextures();
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
         
-        objectShader.setMat4("projection", projection);
-        objectShader.setMat4("view", view);
         model = glm::mat4(1.0f);
         model = glm::translate(model, pointLightPositions[0]);
         model = glm::scale(model, glm::vec3(1.0f)); // Make it a smaller cube
-        objectShader.setMat4("model", model);
+        objectShader.setMat4(modelUniform, model);
+        GLState::Instance().BindVertexArray(0);
+        ClearSampledTextures();
         glDrawArrays(GL_TRIANGLES, 0, 36);
 
+        // triangles drawn against what full detail without culling would have cost, averaged over a few seconds
+        drawStatsFrames++;
+        if (currentFrame - drawStatsTime >= 5.0f)
+        {
+            const DrawStats &drawn = FrameDrawStats();
+            char line[256];
+            snprintf(line, sizeof(line), "DRAW:: %zu triangles per frame of %zu at full detail (%.0f%%), %zu draws, %zu meshes and %zu of %zu meshlets culled",
+                     drawn.triangles / drawStatsFrames, drawn.fullTriangles / drawStatsFrames,
+                     drawn.fullTriangles ? 100.0 * drawn.triangles / drawn.fullTriangles : 100.0, drawn.draws / drawStatsFrames,
+                     drawn.meshesCulled / drawStatsFrames, drawn.meshletsCulled / drawStatsFrames, drawn.meshletsTested / drawStatsFrames);
+            std::cout << line << std::endl;
+            // the render loop sets its uniforms through handles: this should stay at 0 once the models are loaded
+            snprintf(line, sizeof(line), "SHADER:: %.1f uniform lookups by name per frame; light block uploaded %u times, camera block %u times so far",
+                     (double)(UniformLookups() - uniformLookupsAtReport) / drawStatsFrames, lightBlock.Uploads(), cameraBlock.Uploads());
+            std::cout << line << std::endl;
+            uniformLookupsAtReport = UniformLookups();
+            GLState::Instance().Report(drawStatsFrames);
+            ResidencyManager::Instance().Report();
+            textureStreamer.ReportMips();
+            FrameDrawStats().Reset();
+            drawStatsFrames = 0;
+            drawStatsTime = currentFrame;
+        }
+
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (firstFrame)
+        {
+            char line[128];
+            snprintf(line, sizeof(line), "STARTUP:: first frame after %.1fms (%zu models still loading)",
+                     MillisecondsSince(startTime), modelStreamer.Pending());
+            std::cout << line << std::endl;
+            firstFrame = false;
+        }
     }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
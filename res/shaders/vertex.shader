@@ -1,21 +1,49 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// instanced draws (see InstanceBuffer.h) read the matrices per instance instead of the model uniform
+layout (location = 8) in mat4 instanceModel;
+layout (location = 12) in mat3 instanceNormalMatrix;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// shared with every program (see UniformBlock.h)
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+uniform bool instanced;
+
+// compact meshes (see VertexCompression.h) store positions as unorm16 within the mesh bounds and octahedral normals
+uniform bool compactVertex;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    vec3 position = positionOffset + positionScale * aPos.xyz;
+    vec3 normal = compactVertex ? octahedralDecode(aNormal.xy) : aNormal;
+
+    mat4 world = instanced ? instanceModel : model;
+    mat3 normalMatrix = instanced ? instanceNormalMatrix : mat3(transpose(inverse(model)));
+
+    FragPos = vec3(world * vec4(position, 1.0));
+    Normal = normalMatrix * normal;  
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}